@@ -0,0 +1,113 @@
+#include "batch.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+Mat4 view_matrix(const View& view, int width, int height) {
+    return getViewport(0, 0, width, height, 255) *
+           getProjection((view.eye - view.center).norm()) *
+           lookat(view.eye, view.center, view.up);
+}
+
+std::vector<View> turntable(const View& start, int frames) {
+    std::vector<View> views;
+    Vec3f axis = start.up;
+    axis.normalize();
+    Vec3f offset = start.eye - start.center;
+    for (int i = 0; i < frames; i++) {
+        // Rotación de offset alrededor de axis (fórmula de Rodrigues)
+        float angle = 2 * M_PI * i / frames;
+        float c = cosf(angle), s = sinf(angle);
+        Vec3f rotated = offset * c + (axis ^ offset) * s +
+                        axis * ((axis * offset) * (1 - c));
+        views.push_back(View{start.center + rotated, start.center, start.up});
+    }
+    return views;
+}
+
+// Lector mínimo para el formato de read_views: avanza p saltando espacios
+// y devuelve false si lo siguiente no es c
+static bool expect(const char*& p, char c) {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+    if (*p != c) return false;
+    p++;
+    return true;
+}
+
+static bool peek(const char*& p, char c) {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+    return *p == c;
+}
+
+static bool parse_vec3(const char*& p, Vec3f& v) {
+    if (!expect(p, '[')) return false;
+    for (int i = 0; i < 3; i++) {
+        if (i > 0 && !expect(p, ',')) return false;
+        char* end;
+        v.raw[i] = strtof(p, &end);
+        if (end == p) return false;
+        p = end;
+    }
+    return expect(p, ']');
+}
+
+static bool parse_view(const char*& p, View& view) {
+    view = View{Vec3f(), Vec3f(), Vec3f(0, 0, 1)};
+    bool hasEye = false;
+    if (!expect(p, '{')) return false;
+    if (expect(p, '}')) return false;
+    do {
+        if (!expect(p, '"')) return false;
+        const char* key = p;
+        while (*p != '\0' && *p != '"') p++;
+        std::string name(key, p - key);
+        if (!expect(p, '"') || !expect(p, ':')) return false;
+        Vec3f* value = name == "eye"      ? &view.eye
+                       : name == "center" ? &view.center
+                       : name == "up"     ? &view.up
+                                          : nullptr;
+        if (value == nullptr || !parse_vec3(p, *value)) return false;
+        hasEye = hasEye || value == &view.eye;
+    } while (expect(p, ','));
+    return expect(p, '}') && hasEye;
+}
+
+bool read_views(const char* filename, std::vector<View>& views) {
+    std::ifstream is(filename);
+    if (!is) {
+        std::cerr << "Can't read " << filename << std::endl;
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << is.rdbuf();
+    std::string text = buffer.str();
+    const char* p = text.c_str();
+    views.clear();
+    bool ok = expect(p, '[');
+    if (ok && !peek(p, ']')) {
+        do {
+            View view;
+            ok = parse_view(p, view);
+            if (ok) views.push_back(view);
+        } while (ok && expect(p, ','));
+    }
+    ok = ok && expect(p, ']');
+    if (!ok) {
+        std::cerr << "Invalid views file " << filename << " at offset "
+                  << p - text.c_str() << std::endl;
+        views.clear();
+    }
+    return ok;
+}
+
+BatchRenderer::BatchRenderer(int width, int height, int numThreads)
+    : width(width), height(height), numThreads(numThreads), lastStats() {
+    if (this->numThreads <= 0) {
+        this->numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
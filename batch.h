@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <vector>
+#include "geometry.h"
+#include "model.h"
+#include "our_gl.h"
+#include "pngimage/pngimage.h"
+#include "renderer.h"
+
+// Cámara de una vista: mira desde eye hacia center, con up hacia arriba
+struct View {
+    Vec3f eye, center, up;
+};
+
+// viewport * proyección * cámara de view para una imagen de width x height
+Mat4 view_matrix(const View& view, int width, int height);
+// Vistas de un archivo JSON: un array de objetos con "eye", "center" y "up"
+// (arrays de 3 números; center por defecto (0, 0, 0) y up (0, 0, 1)), p.ej.
+//   [{"eye": [7, 7, 7], "center": [0, 0, 0]}, ...]
+bool read_views(const char* filename, std::vector<View>& views);
+// frames vistas girando start alrededor del eje up que pasa por center
+std::vector<View> turntable(const View& start, int frames);
+
+// Dibujo de muchas vistas de un modelo en un solo proceso: el modelo y la
+// textura se cargan una vez, y cada hilo tiene su propio TileRenderer (con
+// sus buffers de vértices transformados), imagen y z-buffer, que reutiliza
+// en todas las vistas que dibuja. Los hilos se reparten las vistas (cada
+// uno toma la siguiente que quede)
+class BatchRenderer {
+   public:
+    struct Stats {
+        int frames;
+        double seconds;
+        double fps() const { return seconds > 0 ? frames / seconds : 0.0; }
+    };
+
+    // numThreads <= 0: uno por núcleo de la CPU
+    BatchRenderer(int width, int height, int numThreads = 0);
+    int threads() const { return numThreads; }
+    const Stats& stats() const { return lastStats; }
+
+    // Dibuja model desde cada vista con una copia de shader, que debe tener
+    // un miembro Mat4 mvp (se le asigna view_matrix de la vista)
+    // output(i, image) recibe la imagen de la vista i en el hilo que la ha
+    // dibujado (a la vez que otros hilos). Puede modificarla o cambiar su
+    // memoria por otra del mismo tamaño (ver FrameWriter): se vuelve a usar
+    // para otra vista en cuanto output termina
+    template <typename Shader, typename Output>
+    void render(const Model& model, const std::vector<View>& views,
+                const Shader& shader, Output output) {
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        int workers = std::max(1, std::min(numThreads, (int)views.size()));
+        // Con menos vistas que hilos, cada vista se dibuja con varios
+        int rendererThreads = std::max(1, numThreads / workers);
+        std::atomic<int> next(0);
+        auto work = [&]() {
+            TileRenderer renderer(rendererThreads);
+            PNGImage image(width, height, RGBColor::Black);
+            ZBuffer zbuffer(width, height);
+            Shader copy = shader;
+            for (int i = next++; i < (int)views.size(); i = next++) {
+                image.fill(RGBColor::Black);
+                zbuffer.fill(-std::numeric_limits<float>::max());
+                copy.mvp = view_matrix(views[i], width, height);
+                renderer.draw(model, copy, image, zbuffer);
+                output(i, image);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int i = 1; i < workers; i++) threads.push_back(std::thread(work));
+        work();
+        for (std::thread& t : threads) t.join();
+        lastStats.frames = views.size();
+        lastStats.seconds = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    }
+
+   private:
+    int width, height;
+    int numThreads;
+    Stats lastStats;
+};
@@ -0,0 +1,87 @@
+// Benchmark de las sumas de comprobación (CRC-32 y Adler-32): velocidad de
+// cada implementación disponible en la CPU, comprobando que todas dan el
+// mismo resultado
+// Uso: bench_checksum [megabytes]
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "../pngimage/checksum.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Compara cada implementación con la primera (la más simple) en tamaños y
+// alineamientos variados, encadenando llamadas
+static bool check(const std::vector<Checksum::Implementation>& impls,
+                  uint32_t initial, const uint8_t* data) {
+    bool ok = true;
+    for (size_t i = 1; i < impls.size(); i++) {
+        for (size_t length = 0; length < 600; length += 7) {
+            for (size_t offset = 0; offset < 16; offset += 5) {
+                uint32_t expected =
+                    impls[0].update(initial, data + offset, length);
+                uint32_t split = impls[i].update(
+                    impls[i].update(initial, data + offset, length / 3),
+                    data + offset + length / 3, length - length / 3);
+                if (split != expected) {
+                    std::cerr << impls[i].name << " differs at length "
+                              << length << std::endl;
+                    ok = false;
+                }
+            }
+        }
+    }
+    return ok;
+}
+
+static void run(const char* title,
+                const std::vector<Checksum::Implementation>& impls,
+                uint32_t initial, const uint8_t* data, size_t length) {
+    uint32_t expected = impls[0].update(initial, data, length);
+    for (size_t i = 0; i < impls.size(); i++) {
+        // Repetir hasta medir al menos medio segundo
+        int reps = 0;
+        uint32_t result = 0;
+        Clock::time_point start = Clock::now();
+        do {
+            result = impls[i].update(initial, data, length);
+            reps++;
+        } while (seconds_since(start) < 0.5);
+        double time = seconds_since(start) / reps;
+        std::cout << std::left << std::setw(10) << title << std::setw(8)
+                  << impls[i].name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(10)
+                  << length / time / 1e9 << " GB/s  " << std::hex
+                  << std::setw(8) << std::setfill('0') << result << std::dec
+                  << std::setfill(' ')
+                  << (result == expected ? "" : "  MISMATCH") << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = argc > 1 ? atoi(argv[1]) : 1;  // cabe en caché
+    size_t length = megabytes << 20;
+    std::vector<uint8_t> data(length);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < length; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+
+    std::vector<Checksum::Implementation> crcs =
+        Checksum::crc32_implementations();
+    std::vector<Checksum::Implementation> adlers =
+        Checksum::adler32_implementations();
+    bool ok = check(crcs, 0, data.data()) && check(adlers, 1, data.data());
+
+    std::cout << megabytes << " MB of random data" << std::endl;
+    run("crc32", crcs, 0, data.data(), length);
+    run("adler32", adlers, 1, data.data(), length);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+// Benchmark de la lectura de modelos .obj: compara ObjLoader (con uno y
+// varios hilos) con el lector anterior basado en getline/istringstream,
+// comprobando que todos leen lo mismo
+// Usa obj/african_head.obj y esferas generadas (en índices absolutos y
+// negativos) con el número de triángulos indicado
+// También mide la carga completa de Model (malla y textura) desde el .obj y
+// el .png o desde la caché binaria (ver MeshCache)
+// Uso: bench_obj [miles de triángulos de la esfera]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../model.h"
+#include "../objloader.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Lector anterior de Model::Model (solo caras v/vt/vn), para comparar
+static void legacy_load(const char* filename, ObjMesh& mesh) {
+    mesh.clear();
+    std::ifstream is(filename);
+    std::string line;
+    while (!is.eof()) {
+        std::getline(is, line);
+        std::istringstream iss(line.c_str());
+        char ctrash;
+        if (line.compare(0, 2, "v ") == 0) {
+            iss >> ctrash;
+            Vec3f v;
+            for (int i = 0; i < 3; i++) iss >> v.raw[i];
+            mesh.verts.push_back(v);
+        } else if (line.compare(0, 3, "vt ") == 0) {
+            iss >> ctrash >> ctrash;
+            Vec2f v;
+            for (int i = 0; i < 2; i++) iss >> v.raw[i];
+            mesh.uvs.push_back(v);
+        } else if (line.compare(0, 3, "vn ") == 0) {
+            iss >> ctrash >> ctrash;
+            Vec3f v;
+            for (int i = 0; i < 3; i++) iss >> v.raw[i];
+            mesh.norms.push_back(v);
+        } else if (line.compare(0, 2, "f ") == 0) {
+            iss >> ctrash;
+            std::vector<Vec3i> f;
+            int idx, iduv, idnorm;
+            while (iss >> idx >> ctrash >> iduv >> ctrash >> idnorm) {
+                f.push_back(Vec3i(idx - 1, iduv - 1, idnorm - 1));
+            }
+            // El renderer solo usaba las 3 primeras esquinas
+            for (int i = 0; i < 3 && i < (int)f.size(); i++) {
+                mesh.corners.push_back(f[i]);
+            }
+        }
+    }
+}
+
+// Esfera de stacks x slices cuadriláteros (2 triángulos cada uno)
+static bool write_sphere(const char* filename, int stacks, int slices,
+                         bool relative) {
+    FILE* file = fopen(filename, "w");
+    if (file == nullptr) {
+        std::cerr << "Can't write " << filename << std::endl;
+        return false;
+    }
+    fprintf(file, "# esfera %dx%d\n", stacks, slices);
+    int count = 0;  // vértices escritos
+    for (int i = 0; i < stacks; i++) {
+        for (int j = 0; j < slices; j++) {
+            // Cada cuadrilátero con sus propios vértices, para que los
+            // índices relativos sean cortos
+            const int di[4] = {0, 1, 1, 0}, dj[4] = {0, 0, 1, 1};
+            for (int k = 0; k < 4; k++) {
+                float theta = M_PI * (i + di[k]) / stacks;
+                float phi = 2 * M_PI * (j + dj[k]) / slices;
+                float x = sinf(theta) * cosf(phi), y = cosf(theta),
+                      z = sinf(theta) * sinf(phi);
+                fprintf(file, "v %.6f %.6f %.6f\n", x, y, z);
+                fprintf(file, "vt %.6f %.6f\n", (float)(j + dj[k]) / slices,
+                        (float)(i + di[k]) / stacks);
+                fprintf(file, "vn %.6f %.6f %.6f\n", x, y, z);
+            }
+            const int tris[6] = {0, 1, 2, 0, 2, 3};
+            for (int t = 0; t < 6; t += 3) {
+                fprintf(file, "f");
+                for (int k = t; k < t + 3; k++) {
+                    int id = relative ? tris[k] - 4 : count + tris[k] + 1;
+                    fprintf(file, " %d/%d/%d", id, id, id);
+                }
+                fprintf(file, "\n");
+            }
+            count += 4;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static bool same(const ObjMesh& a, const ObjMesh& b) {
+    return a.verts.size() == b.verts.size() && a.uvs.size() == b.uvs.size() &&
+           a.norms.size() == b.norms.size() &&
+           a.corners.size() == b.corners.size() &&
+           memcmp(a.verts.data(), b.verts.data(),
+                  a.verts.size() * sizeof(Vec3f)) == 0 &&
+           memcmp(a.uvs.data(), b.uvs.data(), a.uvs.size() * sizeof(Vec2f)) ==
+               0 &&
+           memcmp(a.norms.data(), b.norms.data(),
+                  a.norms.size() * sizeof(Vec3f)) == 0 &&
+           memcmp(a.corners.data(), b.corners.data(),
+                  a.corners.size() * sizeof(Vec3i)) == 0;
+}
+
+static size_t file_size(const char* filename) {
+    std::ifstream is(filename, std::ios::binary | std::ios::ate);
+    return is.is_open() ? (size_t)is.tellg() : 0;
+}
+
+static void report(const char* name, double time, size_t bytes, bool ok) {
+    std::cout << "  " << std::left << std::setw(12) << name << std::right
+              << std::fixed << std::setprecision(2) << std::setw(9)
+              << time * 1e3 << " ms " << std::setw(8) << bytes / time / 1e6
+              << " MB/s" << (ok ? "" : "  MISMATCH") << std::endl;
+}
+
+// Tiempo medio de load (repitiendo hasta medir al menos medio segundo)
+template <typename Load>
+static double measure(Load load, ObjMesh& mesh) {
+    int reps = 0;
+    Clock::time_point start = Clock::now();
+    do {
+        load(mesh);
+        reps++;
+    } while (seconds_since(start) < 0.5);
+    return seconds_since(start) / reps;
+}
+
+// reference: malla esperada (leída con el lector anterior si es nullptr)
+static bool run(const char* filename, const ObjMesh* reference) {
+    size_t bytes = file_size(filename);
+    std::cout << filename << " (" << bytes / 1000 << " KB)" << std::endl;
+    ObjMesh legacy, mesh;
+    bool ok = true;
+    if (reference == nullptr) {
+        double time = measure(
+            [&](ObjMesh& m) { legacy_load(filename, m); }, legacy);
+        report("istringstream", time, bytes, true);
+        reference = &legacy;
+    }
+    int hw = std::max(1u, std::thread::hardware_concurrency());
+    const int threads[3] = {1, hw, std::max(hw, 4)};
+    for (int i = 0; i < 3; i++) {
+        if (i > 0 && threads[i] == threads[i - 1]) continue;
+        bool loaded = true;
+        double time = measure(
+            [&](ObjMesh& m) {
+                loaded = ObjLoader::load(filename, m, threads[i]);
+            },
+            mesh);
+        bool equal = loaded && same(mesh, *reference);
+        ok = ok && equal;
+        std::string name = "ObjLoader x" + std::to_string(threads[i]);
+        report(name.c_str(), time, bytes, equal);
+    }
+    return ok;
+}
+
+static void run_model(const char* filename) {
+    std::cout << "Model " << filename << std::endl;
+    delete new Model(filename);  // crear la caché si no existe
+    for (int useCache = 0; useCache < 2; useCache++) {
+        int reps = 0;
+        Clock::time_point start = Clock::now();
+        do {
+            delete new Model(filename, useCache);
+            reps++;
+        } while (seconds_since(start) < 0.5);
+        double time = seconds_since(start) / reps;
+        std::cout << "  " << std::left << std::setw(12)
+                  << (useCache ? "mesh cache" : "obj + png") << std::right
+                  << std::fixed << std::setprecision(3) << std::setw(9)
+                  << time * 1e3 << " ms" << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    int kiloTris = argc > 1 ? atoi(argv[1]) : 500;
+    int side = std::max(1, (int)sqrt(kiloTris * 1000 / 2.0));
+    bool ok = run("obj/african_head.obj", nullptr);
+    run_model("obj/african_head.obj");
+
+    const char* absoluteName = "bin/bench_sphere.obj";
+    const char* relativeName = "bin/bench_sphere_relative.obj";
+    if (!write_sphere(absoluteName, side, side, false) ||
+        !write_sphere(relativeName, side, side, true)) {
+        return 1;
+    }
+    ok = run(absoluteName, nullptr) && ok;
+    // Con índices negativos se compara con la esfera en índices absolutos
+    ObjMesh reference;
+    ok = ObjLoader::load(absoluteName, reference, 1) &&
+         run(relativeName, &reference) && ok;
+    remove(absoluteName);
+    remove(relativeName);
+    return ok ? 0 : 1;
+}
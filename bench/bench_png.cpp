@@ -0,0 +1,108 @@
+// Benchmark del codificador PNG: tiempo, velocidad y tamaño de salida de
+// cada nivel de compresión (con un hilo), comprobando que la imagen se
+// decodifica igual, y velocidad de la compresión por franjas en varios
+// hilos de una imagen grande (la de entrada repetida 4x4 veces)
+// Uso: bench_png [imagen.png]
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include "../pngimage/pngchunk.h"
+#include "../pngimage/pngimage.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    const char* filename = argc > 1 ? argv[1] : "obj/african_head_diffuse.png";
+    PNGImage image;
+    if (!image.read_png_file(filename)) return 1;
+    double rawMB = image.width * image.channels * image.height / 1e6;
+    std::cout << filename << ": " << image.width << "x" << image.height
+              << ", " << rawMB << " MB" << std::endl;
+    std::cout << "level  size (bytes)  ratio  encode (ms)  encode MB/s  "
+                 "decode (ms)  decode MB/s"
+              << std::endl;
+
+    PNGImage decoded(image.width, image.height, RGBColor::Black,
+                     image.channels);
+    for (int level = Deflater::MIN_LEVEL; level <= Deflater::MAX_LEVEL;
+         level++) {
+        // Repetir hasta medir al menos medio segundo (con el mismo encoder,
+        // que reutiliza su memoria)
+        PNGChunk::IDATEncoder encoder(image.width, image.channels, level, 1);
+        uint8_t* data;
+        size_t size;
+        uint32_t crc;
+        int reps = 0;
+        Clock::time_point start = Clock::now();
+        do {
+            encoder.encode(image.data(), image.height, image.stride, true,
+                           data, size, crc);
+            reps++;
+        } while (seconds_since(start) < 0.5);
+        double encodeTime = seconds_since(start) / reps;
+
+        // data sigue siendo la salida de la última vez
+        PNGChunk::IDATInfo info;
+        info.read_info(data, size);
+        reps = 0;
+        bool ok = true;
+        start = Clock::now();
+        do {
+            ok = ok && info.process_pixels(decoded.width, decoded.height,
+                                           decoded.channels, decoded.data(),
+                                           decoded.stride);
+            reps++;
+        } while (seconds_since(start) < 0.5);
+        double decodeTime = seconds_since(start) / reps;
+        ok = ok && memcmp(image.data(), decoded.data(), image.size_bytes()) == 0;
+
+        std::cout << std::fixed << std::setprecision(2) << std::setw(5)
+                  << level << std::setw(14) << size << std::setw(7)
+                  << rawMB * 1e6 / size << std::setw(13) << encodeTime * 1e3
+                  << std::setw(13) << rawMB / encodeTime << std::setw(13)
+                  << decodeTime * 1e3 << std::setw(13) << rawMB / decodeTime
+                  << (ok ? "" : "  ROUNDTRIP FAILED") << std::endl;
+    }
+
+    PNGImage large(4 * image.width, 4 * image.height, RGBColor::Black,
+                   image.channels);
+    int rowBytes = image.width * image.channels;
+    for (int y = 0; y < large.height; y++) {
+        for (int i = 0; i < 4; i++) {
+            memcpy(large.row(y) + i * rowBytes, image.row(y % image.height),
+                   rowBytes);
+        }
+    }
+    double largeMB = large.size_bytes() / 1e6;
+    std::cout << large.width << "x" << large.height << ", level "
+              << Deflater::DEFAULT_LEVEL << std::endl
+              << "threads  size (bytes)  encode (ms)  encode MB/s" << std::endl;
+    int hw = std::max(1u, std::thread::hardware_concurrency());
+    for (int threads = 1;; threads = std::min(2 * threads, hw)) {
+        PNGChunk::IDATEncoder encoder(large.width, large.channels,
+                                      Deflater::DEFAULT_LEVEL, threads);
+        uint8_t* data;
+        size_t size;
+        uint32_t crc;
+        int reps = 0;
+        Clock::time_point start = Clock::now();
+        do {
+            encoder.encode(large.data(), large.height, large.stride, true,
+                           data, size, crc);
+            reps++;
+        } while (seconds_since(start) < 0.5);
+        double encodeTime = seconds_since(start) / reps;
+        std::cout << std::setw(7) << threads << std::setw(14) << size
+                  << std::setw(13) << encodeTime * 1e3 << std::setw(13)
+                  << largeMB / encodeTime << std::endl;
+        if (threads == hw) break;
+    }
+    return 0;
+}
@@ -0,0 +1,304 @@
+// Benchmark del dibujo con TileRenderer: tiempo de cada fase (vértices,
+// reparto en celdas y rasterización) con 1 hilo y con uno por núcleo
+// También muestra cuántas esquinas reutilizan un vértice ya transformado y
+// el tiempo que ahorra frente a transformar cada esquina por separado (como
+// antes de la fase de vértices), y el trabajo que elimina el ensamblado:
+// caras descartadas o recortadas y pixels procesados con y sin descartar
+// las caras de espaldas a la cámara. Por último compara el z-buffer con y
+// sin mínimos por celda y en float o con enteros de 16 bits, y el modo
+// inmediato con el diferido (pixels sombreados y tiempo) con un shader
+// barato y otro caro, el dibujo de muchas vistas en lote con el de una
+// ejecución por vista (y escribiendo los PNG en el mismo hilo o en segundo
+// plano), y el coste de cada filtro de textura y de generar los mipmaps
+// Uso: bench_render [modelo.obj ...]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../batch.h"
+#include "../framewriter.h"
+#include "../model.h"
+#include "../our_gl.h"
+#include "../renderer.h"
+#include "../texture.h"
+#include "bench_shaders.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static const int WIDTH = 800, HEIGHT = 800;
+
+// Media de cada fase en al menos medio segundo de dibujos
+template <typename Shader>
+static TileRenderer::Stats measure(
+    TileRenderer& renderer, const Model& model, const Shader& shader,
+    ZBuffer::Format format = ZBuffer::FLOAT32, bool hierarchical = true) {
+    PNGImage image(WIDTH, HEIGHT, RGBColor::Black);
+    ZBuffer zbuffer(WIDTH, HEIGHT, format);
+    zbuffer.hierarchical = hierarchical;
+    TileRenderer::Stats total = TileRenderer::Stats();
+    int reps = 0;
+    Clock::time_point start = Clock::now();
+    do {
+        zbuffer.fill(-std::numeric_limits<float>::max());
+        renderer.draw(model, shader, image, zbuffer);
+        // Los contadores son iguales en todos los dibujos
+        const TileRenderer::Stats& stats = renderer.stats();
+        double vertexTime = total.vertexTime, binTime = total.binTime;
+        double rasterTime = total.rasterTime;
+        total = stats;
+        total.vertexTime = vertexTime;
+        total.binTime = binTime;
+        total.rasterTime = rasterTime;
+        total.vertexTime += stats.vertexTime;
+        total.binTime += stats.binTime;
+        total.rasterTime += stats.rasterTime;
+        reps++;
+    } while (seconds_since(start) < 0.5);
+    total.vertexTime /= reps;
+    total.binTime /= reps;
+    total.rasterTime /= reps;
+    return total;
+}
+
+// Tiempo de transformar cada vértice una vez (como la fase de vértices) o
+// las 3 esquinas de cada cara por separado, llamando a vertex a través de
+// IShader como el renderer (noinline: sin que el compilador sepa el tipo del
+// shader). Se repite sin dibujar entre medias, con los datos en caché
+__attribute__((noinline)) static double measure_vertices(const Model& model,
+                                                         IShader& shader,
+                                                         bool perCorner) {
+    std::vector<Vec4f> positions(3 * model.nfaces());
+    std::vector<float> varyings(positions.size() * shader.varying_count());
+    int reps = 0;
+    Clock::time_point start = Clock::now();
+    do {
+        if (perCorner) {
+            for (int i = 0; i < 3 * model.nfaces(); i++) {
+                positions[i] = shader.vertex(
+                    model.face(i / 3)[i % 3],
+                    varyings.data() + i * shader.varying_count());
+            }
+        } else {
+            for (int i = 0; i < model.nverts(); i++) {
+                positions[i] = shader.vertex(
+                    i, varyings.data() + i * shader.varying_count());
+            }
+        }
+        reps++;
+    } while (seconds_since(start) < 0.5);
+    return seconds_since(start) / reps;
+}
+
+static void run(const char* filename) {
+    Model model(filename);
+    std::cout << filename << ": " << model.nfaces() << " triangles, "
+              << model.nverts() << " vertices" << std::endl;
+    Vec3f camera(7.0f, 7.0f, 7.0f);
+    Vec3f eye(-1.0f, -1.0f, -1.0f);
+    Vec3f up(0.0f, 0.0f, 1.0f);
+    BenchShader shader;
+    shader.model = &model;
+    shader.light = Vec3f(1, 1, 1).normalize();
+    View view = {camera, eye.normalize(), up};
+    shader.mvp = view_matrix(view, WIDTH, HEIGHT);
+
+    int hw = std::max(1u, std::thread::hardware_concurrency());
+    const int threads[2] = {1, hw};
+    std::cout << "  threads  vertex (ms)  bin (ms)  raster (ms)" << std::endl;
+    TileRenderer::Stats stats = TileRenderer::Stats();
+    for (int i = 0; i < 2; i++) {
+        if (i > 0 && threads[i] == threads[i - 1]) continue;
+        TileRenderer renderer(threads[i]);
+        stats = measure(renderer, model, shader);
+        std::cout << std::fixed << std::setprecision(3) << std::setw(9)
+                  << threads[i] << std::setw(13) << stats.vertexTime * 1e3
+                  << std::setw(10) << stats.binTime * 1e3 << std::setw(13)
+                  << stats.rasterTime * 1e3 << std::endl;
+    }
+    BenchShader copy = shader;
+    double verticesTime = measure_vertices(model, copy, false);
+    double cornersTime = measure_vertices(model, copy, true);
+    std::cout << "  vertex cache: " << std::setprecision(1)
+              << stats.hit_rate() * 100 << "% hits, " << std::setprecision(3)
+              << verticesTime * 1e3 << " ms per vertex vs " << cornersTime * 1e3
+              << " ms per corner (saved " << (cornersTime - verticesTime) * 1e3
+              << " ms)" << std::endl;
+
+    std::cout << "  assembly: " << stats.faces << " faces, "
+              << stats.culledFrustum << " outside, " << stats.clipped
+              << " clipped, " << stats.culledBackFace << " back-facing, "
+              << stats.culledSmall << " too small, " << stats.triangles
+              << " drawn" << std::endl;
+    TileRenderer noCulling(hw);
+    noCulling.set_back_face_culling(false);
+    TileRenderer::Stats all = measure(noCulling, model, shader);
+    std::cout << std::setprecision(3) << "  fragments: " << stats.fragments
+              << " (" << stats.shaded << " shaded) vs " << all.fragments
+              << " (" << all.shaded << " shaded) without back-face culling, "
+              << "raster " << stats.rasterTime * 1e3 << " vs "
+              << all.rasterTime * 1e3 << " ms" << std::endl;
+
+    std::cout << "  z-buffer         raster (ms)  occluded pixels  occluded "
+                 "triangles" << std::endl;
+    const char* names[3] = {"float", "float, no hi-z", "unorm16"};
+    for (int i = 0; i < 3; i++) {
+        TileRenderer renderer(hw);
+        TileRenderer::Stats z = measure(
+            renderer, model, shader,
+            i < 2 ? ZBuffer::FLOAT32 : ZBuffer::UNORM16, i != 1);
+        std::cout << "  " << std::left << std::setw(15) << names[i]
+                  << std::right << std::setw(13) << z.rasterTime * 1e3
+                  << std::setw(17) << z.occluded << std::setw(21)
+                  << z.occludedTriangles << std::endl;
+    }
+
+    // Inmediato: un pixel se sombrea cada vez que pasa el test de
+    // profundidad, diferido: una vez (el de punto de luz descarta pixels:
+    // se dibuja en modo inmediato aunque se pida diferido)
+    BenchPointLight pointLight;
+    pointLight.model = &model;
+    pointLight.mvp = shader.mvp;
+    pointLight.light = shader.light;
+    pointLight.light_center = Vec3f(0.0f, 0.0f, 0.25f);
+    pointLight.light_radius = 1.0f;
+    std::cout << "  shader       mode       raster (ms)  shaded pixels  "
+                 "overdraw" << std::endl;
+    for (int i = 0; i < 2; i++) {
+        TileRenderer::Stats modes[2];
+        for (int deferred = 0; deferred < 2; deferred++) {
+            TileRenderer renderer(hw);
+            if (deferred) renderer.set_mode(TileRenderer::DEFERRED);
+            modes[deferred] = i == 0
+                                  ? measure(renderer, model, shader)
+                                  : measure(renderer, model, pointLight);
+        }
+        for (int deferred = 0; deferred < 2; deferred++) {
+            std::cout << "  " << std::left << std::setw(13)
+                      << (i == 0 ? "gouraud" : "point light") << std::setw(9)
+                      << (!deferred ? "immediate"
+                                    : i == 0 ? "deferred" : "(immed.)")
+                      << std::right
+                      << std::setw(13) << modes[deferred].rasterTime * 1e3
+                      << std::setw(15) << modes[deferred].invocations
+                      << std::setw(10) << std::setprecision(2)
+                      << (double)modes[deferred].invocations /
+                             modes[1].invocations
+                      << std::setprecision(3) << std::endl;
+        }
+    }
+
+    // Vistas en lote frente a una ejecución por vista: cargar el modelo
+    // (desde la caché), reservar imagen y buffers y dibujar (sin contar
+    // arrancar el proceso ni escribir las imágenes)
+    std::vector<View> views = turntable(view, 16);
+    BatchRenderer batch(WIDTH, HEIGHT, hw);
+    batch.render(model, views, shader, [](int, PNGImage&) {});
+    Clock::time_point start = Clock::now();
+    for (const View& v : views) {
+        Model copy(filename);
+        BenchShader single = shader;
+        single.model = &copy;
+        single.mvp = view_matrix(v, WIDTH, HEIGHT);
+        PNGImage image(WIDTH, HEIGHT, RGBColor::Black);
+        ZBuffer zbuffer(WIDTH, HEIGHT);
+        zbuffer.fill(-std::numeric_limits<float>::max());
+        TileRenderer renderer(hw);
+        renderer.draw(copy, single, image, zbuffer);
+    }
+    double separate = seconds_since(start);
+    std::cout << "  batch: " << views.size() << " views, "
+              << std::setprecision(1) << batch.stats().fps()
+              << " frames/s vs " << views.size() / separate
+              << " frames/s loading the model for each view"
+              << std::setprecision(3) << std::endl;
+
+    // Y escribiendo las imágenes (en bin/, se borran al terminar): en el
+    // hilo que dibuja o con FrameWriter, que las escribe mientras se dibujan
+    // las siguientes
+    std::vector<std::string> frameNames;
+    for (size_t i = 0; i < views.size(); i++) {
+        frameNames.push_back("bin/bench_frame_" + std::to_string(i) + ".png");
+    }
+    start = Clock::now();
+    batch.render(model, views, shader, [&](int i, PNGImage& image) {
+        image.flip_vertically();
+        image.write_png_file(frameNames[i].c_str());
+    });
+    double inline_ = seconds_since(start);
+    start = Clock::now();
+    FrameWriter::Stats output;
+    {
+        FrameWriter writer(hw);
+        batch.render(model, views, shader, [&](int i, PNGImage& image) {
+            writer.write(image, frameNames[i], true);
+        });
+        writer.flush();
+        output = writer.stats();
+    }
+    double async = seconds_since(start);
+    for (const std::string& name : frameNames) std::remove(name.c_str());
+    std::cout << "  batch + PNG: " << std::setprecision(1)
+              << views.size() / inline_ << " frames/s writing in the drawing "
+              << "thread vs " << views.size() / async
+              << " frames/s with FrameWriter (" << output.meanLatency * 1e3
+              << " ms mean latency, " << output.waitSeconds
+              << " s waiting for a buffer)" << std::setprecision(3)
+              << std::endl;
+
+    std::cout << "  texture filter  raster (ms)" << std::endl;
+    const char* filters[3] = {"nearest", "bilinear", "trilinear"};
+    for (int i = 0; i < 3; i++) {
+        TileRenderer renderer(hw);
+        BenchShader filtered = shader;
+        filtered.filter = (Texture::Filter)i;
+        TileRenderer::Stats f = measure(renderer, model, filtered);
+        std::cout << "  " << std::left << std::setw(14) << filters[i]
+                  << std::right << std::setw(13) << f.rasterTime * 1e3
+                  << std::endl;
+    }
+}
+
+// Tiempo de generar los mipmaps de la textura de filename con 1 hilo y con
+// uno por núcleo
+static void run_texture(const char* filename) {
+    PNGImage image;
+    if (!image.read_png_file(filename)) return;
+    std::cout << filename << ": " << image.width << "x" << image.height
+              << std::endl;
+    int hw = std::max(1u, std::thread::hardware_concurrency());
+    const int threads[2] = {1, hw};
+    std::cout << "  threads  mipmaps (ms)" << std::endl;
+    for (int i = 0; i < 2; i++) {
+        if (i > 0 && threads[i] == threads[i - 1]) continue;
+        Texture texture;
+        int reps = 0;
+        Clock::time_point start = Clock::now();
+        do {
+            texture.build(image, true, threads[i]);
+            reps++;
+        } while (seconds_since(start) < 0.5);
+        std::cout << std::setw(9) << threads[i] << std::setw(14)
+                  << seconds_since(start) / reps * 1e3 << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) run(argv[i]);
+    } else {
+        run("obj/african_head.obj");
+        run("obj/spaceship.obj");
+        run_texture("obj/african_head_diffuse.png");
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+
+#include "../geometry.h"
+#include "../model.h"
+#include "../our_gl.h"
+#include "../texture.h"
+
+// Shaders de los benchmarks de dibujo (bench_render y bench_suite)
+
+// Igual que GouraudShader de main.cpp, con el filtro de textura a elegir
+struct BenchShader : public ShaderBase<BenchShader> {
+    static const bool CAN_DISCARD = false;  // ver IShader
+    const Model* model;
+    Mat4 mvp;
+    Vec3f light;
+    Texture::Filter filter = Texture::TRILINEAR;
+    Vec3f varying_intensity;
+    Vec2f varying_uvs[3];
+
+    int varying_count() const override { return 3; }
+
+    Vec4f vertex(int ivert, float* varyings) override {
+        Vec2f uv = model->uv(ivert);
+        float intensity = light * model->norm(ivert);
+        varyings[0] = uv.x;
+        varyings[1] = uv.y;
+        varyings[2] = std::max(0.0f, intensity);
+        return mvp * Vec4f(model->vert(ivert), 1.0f);
+    }
+
+    void set_varyings(const float* const varyings[3]) override {
+        for (int i = 0; i < 3; i++) {
+            varying_uvs[i] = Vec2f(varyings[i][0], varyings[i][1]);
+            varying_intensity.raw[i] = varyings[i][2];
+        }
+    }
+
+    bool fragment(Vec3f bar, RGBColor& color) override {
+        Vec2f uv;
+        for (int i = 0; i < 3; i++) {
+            uv = uv + varying_uvs[i] * bar.raw[i];
+        }
+        float intensity = varying_intensity * bar;
+        color = model->diffuse(uv) * intensity;
+        return false;
+    }
+
+    uint32_t fragment_block(FragmentBlock& block, uint32_t mask) override {
+        float u[BLOCK_SIZE], v[BLOCK_SIZE], intensity[BLOCK_SIZE];
+        for (int i = 0; i < BLOCK_SIZE; i++) {
+            float b0 = block.bar[0][i], b1 = block.bar[1][i],
+                  b2 = block.bar[2][i];
+            u[i] = 0.0f + varying_uvs[0].x * b0 + varying_uvs[1].x * b1 +
+                   varying_uvs[2].x * b2;
+            v[i] = 0.0f + varying_uvs[0].y * b0 + varying_uvs[1].y * b1 +
+                   varying_uvs[2].y * b2;
+            intensity[i] = varying_intensity.x * b0 +
+                           varying_intensity.y * b1 + varying_intensity.z * b2;
+        }
+        model->texture().sample_block(u, v, BLOCK_WIDTH, mask, filter,
+                                      block.colors);
+        for (int i = 0; i < BLOCK_SIZE; i++) {
+            if (mask >> i & 1) block.colors[i] = block.colors[i] * intensity[i];
+        }
+        return 0;
+    }
+};
+
+// Igual que PointLightShader de main.cpp (matriz por vector y raíz
+// cuadrada por pixel)
+struct BenchPointLight : public ShaderBase<BenchPointLight> {
+    const Model* model;
+    Mat4 mvp;
+    Vec3f light;
+    Mat3 varying_vertices;
+    Vec3f varying_intensity;
+    Vec3f light_center;
+    float light_radius;
+
+    int varying_count() const override { return 4; }
+
+    Vec4f vertex(int ivert, float* varyings) override {
+        Vec3f vert = model->vert(ivert);
+        float intensity = light * model->norm(ivert);
+        for (int i = 0; i < 3; i++) varyings[i] = vert.raw[i];
+        varyings[3] = std::max(0.0f, intensity);
+        return mvp * Vec4f(vert, 1.0f);
+    }
+
+    void set_varyings(const float* const varyings[3]) override {
+        for (int j = 0; j < 3; j++) {
+            for (int i = 0; i < 3; i++) {
+                varying_vertices[i][j] = varyings[j][i];
+            }
+            varying_intensity.raw[j] = varyings[j][3];
+        }
+    }
+
+    bool fragment(Vec3f bar, RGBColor& color) override {
+        Vec3f pos = varying_vertices * bar;
+        float d = (light_center - pos).norm();
+        if (d > light_radius) return true;
+        float intensity_distance = 1.0f - d / light_radius;
+        intensity_distance = intensity_distance * intensity_distance;
+        float intensity_norm = varying_intensity * bar;
+        color = RGBColor::White * intensity_distance * intensity_norm;
+        return false;
+    }
+};
@@ -0,0 +1,425 @@
+// Batería de benchmarks de dibujo, para comparar versiones: dibuja
+// obj/african_head.obj, obj/spaceship.obj y esferas generadas (de 10 mil a
+// 10 millones de triángulos, con la textura de african_head) a varias
+// resoluciones y con los dos shaders de bench_render
+// De cada combinación da la mediana del tiempo de cada fase, triángulos por
+// segundo (del dibujo completo), fragmentos por segundo (de la
+// rasterización), reservas de memoria por dibujo (tras el primero deberían
+// ser 0) y el CRC-32 de la imagen (cambia si cambia el resultado), y de
+// cada modelo el tiempo de carga y la memoria residente máxima
+// Todo es determinista salvo los tiempos: cámara y mallas fijas y el mismo
+// número de hilos en cada ejecución (--threads)
+// --json guarda los resultados y --baseline los compara con los de otra
+// ejecución: tiempo de cada combinación respecto al anterior e imágenes que
+// han cambiado
+// Uso: bench_suite [--json archivo] [--baseline archivo] [--threads N]
+//                  [--max-triangles N] [--min-time segundos]
+#include <stdint.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../model.h"
+#include "../objloader.h"
+#include "../our_gl.h"
+#include "../pngimage/checksum.h"
+#include "../renderer.h"
+#include "bench_shaders.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Reservas de memoria de todo el programa (new y new[] de cualquier hilo)
+static std::atomic<uint64_t> allocations(0), allocatedBytes(0);
+
+void* operator new(size_t size) {
+    allocations++;
+    allocatedBytes += size;
+    void* p = malloc(size > 0 ? size : 1);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// Memoria residente máxima en KB desde el último reset_peak_rss (VmHWM en
+// Linux) o, si no se puede leer, desde el inicio del programa
+static long peak_rss_kb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return atol(line.c_str() + 6);
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void reset_peak_rss() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+}
+
+// Esfera de radio 1 con stacks x slices cuadriláteros (2 triángulos cada
+// uno), vértices compartidos y caras en sentido antihorario vistas desde
+// fuera
+static void make_sphere(int stacks, int slices, ObjMesh& mesh) {
+    mesh.clear();
+    for (int i = 0; i <= stacks; i++) {
+        for (int j = 0; j <= slices; j++) {
+            float theta = M_PI * i / stacks, phi = 2 * M_PI * j / slices;
+            Vec3f p(sinf(theta) * cosf(phi), cosf(theta),
+                    sinf(theta) * sinf(phi));
+            mesh.verts.push_back(p);
+            mesh.uvs.push_back(Vec2f((float)j / slices, (float)i / stacks));
+            mesh.norms.push_back(p);
+        }
+    }
+    mesh.corners.reserve((size_t)6 * stacks * slices);
+    for (int i = 0; i < stacks; i++) {
+        for (int j = 0; j < slices; j++) {
+            int a = i * (slices + 1) + j, b = a + slices + 1;
+            const int quad[6] = {a, a + 1, b + 1, a, b + 1, b};
+            for (int id : quad) mesh.corners.push_back(Vec3i(id, id, id));
+        }
+    }
+}
+
+struct Options {
+    const char* json = nullptr;
+    const char* baseline = nullptr;
+    int threads = 0;
+    long maxTriangles = 10000000;
+    double minTime = 0.5;
+};
+
+// Resultado de una combinación modelo / resolución / shader
+struct Result {
+    std::string scene;
+    int triangles;
+    double loadTime;
+    long peakRss;  // del modelo, se rellena al acabar con él
+    int width, height;
+    const char* shader;
+    int reps;
+    // Medianas en segundos
+    double frameTime, vertexTime, binTime, rasterTime;
+    int64_t drawn;  // triángulos que quedan tras el ensamblado
+    uint64_t fragments, shaded;
+    double allocationsPerFrame, bytesPerFrame;
+    uint32_t crc;
+};
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+// Un dibujo de calentamiento y después al menos 3 y al menos minTime
+// segundos de dibujos
+template <typename Shader>
+static void measure(TileRenderer& renderer, const Model& model,
+                    const Shader& shader, const Options& options,
+                    Result& result) {
+    PNGImage image(result.width, result.height, RGBColor::Black);
+    ZBuffer zbuffer(result.width, result.height);
+    zbuffer.fill(-std::numeric_limits<float>::max());
+    renderer.draw(model, shader, image, zbuffer);
+
+    std::vector<double> frame, vertex, bin, raster;
+    // Reservas de los dibujos, sin contar las de los vectores de tiempos
+    uint64_t drawAllocations = 0, drawBytes = 0;
+    Clock::time_point start = Clock::now();
+    do {
+        Clock::time_point drawStart = Clock::now();
+        uint64_t allocs0 = allocations, bytes0 = allocatedBytes;
+        zbuffer.fill(-std::numeric_limits<float>::max());
+        renderer.draw(model, shader, image, zbuffer);
+        drawAllocations += allocations - allocs0;
+        drawBytes += allocatedBytes - bytes0;
+        frame.push_back(seconds_since(drawStart));
+        const TileRenderer::Stats& stats = renderer.stats();
+        vertex.push_back(stats.vertexTime);
+        bin.push_back(stats.binTime);
+        raster.push_back(stats.rasterTime);
+    } while (frame.size() < 3 || seconds_since(start) < options.minTime);
+    result.reps = frame.size();
+    result.allocationsPerFrame = (double)drawAllocations / result.reps;
+    result.bytesPerFrame = (double)drawBytes / result.reps;
+    result.frameTime = median(frame);
+    result.vertexTime = median(vertex);
+    result.binTime = median(bin);
+    result.rasterTime = median(raster);
+    result.drawn = renderer.stats().triangles;
+    result.fragments = renderer.stats().fragments;
+    result.shaded = renderer.stats().shaded;
+    // El dibujo es determinista: la imagen es la misma en cada repetición
+    result.crc = 0;
+    for (int y = 0; y < image.height; y++) {
+        result.crc = Checksum::crc32(result.crc, image.row(y),
+                                     image.width * image.channels);
+    }
+}
+
+static void print_header() {
+    std::cout << "scene                  tris  resolution  shader       reps"
+                 "  frame (ms)    vertex       bin    raster  Mtri/s  Mfrag/s"
+                 "  allocs  crc"
+              << std::endl;
+}
+
+static void print(const Result& r) {
+    std::string resolution =
+        std::to_string(r.width) + "x" + std::to_string(r.height);
+    std::cout << std::left << std::setw(16) << r.scene << std::right
+              << std::setw(10) << r.triangles << "  " << std::left
+              << std::setw(12) << resolution << std::setw(11) << r.shader
+              << std::right << std::setw(6) << r.reps << std::fixed
+              << std::setprecision(3) << std::setw(12) << r.frameTime * 1e3
+              << std::setw(10) << r.vertexTime * 1e3 << std::setw(10)
+              << r.binTime * 1e3 << std::setw(10) << r.rasterTime * 1e3
+              << std::setprecision(2) << std::setw(8)
+              << r.triangles / r.frameTime / 1e6 << std::setw(9)
+              << r.fragments / r.rasterTime / 1e6 << std::setprecision(1)
+              << std::setw(8) << r.allocationsPerFrame << "  " << std::hex
+              << std::setw(8) << std::setfill('0') << r.crc << std::dec
+              << std::setfill(' ') << std::endl;
+}
+
+// Dibuja model con cada resolución y shader
+static void run(const std::string& name, const Model& model, double loadTime,
+                const Options& options, int threads,
+                std::vector<Result>& results) {
+    Vec3f camera(7.0f, 7.0f, 7.0f);
+    Vec3f eye(-1.0f, -1.0f, -1.0f);
+    Vec3f up(0.0f, 0.0f, 1.0f);
+    Vec3f light = Vec3f(1, 1, 1).normalize();
+    Mat4 view = getProjection((camera - eye).norm()) *
+                lookat(camera, eye.normalize(), up);
+    TileRenderer renderer(threads);
+    const int sizes[3] = {512, 1024, 2048};
+    size_t first = results.size();
+    for (int size : sizes) {
+        for (int s = 0; s < 2; s++) {
+            Result r = Result();
+            r.scene = name;
+            r.triangles = model.nfaces();
+            r.loadTime = loadTime;
+            r.width = r.height = size;
+            Mat4 mvp = getViewport(0, 0, size, size, 255) * view;
+            if (s == 0) {
+                BenchShader shader;
+                shader.model = &model;
+                shader.mvp = mvp;
+                shader.light = light;
+                r.shader = "gouraud";
+                measure(renderer, model, shader, options, r);
+            } else {
+                BenchPointLight shader;
+                shader.model = &model;
+                shader.mvp = mvp;
+                shader.light = light;
+                shader.light_center = Vec3f(0.0f, 0.0f, 0.25f);
+                shader.light_radius = 1.0f;
+                r.shader = "point light";
+                measure(renderer, model, shader, options, r);
+            }
+            print(r);
+            results.push_back(r);
+        }
+    }
+    long peak = peak_rss_kb();
+    for (size_t i = first; i < results.size(); i++) results[i].peakRss = peak;
+    std::cout << "  " << name << ": load " << std::setprecision(3)
+              << loadTime * 1e3 << " ms, peak RSS " << std::setprecision(1)
+              << peak / 1024.0 << " MB" << std::endl;
+}
+
+static bool write_json(const char* filename, const Options& options,
+                       int threads, const std::vector<Result>& results) {
+    std::ofstream os(filename);
+    if (!os) {
+        std::cerr << "Can't write " << filename << std::endl;
+        return false;
+    }
+    os << std::setprecision(9);
+    os << "{\n  \"version\": 1,\n  \"compiler\": \"" << __VERSION__
+       << "\",\n  \"raster\": \"" << raster_implementations().back()
+       << "\",\n  \"threads\": " << threads
+       << ",\n  \"min_time_s\": " << options.minTime
+       << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        os << "    {\"scene\": \"" << r.scene
+           << "\", \"triangles\": " << r.triangles
+           << ", \"load_s\": " << r.loadTime
+           << ", \"peak_rss_kb\": " << r.peakRss << ", \"width\": " << r.width
+           << ", \"height\": " << r.height << ", \"shader\": \"" << r.shader
+           << "\", \"reps\": " << r.reps << ", \"frame_s\": " << r.frameTime
+           << ", \"vertex_s\": " << r.vertexTime
+           << ", \"bin_s\": " << r.binTime
+           << ", \"raster_s\": " << r.rasterTime
+           << ", \"triangles_drawn\": " << r.drawn
+           << ", \"triangles_per_s\": " << r.triangles / r.frameTime
+           << ", \"fragments\": " << r.fragments
+           << ", \"shaded\": " << r.shaded
+           << ", \"fragments_per_s\": " << r.fragments / r.rasterTime
+           << ", \"allocations_per_frame\": " << r.allocationsPerFrame
+           << ", \"allocated_bytes_per_frame\": " << r.bytesPerFrame
+           << ", \"crc32\": " << r.crc << "}"
+           << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+    return (bool)os;
+}
+
+// Valor de "key" en una línea de resultado de write_json ("" si no está)
+static std::string json_field(const std::string& line, const char* key) {
+    std::string pattern = std::string("\"") + key + "\": ";
+    size_t pos = line.find(pattern);
+    if (pos == std::string::npos) return "";
+    pos += pattern.size();
+    if (line[pos] == '"') {
+        size_t end = line.find('"', pos + 1);
+        return line.substr(pos + 1, end - pos - 1);
+    }
+    return line.substr(pos, line.find_first_of(",}", pos) - pos);
+}
+
+// Compara results con los de filename (escrito por write_json)
+static bool compare(const char* filename, const std::vector<Result>& results) {
+    std::ifstream is(filename);
+    if (!is) {
+        std::cerr << "Can't read " << filename << std::endl;
+        return false;
+    }
+    std::cout << "baseline " << filename << " (frame time ratio, > 1: slower)"
+              << std::endl;
+    std::string line;
+    int changed = 0;
+    while (std::getline(is, line)) {
+        std::string scene = json_field(line, "scene");
+        if (scene.empty()) continue;
+        for (const Result& r : results) {
+            if (r.scene != scene || json_field(line, "shader") != r.shader ||
+                atoi(json_field(line, "width").c_str()) != r.width ||
+                atoi(json_field(line, "height").c_str()) != r.height) {
+                continue;
+            }
+            double ratio =
+                r.frameTime / atof(json_field(line, "frame_s").c_str());
+            bool sameImage =
+                strtoul(json_field(line, "crc32").c_str(), nullptr, 10) ==
+                r.crc;
+            if (!sameImage) changed++;
+            std::cout << "  " << std::left << std::setw(16) << r.scene
+                      << std::setw(11)
+                      << std::to_string(r.width) + "x" +
+                             std::to_string(r.height)
+                      << std::setw(11) << r.shader << std::right
+                      << std::setprecision(2) << std::setw(6) << ratio
+                      << (sameImage ? "" : "  image changed") << std::endl;
+        }
+    }
+    if (changed > 0) {
+        std::cout << "  " << changed << " images changed" << std::endl;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--json") == 0 && hasValue) {
+            options.json = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && hasValue) {
+            options.baseline = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && hasValue) {
+            options.threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-triangles") == 0 && hasValue) {
+            options.maxTriangles = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--min-time") == 0 && hasValue) {
+            options.minTime = atof(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--json file] [--baseline file] [--threads N]"
+                         " [--max-triangles N] [--min-time seconds]"
+                      << std::endl;
+            return 1;
+        }
+    }
+    int threads = options.threads > 0
+                      ? options.threads
+                      : std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "threads: " << threads
+              << ", raster: " << raster_implementations().back() << std::endl;
+    print_header();
+
+    std::vector<Result> results;
+    const char* models[2] = {"obj/african_head.obj", "obj/spaceship.obj"};
+    for (const char* filename : models) {
+        reset_peak_rss();
+        Clock::time_point start = Clock::now();
+        Model model(filename);
+        double loadTime = seconds_since(start);
+        std::string name(filename);
+        name = name.substr(name.find_last_of('/') + 1);
+        name = name.substr(0, name.find_last_of('.'));
+        run(name, model, loadTime, options, threads, results);
+    }
+    const long sphereTriangles[4] = {10000, 100000, 1000000, 10000000};
+    for (long triangles : sphereTriangles) {
+        if (triangles > options.maxTriangles) break;
+        reset_peak_rss();
+        // Generación de la malla aparte: el tiempo de carga es el de Model
+        int side = (int)std::sqrt(triangles / 2.0);
+        ObjMesh mesh;
+        make_sphere(side, side, mesh);
+        Clock::time_point start = Clock::now();
+        Model model(mesh, "obj/african_head_diffuse.png");
+        double loadTime = seconds_since(start);
+        mesh = ObjMesh();
+        run("sphere_" + std::to_string(triangles), model, loadTime, options,
+            threads, results);
+    }
+
+    // Tras el dibujo de calentamiento no debería reservarse memoria
+    int allocating = 0;
+    for (const Result& r : results) {
+        if (r.allocationsPerFrame > 0) allocating++;
+    }
+    if (allocating > 0) {
+        std::cout << "  " << allocating
+                  << " combinations allocate memory while drawing"
+                  << std::endl;
+    }
+
+    if (options.baseline != nullptr && !compare(options.baseline, results)) {
+        return 1;
+    }
+    if (options.json != nullptr &&
+        !write_json(options.json, options, threads, results)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "framewriter.h"
+
+#include <algorithm>
+
+FrameWriter::FrameWriter(int numThreads, int maxFrames, int compressionLevel)
+    : maxFrames(maxFrames),
+      compressionLevel(compressionLevel),
+      pending(0),
+      stopping(false),
+      written(0),
+      failed(0),
+      submitted(0),
+      maxQueued(0),
+      totalLatency(0.0),
+      maxLatency(0.0),
+      totalQueued(0.0),
+      waitSeconds(0.0) {
+    if (numThreads <= 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (this->maxFrames <= 0) this->maxFrames = 2 * numThreads;
+    for (int i = 0; i < numThreads; i++) {
+        workers.push_back(std::thread(&FrameWriter::work, this));
+    }
+}
+
+FrameWriter::~FrameWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (std::thread& t : workers) t.join();
+    for (PNGImage* frame : frames) delete frame;
+}
+
+void FrameWriter::write(PNGImage& image, const std::string& filename,
+                        bool flipVertically) {
+    PNGImage* frame = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (freeFrames.empty() && (int)frames.size() >= maxFrames) {
+            // Todos los buffers ocupados: esperar al siguiente que se escriba
+            Clock::time_point start = Clock::now();
+            frameDone.wait(lock, [this] { return !freeFrames.empty(); });
+            waitSeconds +=
+                std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        if (!freeFrames.empty()) {
+            frame = freeFrames.back();
+            freeFrames.pop_back();
+        } else {
+            frame = new PNGImage();
+            frames.push_back(frame);
+        }
+    }
+    // Fuera del lock: la reserva de un buffer nuevo (o de otro tamaño)
+    if (frame->width != image.width || frame->height != image.height ||
+        frame->channels != image.channels) {
+        *frame = image;
+    }
+    image.swap(*frame);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        submitted++;
+        totalQueued += queue.size();
+        maxQueued = std::max(maxQueued, (int)queue.size());
+        queue.push_back(Job{frame, filename, flipVertically, Clock::now()});
+        pending++;
+    }
+    jobReady.notify_one();
+}
+
+bool FrameWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    frameDone.wait(lock, [this] { return pending == 0; });
+    return failed == 0;
+}
+
+FrameWriter::Stats FrameWriter::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats stats;
+    stats.frames = written;
+    stats.failed = failed;
+    stats.meanLatency = written > 0 ? totalLatency / written : 0.0;
+    stats.maxLatency = maxLatency;
+    stats.meanQueued = submitted > 0 ? totalQueued / submitted : 0.0;
+    stats.maxQueued = maxQueued;
+    stats.waitSeconds = waitSeconds;
+    return stats;
+}
+
+void FrameWriter::work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        jobReady.wait(lock, [this] { return stopping || !queue.empty(); });
+        // Al terminar se vacía la cola antes de salir
+        if (queue.empty()) return;
+        Job job = queue.front();
+        queue.pop_front();
+        lock.unlock();
+
+        if (job.flipVertically) job.image->flip_vertically();
+        // Un hilo por imagen: ya se escriben varias a la vez
+        bool ok = job.image->write_png_file(job.filename.c_str(),
+                                            compressionLevel, 1);
+        double latency =
+            std::chrono::duration<double>(Clock::now() - job.submitted)
+                .count();
+
+        lock.lock();
+        written++;
+        if (!ok) failed++;
+        totalLatency += latency;
+        maxLatency = std::max(maxLatency, latency);
+        freeFrames.push_back(job.image);
+        pending--;
+        frameDone.notify_all();
+    }
+}
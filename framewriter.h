@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pngimage/pngimage.h"
+
+// Escritura de imágenes PNG en segundo plano: write() deja la imagen en una
+// cola y vuelve enseguida, y un grupo de hilos las comprime y escribe
+// mientras se dibujan las siguientes
+// Las imágenes no se copian: write() intercambia la memoria de la imagen
+// por la de un buffer libre, que se recicla cuando termina de escribirse.
+// Como mucho hay maxFrames buffers: si están todos en la cola o
+// escribiéndose, write() espera a que se libere uno (así la memoria está
+// acotada aunque se dibuje más rápido de lo que se escribe)
+class FrameWriter {
+   public:
+    struct Stats {
+        int frames;          // imágenes escritas
+        int failed;          // de ellas, las que han dado error
+        double meanLatency;  // segundos desde write() hasta escribir el PNG
+        double maxLatency;
+        double meanQueued;  // imágenes esperando en la cola en cada write()
+        int maxQueued;
+        double waitSeconds;  // tiempo total en write() esperando un buffer
+    };
+
+    // numThreads <= 0: uno por núcleo de la CPU
+    // maxFrames <= 0: dos por hilo
+    FrameWriter(int numThreads = 0, int maxFrames = 0,
+                int compressionLevel = Deflater::DEFAULT_LEVEL);
+    // Espera a que se escriban las imágenes pendientes
+    ~FrameWriter();
+    int threads() const { return (int)workers.size(); }
+
+    // Encola image para escribirla en filename, volteada verticalmente si
+    // flipVertically. Se puede llamar desde varios hilos a la vez
+    // Al volver, image tiene el mismo tamaño pero su contenido es otro
+    void write(PNGImage& image, const std::string& filename,
+               bool flipVertically = false);
+    // Espera a que se escriban todas las imágenes encoladas
+    // false si alguna ha fallado desde que se creó el FrameWriter
+    bool flush();
+    Stats stats() const;
+
+   private:
+    typedef std::chrono::steady_clock Clock;
+    struct Job {
+        PNGImage* image;
+        std::string filename;
+        bool flipVertically;
+        Clock::time_point submitted;
+    };
+
+    int maxFrames;
+    int compressionLevel;
+    std::vector<std::thread> workers;
+
+    // Todo lo siguiente se protege con mutex
+    mutable std::mutex mutex;
+    std::condition_variable jobReady;   // hay trabajo (o hay que terminar)
+    std::condition_variable frameDone;  // se ha liberado un buffer
+    std::deque<Job> queue;
+    std::vector<PNGImage*> freeFrames;
+    std::vector<PNGImage*> frames;  // todos los buffers reservados
+    int pending;                    // en la cola o escribiéndose
+    bool stopping;
+    // Acumulados para stats()
+    int written, failed, submitted, maxQueued;
+    double totalLatency, maxLatency, totalQueued, waitSeconds;
+
+    void work();
+
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+};
@@ -3,6 +3,9 @@
 #include <cmath>
 #include <vector>
 #include <ostream>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
 
 template <class T>
 struct Vec2 {
@@ -73,10 +76,44 @@ struct Vec3 {
     friend std::ostream &operator<<(std::ostream &s, Vec3<T> &vector);
 };
 
+template <class T>
+struct Vec4 {
+    union {
+        struct {
+            T x, y, z, w;
+        };
+        T raw[4];
+    };
+
+    Vec4() : x(0), y(0), z(0), w(0) {}
+    Vec4(T _x, T _y, T _z, T _w) : x(_x), y(_y), z(_z), w(_w) {}
+    Vec4(const Vec3<T> &v, T _w) : x(v.x), y(v.y), z(v.z), w(_w) {}
+    inline Vec4<T> operator+(const Vec4<T> &other) const {
+        return Vec4<T>(x + other.x, y + other.y, z + other.z, w + other.w);
+    }
+    inline Vec4<T> operator-(const Vec4<T> &other) const {
+        return Vec4<T>(x - other.x, y - other.y, z - other.z, w - other.w);
+    }
+    inline Vec4<T> operator*(const float f) const {
+        return Vec4<T>(x * f, y * f, z * f, w * f);
+    }
+    // dot product
+    inline T operator*(const Vec4<T> &other) const {
+        return x * other.x + y * other.y + z * other.z + w * other.w;
+    }
+    // coordenadas homogéneas a cartesianas (dividir entre w)
+    inline Vec3<T> dehomogenize() const {
+        return Vec3<T>(x / w, y / w, z / w);
+    }
+    template <class>
+    friend std::ostream &operator<<(std::ostream &s, Vec4<T> &vector);
+};
+
 typedef Vec2<float> Vec2f;
 typedef Vec2<int> Vec2i;
 typedef Vec3<float> Vec3f;
 typedef Vec3<int> Vec3i;
+typedef Vec4<float> Vec4f;
 
 template <class T>
 std::ostream &operator<<(std::ostream &s, Vec2<T> &vector) {
@@ -90,22 +127,108 @@ std::ostream &operator<<(std::ostream &s, Vec3<T> &vector) {
     return s;
 }
 
+template <class T>
+std::ostream &operator<<(std::ostream &s, Vec4<T> &vector) {
+    s << "(" << vector.x << ", " << vector.y << ", " << vector.z << ", "
+      << vector.w << ")";
+    return s;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
-class Matrix {
-   private:
-    static const int DEFAULT_ALLOC = 4;
-    std::vector<std::vector<float>> m;
-    int rows, cols;
+// Matriz de tamaño fijo, N filas y M columnas (sin memoria dinámica)
+// Las filas de Mat<4, 4> quedan alineadas a 16 bytes para operar con SSE
+template <int N, int M>
+struct Mat {
+    alignas(16) float m[N][M];
+
+    constexpr Mat() : m() {}
+    static constexpr Mat<N, M> identity() {
+        Mat<N, M> I;
+        for (int i = 0; i < N && i < M; i++) I.m[i][i] = 1.0f;
+        return I;
+    }
+    inline float *operator[](const int i) { return m[i]; }
+    constexpr const float *operator[](const int i) const { return m[i]; }
+    constexpr Mat<M, N> transpose() const {
+        Mat<M, N> t;
+        for (int i = 0; i < N; i++) {
+            for (int j = 0; j < M; j++) t.m[j][i] = m[i][j];
+        }
+        return t;
+    }
+};
+
+typedef Mat<3, 3> Mat3;
+typedef Mat<4, 4> Mat4;
+
+template <int N, int M, int P>
+constexpr Mat<N, P> operator*(const Mat<N, M> &a, const Mat<M, P> &b) {
+    Mat<N, P> res;
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < P; j++) {
+            for (int k = 0; k < M; k++) res.m[i][j] += a.m[i][k] * b.m[k][j];
+        }
+    }
+    return res;
+}
+
+// Cada fila del resultado es una combinación de las filas de b
+// (mismo orden de sumas que la versión genérica)
+inline Mat4 operator*(const Mat4 &a, const Mat4 &b) {
+#ifdef __SSE__
+    Mat4 res;
+    __m128 b0 = _mm_load_ps(b.m[0]), b1 = _mm_load_ps(b.m[1]),
+           b2 = _mm_load_ps(b.m[2]), b3 = _mm_load_ps(b.m[3]);
+    for (int i = 0; i < 4; i++) {
+        __m128 row = _mm_mul_ps(_mm_set1_ps(a.m[i][0]), b0);
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][1]), b1));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][2]), b2));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][3]), b3));
+        _mm_store_ps(res.m[i], row);
+    }
+    return res;
+#else
+    return operator*<4, 4, 4>(a, b);
+#endif
+}
 
-   public:
-    Matrix(int r = DEFAULT_ALLOC, int c = DEFAULT_ALLOC);
-    inline int nrows() const;
-    inline int ncols() const;
+// El resultado es una combinación de las columnas de a
+inline Vec4f operator*(const Mat4 &a, const Vec4f &v) {
+#ifdef __SSE__
+    __m128 c0 = _mm_load_ps(a.m[0]), c1 = _mm_load_ps(a.m[1]),
+           c2 = _mm_load_ps(a.m[2]), c3 = _mm_load_ps(a.m[3]);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    __m128 res = _mm_mul_ps(c0, _mm_set1_ps(v.x));
+    res = _mm_add_ps(res, _mm_mul_ps(c1, _mm_set1_ps(v.y)));
+    res = _mm_add_ps(res, _mm_mul_ps(c2, _mm_set1_ps(v.z)));
+    res = _mm_add_ps(res, _mm_mul_ps(c3, _mm_set1_ps(v.w)));
+    Vec4f out;
+    _mm_storeu_ps(out.raw, res);
+    return out;
+#else
+    Vec4f out;
+    for (int i = 0; i < 4; i++) {
+        out.raw[i] = a.m[i][0] * v.x + a.m[i][1] * v.y + a.m[i][2] * v.z +
+                     a.m[i][3] * v.w;
+    }
+    return out;
+#endif
+}
 
-    static Matrix identity(int dimensions);
-    std::vector<float> &operator[](const int i);
-    Matrix operator*(const Matrix &a) const;
+inline Vec3f operator*(const Mat3 &a, const Vec3f &v) {
+    return Vec3f(a.m[0][0] * v.x + a.m[0][1] * v.y + a.m[0][2] * v.z,
+                 a.m[1][0] * v.x + a.m[1][1] * v.y + a.m[1][2] * v.z,
+                 a.m[2][0] * v.x + a.m[2][1] * v.y + a.m[2][2] * v.z);
+}
 
-    friend std::ostream &operator<<(std::ostream &s, Matrix &m);
-};
\ No newline at end of file
+template <int N, int M>
+std::ostream &operator<<(std::ostream &s, const Mat<N, M> &mat) {
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < M; j++) {
+            s << mat.m[i][j];
+            if (j == M - 1) s << '\n'; else s << '\t';
+        }
+    }
+    return s;
+}
@@ -1,36 +1,45 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <limits>
+#include <string>
+#include "batch.h"
+#include "framewriter.h"
 #include "model.h"
 #include "our_gl.h"
+#include "pngimage/pngwriter.h"
+#include "renderer.h"
 
 static Model* model;
 static Vec3f light(1, 1, 1);
 
-static Matrix modelView, viewport, projection;
-
-Matrix v2m(Vec3f v) {
-    Matrix mat(4, 1);
-    mat[0][0] = v.x;
-    mat[1][0] = v.y;
-    mat[2][0] = v.z;
-    mat[3][0] = 1.0f;
-    return mat;
-}
+struct GouraudShader : public ShaderBase<GouraudShader> {
+    // Nunca descarta pixels (ver IShader::CAN_DISCARD)
+    static const bool CAN_DISCARD = false;
+    // viewport * projection * modelView de la vista que se dibuja
+    Mat4 mvp;
+    // varyings: escritos por vertex, leidos por fragment
+    Vec3f varying_intensity;
+    Vec2f varying_uvs[3];
 
-Vec3f m2v(Matrix m) {
-    return Vec3f(m[0][0] / m[3][0], m[1][0] / m[3][0], m[2][0] / m[3][0]);
-}
+    // Por vértice: uv (2) e intensidad (1)
+    int varying_count() const override { return 3; }
 
-struct GouraudShader : public IShader {
-    Vec3f varying_intensity;  // varying: escrito por vertex, leido por fragment
-    Vec2f varying_uvs[3];
+    Vec4f vertex(int ivert, float* varyings) override {
+        Vec2f uv = model->uv(ivert);
+        float intensity = light * model->norm(ivert);
+        varyings[0] = uv.x;
+        varyings[1] = uv.y;
+        varyings[2] = std::max(0.0f, intensity);
+        return mvp * Vec4f(model->vert(ivert), 1.0f);
+    }
 
-    Vec3f vertex(int iface, int nthvert) override {
-        varying_uvs[nthvert] = model->uv(iface, nthvert);
-        float intensity = light * model->norm(iface, nthvert);
-        varying_intensity.raw[nthvert] = std::max(0.0f, intensity);
-        Vec3f vert = model->vert(model->face(iface)[nthvert]);
-        return m2v(viewport * projection * modelView * v2m(vert));
+    void set_varyings(const float* const varyings[3]) override {
+        for (int i = 0; i < 3; i++) {
+            varying_uvs[i] = Vec2f(varyings[i][0], varyings[i][1]);
+            varying_intensity.raw[i] = varyings[i][2];
+        }
     }
 
     bool fragment(Vec3f bar, RGBColor& color) override {
@@ -42,33 +51,68 @@ struct GouraudShader : public IShader {
         color = model->diffuse(uv) * intensity;
         return false;
     }
+
+    // Como fragment, pero interpolando uv e intensidad de los 16 pixels del
+    // bloque a la vez, y con filtrado trilinear: el nivel de la textura se
+    // elige con las diferencias de uv entre pixels vecinos (fragment, con un
+    // solo pixel, usa el texel más cercano)
+    uint32_t fragment_block(FragmentBlock& block, uint32_t mask) override {
+        float u[BLOCK_SIZE], v[BLOCK_SIZE], intensity[BLOCK_SIZE];
+        for (int i = 0; i < BLOCK_SIZE; i++) {
+            float b0 = block.bar[0][i], b1 = block.bar[1][i],
+                  b2 = block.bar[2][i];
+            u[i] = 0.0f + varying_uvs[0].x * b0 + varying_uvs[1].x * b1 +
+                   varying_uvs[2].x * b2;
+            v[i] = 0.0f + varying_uvs[0].y * b0 + varying_uvs[1].y * b1 +
+                   varying_uvs[2].y * b2;
+            intensity[i] = varying_intensity.x * b0 +
+                           varying_intensity.y * b1 + varying_intensity.z * b2;
+        }
+        model->texture().sample_block(u, v, BLOCK_WIDTH, mask,
+                                      Texture::TRILINEAR, block.colors);
+        for (int i = 0; i < BLOCK_SIZE; i++) {
+            if (mask >> i & 1) block.colors[i] = block.colors[i] * intensity[i];
+        }
+        return 0;
+    }
 };
 
 // Punto de luz, la intensidad disminuye respecto a la distancia al cuadrado
-struct PointLightShader : public IShader {
-    Matrix varying_vertices;
+struct PointLightShader : public ShaderBase<PointLightShader> {
+    Mat4 mvp;
+    Mat3 varying_vertices;  // columnas: vértices del triángulo
     Vec3f varying_intensity;
 
     Vec3f light_center;
     float light_radius;
 
     PointLightShader(Vec3f _light_center, float _light_radius)
-        : varying_vertices(Matrix::identity(4)),
+        : varying_vertices(),
           light_center(_light_center),
           light_radius(_light_radius) {}
 
-    Vec3f vertex(int iface, int nthvert) override {
-        float intensity = light * model->norm(iface, nthvert);
-        varying_intensity.raw[nthvert] = std::max(0.0f, intensity);
-        Vec3f vert = model->vert(model->face(iface)[nthvert]);
-        for (int i = 0; i < 3; i++) {
-            varying_vertices[i][nthvert] = vert.raw[i];
+    // Por vértice: posición (3) e intensidad (1)
+    int varying_count() const override { return 4; }
+
+    Vec4f vertex(int ivert, float* varyings) override {
+        Vec3f vert = model->vert(ivert);
+        float intensity = light * model->norm(ivert);
+        for (int i = 0; i < 3; i++) varyings[i] = vert.raw[i];
+        varyings[3] = std::max(0.0f, intensity);
+        return mvp * Vec4f(vert, 1.0f);
+    }
+
+    void set_varyings(const float* const varyings[3]) override {
+        for (int j = 0; j < 3; j++) {
+            for (int i = 0; i < 3; i++) {
+                varying_vertices[i][j] = varyings[j][i];
+            }
+            varying_intensity.raw[j] = varyings[j][3];
         }
-        return m2v(viewport * projection * modelView * v2m(vert));
     }
 
     bool fragment(Vec3f bar, RGBColor& color) override {
-        Vec3f pos = m2v(varying_vertices * v2m(bar));
+        Vec3f pos = varying_vertices * bar;
         float d = (light_center - pos).norm();
         if (d > light_radius) return true;
         float intensity_distance = 1.0f - d / light_radius;
@@ -79,45 +123,161 @@ struct PointLightShader : public IShader {
     }
 };
 
+// Patrón de nombres de --output: se pasa a snprintf con el número de la
+// vista, así que solo puede tener una conversión entera (%d o %i, con
+// relleno con ceros y ancho opcionales, p.ej. %04d) y %% para un '%'
+static bool valid_frame_pattern(const char* pattern) {
+    int conversions = 0;
+    for (const char* p = pattern; *p != '\0'; p++) {
+        if (*p != '%') continue;
+        p++;
+        if (*p == '%') continue;
+        if (*p == '0') p++;
+        while (*p >= '0' && *p <= '9') p++;
+        if (*p != 'd' && *p != 'i') return false;
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+static void usage(const char* program) {
+    std::cerr << "Usage: " << program << " <model_name> [threads]"
+              << " [--views views.json | --turntable frames | --poster size]"
+              << " [--output images/frame_%04d.png]" << std::endl;
+}
+
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <model_name>" << std::endl;
+    if (argc < 2) {
+        usage(argv[0]);
         return 1;
     }
+    // 0: un hilo por núcleo
+    int numThreads = 0;
+    // Varias vistas: las de un archivo o una vuelta alrededor del modelo
+    const char* viewsName = nullptr;
+    int turntableFrames = 0;
+    // Una sola vista de size x size, más grande que la memoria disponible
+    int posterSize = 0;
+    const char* output = nullptr;
+    for (int i = 2; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--views") == 0 && hasValue) {
+            viewsName = argv[++i];
+        } else if (strcmp(argv[i], "--turntable") == 0 && hasValue) {
+            turntableFrames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--poster") == 0 && hasValue) {
+            posterSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && hasValue) {
+            output = argv[++i];
+        } else if (i == 2 && argv[i][0] != '-') {
+            numThreads = atoi(argv[i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
 
     const int width = 800, height = 800;
     model = new Model(argv[1]);
-    PNGImage image(width, height, RGBColor::Black);
-
     light.normalize();
     Vec3f camera(7.0f, 7.0f, 7.0f);
     Vec3f eye(-1.0f, -1.0f, -1.0f);
     Vec3f up(0.0f, 0.0f, 1.0f);
-
-    modelView = lookat(camera, eye.normalize(), up);
-    viewport = getViewport(0, 0, width, height, 255);
-    projection = getProjection((camera - eye).norm());
-
-    // Inicializar z-buffer a numeros negativos
-    float zbuffer[height * width];
-    for (int i = 0; i < height * width; i++) {
-        zbuffer[i] = -1.0f * std::numeric_limits<float>::max();
-    }
+    View view = {camera, eye.normalize(), up};
 
     // Dibujar el modelo
     // Vec3f lightCenter(0.0f, 0.0f, 0.25f);
     // float lightRadius = 1.0f;
     // PointLightShader shader(lightCenter, lightRadius);
     GouraudShader shader;
-    for (int i = 0; i < model->nfaces(); i++) {
-        Vec3f screen[3];
-        for (int j = 0; j < 3; j++) {
-            screen[j] = shader.vertex(i, j);
+
+    if (viewsName != nullptr || turntableFrames > 0) {
+        std::vector<View> views;
+        if (viewsName != nullptr) {
+            if (!read_views(viewsName, views)) return 1;
+        } else {
+            views = turntable(view, turntableFrames);
+        }
+        BatchRenderer batch(width, height, numThreads);
+        // Los PNG se comprimen y escriben en otros hilos mientras se dibujan
+        // las siguientes vistas
+        FrameWriter writer(numThreads);
+        if (output == nullptr) output = "images/frame_%04d.png";
+        if (!valid_frame_pattern(output)) {
+            std::cerr << "Invalid output pattern " << output
+                      << " (it needs exactly one %d, e.g. frame_%04d.png)"
+                      << std::endl;
+            return 1;
+        }
+        batch.render(*model, views, shader, [&](int i, PNGImage& image) {
+            char filename[1024];
+            snprintf(filename, sizeof(filename), output, i);
+            writer.write(image, filename, true);
+        });
+        bool ok = writer.flush();
+        const BatchRenderer::Stats& stats = batch.stats();
+        std::cout << stats.frames << " frames in " << stats.seconds << " s ("
+                  << stats.fps() << " frames/s, " << batch.threads()
+                  << " threads)" << std::endl;
+        FrameWriter::Stats pngStats = writer.stats();
+        std::cout << "PNG output: " << 1000 * pngStats.meanLatency
+                  << " ms mean latency (max " << 1000 * pngStats.maxLatency
+                  << " ms), " << pngStats.meanQueued
+                  << " frames queued on average (max " << pngStats.maxQueued
+                  << "), " << pngStats.waitSeconds << " s waiting for a buffer"
+                  << std::endl;
+        return ok ? 0 : 1;
+    }
+
+    if (posterSize > 0) {
+        const int size = posterSize;
+        const int tile = TileRenderer::TILE_SIZE;
+        // Franjas de unos 64 MB entre imagen (3 bytes por pixel) y z-buffer
+        // (4), de filas de celdas completas
+        int bandRows = (64 << 20) / ((int64_t)size * 7) / tile * tile;
+        bandRows = std::min(bandRows, (size + tile - 1) / tile * tile);
+        bandRows = std::max(tile, bandRows);
+        PNGImage band(size, bandRows, RGBColor::Black);
+        ZBuffer zbuffer(size, bandRows);
+        shader.mvp = view_matrix(view, size, size);
+        TileRenderer renderer(numThreads);
+        // Las franjas llegan de arriba a abajo de la imagen final (la y de la
+        // imagen crece hacia arriba), y cada una se escribe con sus filas al
+        // revés: no hace falta voltearlas
+        PNGWriter writer;
+        bool ok = writer.open(output != nullptr ? output : "images/poster.png",
+                              size, size, 3, Deflater::DEFAULT_LEVEL,
+                              numThreads);
+        if (ok) {
+            // Si falla la escritura de una franja no se dibujan las demás
+            bool drawn = renderer.draw_bands(
+                *model, shader, size, size, band, zbuffer,
+                [&](const PNGImage& b, int rows) {
+                    return writer.write_rows(b.row(rows - 1), rows,
+                                             -(ptrdiff_t)b.stride);
+                });
+            ok = drawn;
         }
-        triangle(screen, shader, image, zbuffer);
+        ok = ok && writer.close();
+        if (!ok) return 1;
+        const TileRenderer::Stats& stats = renderer.stats();
+        double seconds = stats.vertexTime + stats.binTime + stats.rasterTime;
+        std::cout << size << "x" << size << " poster in "
+                  << (size + bandRows - 1) / bandRows << " bands of "
+                  << bandRows << " rows: " << stats.triangles
+                  << " triangles, " << seconds << " s rendering" << std::endl;
+        return 0;
     }
 
+    PNGImage image(width, height, RGBColor::Black);
+    // Inicializar z-buffer a numeros negativos
+    ZBuffer zbuffer(width, height);
+    zbuffer.fill(-1.0f * std::numeric_limits<float>::max());
+    shader.mvp = view_matrix(view, width, height);
+    TileRenderer renderer(numThreads);
+    renderer.draw(*model, shader, image, zbuffer);
+
     image.flip_vertically();
     image.write_png_file("images/output.png");
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,251 @@
+#include "meshcache.h"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "pngimage/checksum.h"
+
+MeshArrays::MeshArrays()
+    : numVerts(0),
+      numTris(0),
+      x(nullptr),
+      y(nullptr),
+      z(nullptr),
+      u(nullptr),
+      v(nullptr),
+      nx(nullptr),
+      ny(nullptr),
+      nz(nullptr),
+      indices(nullptr) {}
+
+const char MeshCache::MAGIC[8] = {'T', 'R', 'M', 'E', 'S', 'H', '\0', '\0'};
+
+MeshCache::MeshCache() : file() {}
+
+MeshCache::Source MeshCache::stat_source(const char* filename) {
+    Source source;
+    memset(&source, 0, sizeof(source));
+    struct stat info;
+    if (stat(filename, &info) == 0) {
+        source.exists = 1;
+        source.size = info.st_size;
+#if defined(__APPLE__)
+        source.mtime = (int64_t)info.st_mtimespec.tv_sec * 1000000000 +
+                       info.st_mtimespec.tv_nsec;
+#elif !defined(_WIN32)
+        source.mtime = (int64_t)info.st_mtim.tv_sec * 1000000000 +
+                       info.st_mtim.tv_nsec;
+#else
+        source.mtime = (int64_t)info.st_mtime * 1000000000;
+#endif
+    }
+    return source;
+}
+
+uint32_t MeshCache::file_crc(const char* filename) {
+    MappedFile source;
+    if (!source.open(filename)) return 0;
+    return Checksum::crc32(0, source.data(), source.size());
+}
+
+// Si la fecha no coincide (p.ej. archivo copiado o recuperado de git) se
+// compara el contenido, y si es el mismo se cambia la fecha de recorded por
+// la actual (para guardarla y no volver a calcular el CRC)
+bool MeshCache::source_matches(const char* filename, Source& recorded) {
+    Source current = stat_source(filename);
+    if (!current.exists || !recorded.exists) {
+        return current.exists == recorded.exists;
+    }
+    if (current.size != recorded.size) return false;
+    if (current.mtime == recorded.mtime) return true;
+    if (file_crc(filename) != recorded.crc) return false;
+    recorded.mtime = current.mtime;
+    return true;
+}
+
+// Reescribe la cabecera de la caché filename (solo cambian las fechas de
+// los archivos de origen). Si falla la caché sigue valiendo, solo que se
+// volverá a comparar el contenido la próxima vez
+void MeshCache::update_header(const char* filename, const Header& header) {
+    std::fstream fs(filename, std::ios::in | std::ios::out | std::ios::binary);
+    if (fs.is_open()) fs.write((const char*)&header, sizeof(header));
+}
+
+bool MeshCache::open(const char* filename, const char* objName,
+                     const char* textureName, MeshArrays& mesh,
+                     PNGImage& texture) {
+    close();
+    // Sin caché todavía: no es un error
+    if (!stat_source(filename).exists) return false;
+    // Proyección modificable para que la textura se pueda modificar como
+    // cualquier otra imagen (copia privada, la caché no cambia)
+    if (!file.open(filename, true)) return false;
+    const Header* header = (const Header*)file.data();
+    // Copia para comparar los archivos de origen (puede cambiar su fecha)
+    Header updated;
+    bool isValid = file.size() >= sizeof(Header) &&
+                   memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                   header->version == VERSION &&
+                   header->byteOrder == BYTE_ORDER_MARK &&
+                   header->fileSize == file.size();
+    // Tamaño de cada sección
+    if (isValid) {
+        uint64_t numVerts = header->numVerts;
+        uint64_t expected[NUM_SECTIONS];
+        for (int s = X; s <= NZ; s++) expected[s] = numVerts * sizeof(float);
+        expected[INDICES] = 3 * (uint64_t)header->numTris * sizeof(uint32_t);
+        expected[PIXELS] = (uint64_t)header->textureHeight *
+                           (uint32_t)header->textureStride;
+        if (expected[PIXELS] > 0) {
+            isValid = (header->textureChannels == 3 ||
+                       header->textureChannels == 4) &&
+                      header->textureWidth > 0 &&
+                      header->textureStride >=
+                          (int64_t)header->textureWidth *
+                              header->textureChannels;
+        }
+        for (int s = 0; s < NUM_SECTIONS && isValid; s++) {
+            isValid = header->sizes[s] == expected[s] &&
+                      header->offsets[s] % SECTION_ALIGNMENT == 0 &&
+                      header->offsets[s] <= file.size() &&
+                      header->sizes[s] <= file.size() - header->offsets[s];
+        }
+    }
+    if (isValid) {
+        updated = *header;
+        isValid = source_matches(objName, updated.obj) &&
+                  source_matches(textureName, updated.texture);
+    }
+    // Todos los índices dentro de la malla: el renderer no los comprueba
+    uint8_t* base = file.data();
+    if (isValid) {
+        const uint32_t* indices =
+            (const uint32_t*)(base + header->offsets[INDICES]);
+        uint64_t numIndices = 3 * (uint64_t)header->numTris;
+        uint32_t maxIndex = 0;
+        for (uint64_t i = 0; i < numIndices; i++) {
+            maxIndex = std::max(maxIndex, indices[i]);
+        }
+        isValid = numIndices == 0 || maxIndex < header->numVerts;
+    }
+    if (!isValid) {
+        close();
+        return false;
+    }
+    if (updated.obj.mtime != header->obj.mtime ||
+        updated.texture.mtime != header->texture.mtime) {
+        update_header(filename, updated);
+    }
+
+    const float* floats[NZ + 1];
+    for (int s = X; s <= NZ; s++) {
+        floats[s] = (const float*)(base + header->offsets[s]);
+    }
+    mesh.numVerts = header->numVerts;
+    mesh.numTris = header->numTris;
+    mesh.x = floats[X];
+    mesh.y = floats[Y];
+    mesh.z = floats[Z];
+    mesh.u = floats[U];
+    mesh.v = floats[V];
+    mesh.nx = floats[NX];
+    mesh.ny = floats[NY];
+    mesh.nz = floats[NZ];
+    mesh.indices = (const uint32_t*)(base + header->offsets[INDICES]);
+    if (header->sizes[PIXELS] > 0) {
+        texture.wrap(base + header->offsets[PIXELS], header->textureWidth,
+                     header->textureHeight, header->textureChannels,
+                     header->textureStride);
+    }
+    return true;
+}
+
+void MeshCache::close() {
+    file.close();
+}
+
+bool MeshCache::write(const char* filename, const char* objName,
+                      const char* textureName, const MeshArrays& mesh,
+                      const PNGImage& texture) {
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.obj = stat_source(objName);
+    header.obj.crc = file_crc(objName);
+    header.texture = stat_source(textureName);
+    if (header.texture.exists) header.texture.crc = file_crc(textureName);
+    header.numVerts = mesh.numVerts;
+    header.numTris = mesh.numTris;
+    const uint8_t* sections[NUM_SECTIONS] = {
+        (const uint8_t*)mesh.x,  (const uint8_t*)mesh.y,
+        (const uint8_t*)mesh.z,  (const uint8_t*)mesh.u,
+        (const uint8_t*)mesh.v,  (const uint8_t*)mesh.nx,
+        (const uint8_t*)mesh.ny, (const uint8_t*)mesh.nz,
+        (const uint8_t*)mesh.indices, texture.data()};
+    for (int s = X; s <= NZ; s++) {
+        header.sizes[s] = (uint64_t)mesh.numVerts * sizeof(float);
+    }
+    header.sizes[INDICES] = 3 * (uint64_t)mesh.numTris * sizeof(uint32_t);
+    if (texture.data() != nullptr) {
+        // Filas sin relleno
+        header.textureWidth = texture.width;
+        header.textureHeight = texture.height;
+        header.textureChannels = texture.channels;
+        header.textureStride = texture.width * texture.channels;
+        header.sizes[PIXELS] =
+            (uint64_t)header.textureHeight * header.textureStride;
+    }
+    uint64_t offset = sizeof(Header);
+    for (int s = 0; s < NUM_SECTIONS; s++) {
+        offset = (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT *
+                 SECTION_ALIGNMENT;
+        header.offsets[s] = offset;
+        offset += header.sizes[s];
+    }
+    header.fileSize = offset;
+
+    // Se escribe en un archivo temporal y se renombra al terminar, para que
+    // otros procesos nunca vean una caché a medias
+    std::string tempName(filename);
+#ifndef _WIN32
+    tempName += ".tmp" + std::to_string(getpid());
+#else
+    tempName += ".tmp";
+#endif
+    std::ofstream os(tempName.c_str(), std::ios::binary);
+    if (!os.is_open()) {
+        std::cerr << "Can't write mesh cache " << filename << std::endl;
+        return false;
+    }
+    const char padding[SECTION_ALIGNMENT] = {0};
+    os.write((const char*)&header, sizeof(header));
+    uint64_t written = sizeof(header);
+    for (int s = 0; s < NUM_SECTIONS; s++) {
+        os.write(padding, header.offsets[s] - written);
+        if (s == PIXELS) {
+            for (int y = 0; y < header.textureHeight; y++) {
+                os.write((const char*)texture.row(y), header.textureStride);
+            }
+        } else {
+            os.write((const char*)sections[s], header.sizes[s]);
+        }
+        written = header.offsets[s] + header.sizes[s];
+    }
+    os.close();
+    if (!os.good() || std::rename(tempName.c_str(), filename) != 0) {
+        std::cerr << "Can't write mesh cache " << filename << std::endl;
+        std::remove(tempName.c_str());
+        return false;
+    }
+    return true;
+}
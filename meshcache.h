@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include "pngimage/mappedfile.h"
+#include "pngimage/pngimage.h"
+
+// Malla indexada en arrays planos (SoA): cada vértice tiene posición (x, y,
+// z), coordenadas de textura (u, v) y normal (nx, ny, nz), y cada triángulo
+// 3 índices de vértice consecutivos en indices
+struct MeshArrays {
+    uint32_t numVerts;
+    uint32_t numTris;
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* u;
+    const float* v;
+    const float* nx;
+    const float* ny;
+    const float* nz;
+    const uint32_t* indices;
+
+    MeshArrays();
+};
+
+// Caché binaria de un modelo .obj y su textura ya decodificada, para no
+// tener que volver a leerlos en cada ejecución
+// El archivo se proyecta en memoria y los arrays de la malla y los pixels
+// de la textura se usan directamente desde la proyección, sin copiarlos
+// Formato (en el orden de bytes de la máquina):
+//   Header: firma, versión, tamaño/fecha/CRC-32 de los archivos de origen,
+//           tamaños y posición de cada sección
+//   Secciones (alineadas a 64 bytes): x, y, z, u, v, nx, ny, nz (float),
+//           indices (uint32_t) y pixels de la textura (filas sin relleno,
+//           en el orden del PNG)
+// La caché deja de valer si cambia la versión del formato o los archivos de
+// origen: misma fecha de modificación o, si no, mismo contenido (CRC-32),
+// y en ese caso se guarda la fecha nueva en la cabecera
+// Al abrirla se comprueba que los índices de los triángulos no se salen de
+// los vértices, por si el archivo está dañado
+class MeshCache {
+   public:
+    // Cambiar al modificar el formato
+    static const uint32_t VERSION = 2;
+
+    MeshCache();
+    // Proyecta la caché filename si es válida para objName y textureName
+    // mesh y texture apuntan a la proyección mientras siga abierta
+    bool open(const char* filename, const char* objName,
+              const char* textureName, MeshArrays& mesh, PNGImage& texture);
+    void close();
+    bool is_open() const { return file.is_open(); }
+
+    // Guarda la malla y la textura (puede estar vacía) en filename
+    static bool write(const char* filename, const char* objName,
+                      const char* textureName, const MeshArrays& mesh,
+                      const PNGImage& texture);
+
+   private:
+    // Secciones del archivo, en orden
+    enum Section { X, Y, Z, U, V, NX, NY, NZ, INDICES, PIXELS, NUM_SECTIONS };
+    const static int SECTION_ALIGNMENT = 64;
+
+    // Archivo de origen de la caché (.obj o textura)
+    struct Source {
+        uint64_t size;
+        int64_t mtime;  // nanosegundos
+        uint32_t crc;   // CRC-32 del contenido
+        uint32_t exists;
+    };
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;  // BYTE_ORDER_MARK en el orden de quien escribe
+        Source obj;
+        Source texture;
+        uint32_t numVerts;
+        uint32_t numTris;
+        int32_t textureWidth;
+        int32_t textureHeight;
+        int32_t textureChannels;
+        int32_t textureStride;
+        uint64_t offsets[NUM_SECTIONS];
+        uint64_t sizes[NUM_SECTIONS];
+        uint64_t fileSize;
+    };
+    const static char MAGIC[8];
+    const static uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+    MappedFile file;
+
+    // Tamaño y fecha (sin CRC) de filename, exists = 0 si no existe
+    static Source stat_source(const char* filename);
+    static bool source_matches(const char* filename, Source& recorded);
+    static void update_header(const char* filename, const Header& header);
+    static uint32_t file_crc(const char* filename);
+
+    MeshCache(const MeshCache&) = delete;
+    MeshCache& operator=(const MeshCache&) = delete;
+};
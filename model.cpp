@@ -1,105 +1,129 @@
 #include "model.h"
 
-#include <fstream>
 #include <iostream>
-#include <sstream>
 
-void Model::load_texture(const char* filename) {
-    std::string texturename(filename);
-    size_t pos = texturename.find_last_of(".");
-    if (pos == std::string::npos) {
-        std::cerr << "Invalid obj filename" << std::endl;
-    } else {
-        texturename = texturename.substr(0, pos) + "_diffuse.png";
-        diffuseMap.read_png_file(texturename.c_str());
-        diffuseMap.flip_vertically();
-    }
+void Model::load_texture(const std::string& texturename) {
+    diffuseMap.read_png_file(texturename.c_str());
 }
 
-Model::Model(const char* filename) : verts(), faces(), uvs(), norms() {
-    // Apertura
-    std::ifstream is(filename);
-    if (!is.is_open()) {
-        std::cerr << "Can't open file " << filename << std::endl;
-        is.close();
-    }
-    // Textura (almacenada en diffuseMap)
-    load_texture(filename);
-    // Lectura
-    std::string line;
-    while (!is.eof()) {
-        std::getline(is, line);
-        std::istringstream iss(line.c_str());
-        char ctrash;
-        if (line.compare(0, 2, "v ") == 0) {
-            iss >> ctrash;  // leer "v"
-            Vec3f v;
-            // Leer vertice y añadir
-            for (int i = 0; i < 3; i++) iss >> v.raw[i];
-            verts.push_back(v);
-        } else if (line.compare(0, 3, "vt ") == 0) {
-            iss >> ctrash >> ctrash;  // leer "vt"
-            Vec2f v;
-            // Leer textura y añadir
-            for (int i = 0; i < 2; i++) iss >> v.raw[i];
-            uvs.push_back(v);
-        } else if (line.compare(0, 3, "vn ") == 0) {
-            iss >> ctrash >> ctrash;  // leer "vn"
-            Vec3f v;
-            // Leer normal y añadir
-            for (int i = 0; i < 3; i++) iss >> v.raw[i];
-            norms.push_back(v);
-        } else if (line.compare(0, 2, "f ") == 0) {
-            iss >> ctrash;  // leer "f"
-            std::vector<Vec3i> f;
-            // Leer cara y añadir
-            int idx, iduv, idnorm;
-            // leer "idx/iduv/idnorm"
-            // idx -> id de vertice (v)
-            // iduv -> id de texture vertex (vt)
-            // idnorm -> id de normal vertex (vn)
-            while (iss >> idx >> ctrash >> iduv >> ctrash >> idnorm) {
-                idx--;  // en formato .obj los indices empiezan en 1, no 0
-                iduv--;
-                idnorm--;
-                f.push_back(Vec3i(idx, iduv, idnorm));
+// Junta las esquinas de las caras con la misma (posición, textura, normal)
+// en un solo vértice, con una tabla hash de direccionamiento abierto
+void Model::build_mesh(const ObjMesh& obj) {
+    const std::vector<Vec3i>& corners = obj.corners;
+    size_t tableSize = 16;
+    while (tableSize < 2 * corners.size()) tableSize *= 2;
+    std::vector<int32_t> table(tableSize, -1);  // vértice, -1 si libre
+    std::vector<uint32_t> firstCorner;          // esquina de cada vértice
+    indexStorage.resize(corners.size());
+    for (size_t i = 0; i < corners.size(); i++) {
+        const Vec3i& c = corners[i];
+        uint32_t hash = c.ivert * 0x9E3779B1u + c.iuv * 0x85EBCA77u +
+                        c.inorm * 0xC2B2AE3Du;
+        hash ^= hash >> 15;
+        size_t slot = hash & (tableSize - 1);
+        while (table[slot] >= 0) {
+            const Vec3i& other = corners[firstCorner[table[slot]]];
+            if (other.ivert == c.ivert && other.iuv == c.iuv &&
+                other.inorm == c.inorm) {
+                break;
             }
-            faces.push_back(f);
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if (table[slot] < 0) {
+            table[slot] = firstCorner.size();
+            firstCorner.push_back(i);
         }
+        indexStorage[i] = table[slot];
     }
-}
 
-Model::~Model() {}
-
-int Model::nverts() {
-    return verts.size();
-}
-
-int Model::nfaces() {
-    return faces.size();
+    // Atributos de cada vértice (0 si la cara no los indica)
+    size_t n = firstCorner.size();
+    storage.assign(8 * n, 0.0f);
+    float* arrays[8];
+    for (int a = 0; a < 8; a++) arrays[a] = storage.data() + a * n;
+    for (size_t i = 0; i < n; i++) {
+        const Vec3i& c = corners[firstCorner[i]];
+        const Vec3f& p = obj.verts[c.ivert];
+        arrays[0][i] = p.x;
+        arrays[1][i] = p.y;
+        arrays[2][i] = p.z;
+        if (c.iuv >= 0) {
+            arrays[3][i] = obj.uvs[c.iuv].u;
+            arrays[4][i] = obj.uvs[c.iuv].v;
+        }
+        if (c.inorm >= 0) {
+            arrays[5][i] = obj.norms[c.inorm].x;
+            arrays[6][i] = obj.norms[c.inorm].y;
+            arrays[7][i] = obj.norms[c.inorm].z;
+        }
+    }
+    mesh.numVerts = n;
+    mesh.numTris = corners.size() / 3;
+    mesh.x = arrays[0];
+    mesh.y = arrays[1];
+    mesh.z = arrays[2];
+    mesh.u = arrays[3];
+    mesh.v = arrays[4];
+    mesh.nx = arrays[5];
+    mesh.ny = arrays[6];
+    mesh.nz = arrays[7];
+    mesh.indices = indexStorage.data();
 }
 
-Vec3f Model::vert(int i) {
-    return verts[i];
+Model::Model(const char* filename, bool useCache)
+    : mesh(),
+      storage(),
+      indexStorage(),
+      cache(),
+      diffuseMap(),
+      diffuseTexture() {
+    std::string basename(filename);
+    size_t pos = basename.find_last_of(".");
+    bool hasTexture = pos != std::string::npos;
+    if (!hasTexture) {
+        std::cerr << "Invalid obj filename" << std::endl;
+    } else {
+        basename = basename.substr(0, pos);
+    }
+    std::string texturename = basename + "_diffuse.png";
+    std::string cachename = basename + ".mesh";
+    // Caché de ejecuciones anteriores o lectura (la textura en diffuseMap)
+    if (!useCache || !cache.open(cachename.c_str(), filename,
+                                 texturename.c_str(), mesh, diffuseMap)) {
+        if (hasTexture) load_texture(texturename);
+        ObjMesh obj;
+        if (ObjLoader::load(filename, obj)) {
+            build_mesh(obj);
+            if (useCache) {
+                MeshCache::write(cachename.c_str(), filename,
+                                 texturename.c_str(), mesh, diffuseMap);
+            }
+        }
+    }
+    // Mipmaps, con v = 0 abajo (la primera fila del PNG es la de arriba)
+    diffuseTexture.build(diffuseMap, true);
 }
 
-std::vector<int> Model::face(int idx) {
-    std::vector<int> verts;
-    for (Vec3i face : faces[idx]) verts.push_back(face.ivert);
-    return verts;
+Model::Model(const ObjMesh& obj, const char* texturename)
+    : mesh(),
+      storage(),
+      indexStorage(),
+      cache(),
+      diffuseMap(),
+      diffuseTexture() {
+    if (texturename != nullptr) load_texture(texturename);
+    build_mesh(obj);
+    diffuseTexture.build(diffuseMap, true);
 }
 
-Vec2f Model::uv(int iface, int nvert) {
-    return uvs[faces[iface][nvert].iuv];
-}
+Model::~Model() {}
 
-RGBColor Model::diffuse(Vec2f uv) {
-    RGBColor color;
-    diffuseMap.get_pixel((int)(uv.x * diffuseMap.width),
-                         (int)(uv.y * diffuseMap.height), color);
-    return color;
+void Model::face_data(int iface, Face& out) const {
+    const uint32_t* ids = face(iface);
+    for (int k = 0; k < 3; k++) {
+        uint32_t i = ids[k];
+        out.verts[k] = Vec3f(mesh.x[i], mesh.y[i], mesh.z[i]);
+        out.uvs[k] = Vec2f(mesh.u[i], mesh.v[i]);
+        out.norms[k] = Vec3f(mesh.nx[i], mesh.ny[i], mesh.nz[i]);
+    }
 }
-
-Vec3f Model::norm(int iface, int nvert) {
-    return norms[faces[iface][nvert].inorm];
-}
\ No newline at end of file
@@ -1,31 +1,83 @@
 #pragma once
 
+#include <stdint.h>
+#include <string>
 #include <vector>
 #include "geometry.h"
+#include "meshcache.h"
+#include "objloader.h"
 #include "pngimage/pngimage.h"
 #include "pngimage/rgbcolor.h"
+#include "texture.h"
 
 // Modelos en formato wavefront .obj
 // más info: https://en.wikipedia.org/wiki/Wavefront_.obj_file
-// Solo lee los vertices y caras del modelo
+// Lee vértices, texturas, normales y caras (trianguladas) con ObjLoader y
+// los guarda como malla indexada: cada combinación distinta de posición,
+// textura y normal de las caras es un vértice
+// La malla y la textura se guardan en una caché binaria (<nombre>.mesh, ver
+// MeshCache) que se carga directamente en siguientes ejecuciones, y con la
+// textura se generan sus mipmaps (ver Texture)
 class Model {
    private:
-    std::vector<Vec3f> verts;
-    std::vector<std::vector<Vec3i>> faces;
-    std::vector<Vec2f> uvs;
-    std::vector<Vec3f> norms;
-    PNGImage diffuseMap;
+    // Arrays de la malla: apuntan a storage/indexStorage si se ha leído el
+    // .obj o a la proyección de cache si se ha cargado la caché
+    MeshArrays mesh;
+    std::vector<float> storage;
+    std::vector<uint32_t> indexStorage;
+    MeshCache cache;
+    PNGImage diffuseMap;  // como en el archivo PNG (primera fila arriba)
+    Texture diffuseTexture;
 
-    void load_texture(const char *filename);
+    void load_texture(const std::string& texturename);
+    void build_mesh(const ObjMesh& obj);
+
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
 
    public:
-    Model(const char *filename);
+    // Datos de un triángulo completo (ver face_data)
+    struct Face {
+        Vec3f verts[3];
+        Vec2f uvs[3];
+        Vec3f norms[3];
+    };
+
+    // useCache: leer/escribir la caché binaria junto al .obj
+    Model(const char *filename, bool useCache = true);
+    // Malla ya leída o generada, con la textura de texturename (o ninguna)
+    explicit Model(const ObjMesh &obj, const char *texturename = nullptr);
     ~Model();
-    int nverts();
-    int nfaces();
-    Vec3f vert(int i);
-    std::vector<int> face(int idx);
-    Vec2f uv(int iface, int nvert);
-    RGBColor diffuse(Vec2f uv);
-    Vec3f norm(int iface, int nvert);
-};
\ No newline at end of file
+    int nverts() const { return mesh.numVerts; }
+    int nfaces() const { return mesh.numTris; }
+    // Accesos sin reservar memoria: devuelven valores o punteros a los arrays
+    // de la malla (válidos mientras exista el modelo)
+    // Atributos del vértice i
+    Vec3f vert(int i) const {
+        return Vec3f(mesh.x[i], mesh.y[i], mesh.z[i]);
+    }
+    Vec2f uv(int i) const { return Vec2f(mesh.u[i], mesh.v[i]); }
+    Vec3f norm(int i) const {
+        return Vec3f(mesh.nx[i], mesh.ny[i], mesh.nz[i]);
+    }
+    // 3 índices de vértice de la cara idx
+    const uint32_t *face(int idx) const { return mesh.indices + idx * 3; }
+    // Atributos de la esquina nvert de la cara iface
+    Vec2f uv(int iface, int nvert) const {
+        uint32_t i = face(iface)[nvert];
+        return Vec2f(mesh.u[i], mesh.v[i]);
+    }
+    Vec3f norm(int iface, int nvert) const {
+        uint32_t i = face(iface)[nvert];
+        return Vec3f(mesh.nx[i], mesh.ny[i], mesh.nz[i]);
+    }
+    // Texel más cercano de la textura en uv (negro fuera de ella). En el
+    // header para que se pueda expandir en los shaders
+    RGBColor diffuse(Vec2f uv) const { return diffuseTexture.nearest(uv); }
+    // Textura con mipmaps, para muestrear con filtrado
+    const Texture &texture() const { return diffuseTexture; }
+    // Acceso en bloque: todos los atributos de un triángulo, o los arrays
+    // SoA completos para procesar muchos vértices a la vez
+    void face_data(int iface, Face &out) const;
+    const MeshArrays &arrays() const { return mesh; }
+};
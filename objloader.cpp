@@ -0,0 +1,330 @@
+#include "objloader.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "pngimage/mappedfile.h"
+
+void ObjMesh::clear() {
+    verts.clear();
+    uvs.clear();
+    norms.clear();
+    corners.clear();
+}
+
+// Resultado de leer un trozo del archivo. Los índices negativos no se
+// pueden resolver sin saber cuántos elementos hay en los trozos anteriores:
+// se guardan relativos al inicio del trozo y se corrigen al juntarlos
+struct ObjLoader::Chunk {
+    ObjMesh mesh;
+    std::vector<size_t> relative;  // 3 * esquina + atributo (0 v, 1 vt, 2 vn)
+    size_t errorLine;              // 0 si no hay errores (empieza en 1)
+};
+
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && is_space(*p)) p++;
+    return p;
+}
+
+// 10^i exactos en float (hasta 10^10) y en double (hasta 10^22)
+static const double POW10[23] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                 1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Lee un número real en [p, end) y devuelve dónde termina (p si no hay)
+// Los casos habituales (pocas cifras) se resuelven con una sola división
+// exacta, que redondea igual que strtof. El resto se pasa a strtof
+static const char* parse_float(const char* p, const char* end, float& value) {
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    uint64_t mantissa = 0;
+    int digits = 0;  // cifras significativas en mantissa
+    int exponent = 0;
+    bool anyDigit = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        anyDigit = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa > 0) digits++;
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            anyDigit = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa > 0) digits++;
+                exponent--;
+            }
+        }
+    }
+    if (!anyDigit) return start;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool negativeExp = false;
+        if (q < end && (*q == '-' || *q == '+')) negativeExp = *q++ == '-';
+        if (q < end && *q >= '0' && *q <= '9') {
+            int e = 0;
+            for (; q < end && *q >= '0' && *q <= '9'; q++) {
+                if (e < 10000) e = e * 10 + (*q - '0');
+            }
+            exponent += negativeExp ? -e : e;
+            p = q;
+        }
+    }
+
+    float result;
+    if (mantissa < (1 << 24) && exponent >= -10 && exponent <= 10) {
+        // mantissa y 10^exponent exactos en float
+        float scale = POW10[exponent < 0 ? -exponent : exponent];
+        result = exponent < 0 ? mantissa / scale : mantissa * scale;
+    } else if (mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        double scale = POW10[exponent < 0 ? -exponent : exponent];
+        result = exponent < 0 ? mantissa / scale : mantissa * scale;
+    } else {
+        char buffer[128];
+        size_t n = std::min((size_t)(p - start), sizeof(buffer) - 1);
+        memcpy(buffer, start, n);
+        buffer[n] = '\0';
+        value = strtof(buffer, nullptr);
+        return p;
+    }
+    value = negative ? -result : result;
+    return p;
+}
+
+// Lee un entero con signo, devuelve dónde termina (p si no hay)
+static inline const char* parse_int(const char* p, const char* end,
+                                    int& value) {
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    const char* digitsStart = p;
+    int result = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        if (result > (INT32_MAX - 9) / 10) return start;  // no cabe
+        result = result * 10 + (*p - '0');
+    }
+    if (p == digitsStart) return start;
+    value = negative ? -result : result;
+    return p;
+}
+
+// Lee n reales separados por espacios
+template <int N>
+static inline bool parse_floats(const char* p, const char* end,
+                                float* values) {
+    for (int i = 0; i < N; i++) {
+        p = skip_spaces(p, end);
+        const char* next = parse_float(p, end, values[i]);
+        if (next == p) return false;
+        p = next;
+    }
+    return true;
+}
+
+void ObjLoader::parse_chunk(const char* begin, const char* end, Chunk& chunk) {
+    ObjMesh& mesh = chunk.mesh;
+    chunk.errorLine = 0;
+    // Esquinas de la cara actual (se reutiliza entre caras)
+    std::vector<Vec3i> polygon;
+    std::vector<uint8_t> polygonRelative;  // bits: atributos relativos
+    size_t line = 0;
+    for (const char* p = begin; p < end; line++) {
+        const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+        if (lineEnd == nullptr) lineEnd = end;
+        const char* q = skip_spaces(p, lineEnd);
+        p = lineEnd + 1;
+        // Tipo de línea: palabra clave seguida de espacio
+        size_t keyLength = 0;
+        while (q + keyLength < lineEnd && !is_space(q[keyLength])) keyLength++;
+        if (q + keyLength == lineEnd) continue;  // vacía o sin datos
+        bool ok = true;
+        if (keyLength == 1 && q[0] == 'v') {
+            Vec3f v;
+            ok = parse_floats<3>(q + 1, lineEnd, v.raw);
+            mesh.verts.push_back(v);
+        } else if (keyLength == 2 && q[0] == 'v' && q[1] == 't') {
+            Vec2f uv;
+            ok = parse_floats<2>(q + 2, lineEnd, uv.raw);
+            mesh.uvs.push_back(uv);
+        } else if (keyLength == 2 && q[0] == 'v' && q[1] == 'n') {
+            Vec3f n;
+            ok = parse_floats<3>(q + 2, lineEnd, n.raw);
+            mesh.norms.push_back(n);
+        } else if (keyLength == 1 && q[0] == 'f') {
+            // Cada esquina: v, v/vt, v//vn o v/vt/vn
+            const int counts[3] = {(int)mesh.verts.size(),
+                                   (int)mesh.uvs.size(),
+                                   (int)mesh.norms.size()};
+            polygon.clear();
+            polygonRelative.clear();
+            q = skip_spaces(q + 1, lineEnd);
+            while (ok && q < lineEnd) {
+                Vec3i corner(-1, -1, -1);
+                uint8_t relative = 0;
+                for (int attr = 0; attr < 3 && ok; attr++) {
+                    if (attr > 0) {
+                        if (q >= lineEnd || *q != '/') break;
+                        q++;
+                        if (attr == 1 && q < lineEnd && *q == '/') continue;
+                    }
+                    int index;
+                    const char* next = parse_int(q, lineEnd, index);
+                    if (next == q || index == 0) {
+                        ok = false;
+                    } else if (index > 0) {
+                        corner.raw[attr] = index - 1;
+                    } else {
+                        corner.raw[attr] = counts[attr] + index;
+                        relative |= 1 << attr;
+                    }
+                    q = next;
+                }
+                polygon.push_back(corner);
+                polygonRelative.push_back(relative);
+                q = skip_spaces(q, lineEnd);
+            }
+            ok = ok && polygon.size() >= 3;
+            // Triangulación en abanico desde la primera esquina
+            for (size_t i = 2; ok && i < polygon.size(); i++) {
+                const size_t ids[3] = {0, i - 1, i};
+                for (int k = 0; k < 3; k++) {
+                    for (int attr = 0; attr < 3; attr++) {
+                        if (polygonRelative[ids[k]] & (1 << attr)) {
+                            chunk.relative.push_back(
+                                3 * mesh.corners.size() + attr);
+                        }
+                    }
+                    mesh.corners.push_back(polygon[ids[k]]);
+                }
+            }
+        }
+        if (!ok) {
+            chunk.errorLine = line + 1;
+            return;
+        }
+    }
+}
+
+bool ObjLoader::load(const char* filename, ObjMesh& mesh, int numThreads) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        mesh.clear();
+        return false;
+    }
+    if (!parse((const char*)file.data(), file.size(), mesh, numThreads)) {
+        std::cerr << "Invalid obj file " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ObjLoader::parse(const char* text, size_t length, ObjMesh& mesh,
+                      int numThreads) {
+    mesh.clear();
+    if (numThreads <= 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+        numThreads = std::min((size_t)numThreads,
+                              std::max((size_t)1, length / MIN_CHUNK_BYTES));
+    }
+    // Repartir el texto en trozos que acaben en final de línea
+    std::vector<const char*> bounds(1, text);
+    const char* end = text + length;
+    for (int i = 1; i < numThreads; i++) {
+        const char* p = std::max(bounds.back(), text + length * i / numThreads);
+        const char* newline = (const char*)memchr(p, '\n', end - p);
+        if (newline == nullptr) break;
+        bounds.push_back(newline + 1);
+    }
+    bounds.push_back(end);
+    int numChunks = bounds.size() - 1;
+
+    std::vector<Chunk> chunks(numChunks);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < numChunks; i++) {
+        threads.push_back(std::thread(parse_chunk, bounds[i], bounds[i + 1],
+                                      std::ref(chunks[i])));
+    }
+    parse_chunk(bounds[0], bounds[1], chunks[0]);
+    for (std::thread& t : threads) t.join();
+
+    // Juntar los trozos, corrigiendo los índices negativos con el número de
+    // elementos de los trozos anteriores
+    size_t totals[4] = {0, 0, 0, 0};
+    size_t lineOffset = 0;
+    for (int i = 0; i < numChunks; i++) {
+        Chunk& chunk = chunks[i];
+        if (chunk.errorLine != 0) {
+            // Número de línea aproximado: se cuentan las de los trozos
+            // anteriores
+            for (int j = 0; j < i; j++) {
+                lineOffset += std::count(bounds[j], bounds[j + 1], '\n');
+            }
+            std::cerr << "Error in obj line " << lineOffset + chunk.errorLine
+                      << std::endl;
+            mesh.clear();
+            return false;
+        }
+        int* indices = (int*)chunk.mesh.corners.data();
+        for (size_t r : chunk.relative) {
+            indices[r] += totals[r % 3];
+            // -1 es "sin atributo", no puede venir de un índice relativo
+            if (indices[r] < 0) {
+                std::cerr << "Obj face references a missing element"
+                          << std::endl;
+                mesh.clear();
+                return false;
+            }
+        }
+        totals[0] += chunk.mesh.verts.size();
+        totals[1] += chunk.mesh.uvs.size();
+        totals[2] += chunk.mesh.norms.size();
+        totals[3] += chunk.mesh.corners.size();
+    }
+    if (numChunks == 1) {
+        mesh.verts.swap(chunks[0].mesh.verts);
+        mesh.uvs.swap(chunks[0].mesh.uvs);
+        mesh.norms.swap(chunks[0].mesh.norms);
+        mesh.corners.swap(chunks[0].mesh.corners);
+    } else {
+        mesh.verts.reserve(totals[0]);
+        mesh.uvs.reserve(totals[1]);
+        mesh.norms.reserve(totals[2]);
+        mesh.corners.reserve(totals[3]);
+        for (Chunk& chunk : chunks) {
+            ObjMesh& m = chunk.mesh;
+            mesh.verts.insert(mesh.verts.end(), m.verts.begin(), m.verts.end());
+            mesh.uvs.insert(mesh.uvs.end(), m.uvs.begin(), m.uvs.end());
+            mesh.norms.insert(mesh.norms.end(), m.norms.begin(), m.norms.end());
+            mesh.corners.insert(mesh.corners.end(), m.corners.begin(),
+                                m.corners.end());
+        }
+    }
+
+    // Comprobar que todos los índices existen
+    const int counts[3] = {(int)mesh.verts.size(), (int)mesh.uvs.size(),
+                           (int)mesh.norms.size()};
+    for (const Vec3i& corner : mesh.corners) {
+        if (corner.ivert < 0 || corner.ivert >= counts[0] ||
+            corner.iuv < -1 || corner.iuv >= counts[1] ||
+            corner.inorm < -1 || corner.inorm >= counts[2]) {
+            std::cerr << "Obj face references a missing element" << std::endl;
+            mesh.clear();
+            return false;
+        }
+    }
+    return true;
+}
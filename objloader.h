@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "geometry.h"
+
+// Malla leída de un archivo .obj, con las caras trianguladas (en abanico)
+// y guardadas en un único array plano
+struct ObjMesh {
+    std::vector<Vec3f> verts;
+    std::vector<Vec2f> uvs;
+    std::vector<Vec3f> norms;
+    // 3 esquinas por triángulo: (ivert, iuv, inorm) empezando en 0
+    // iuv / inorm valen -1 si la cara no los indica
+    std::vector<Vec3i> corners;
+
+    void clear();
+};
+
+// Lector de modelos wavefront .obj
+// más info: https://en.wikipedia.org/wiki/Wavefront_.obj_file
+// Lee el archivo proyectado en memoria en una sola pasada, sin crear objetos
+// por línea. Soporta vértices (v), texturas (vt), normales (vn) y caras (f)
+// de la forma v, v/vt, v//vn y v/vt/vn, con índices negativos (relativos al
+// último elemento leído). El resto de líneas se ignoran
+// Los archivos grandes se reparten en trozos que se leen en paralelo
+class ObjLoader {
+   public:
+    // numThreads = 0: según el tamaño del archivo y los núcleos de la CPU
+    static bool load(const char* filename, ObjMesh& mesh, int numThreads = 0);
+    static bool parse(const char* text, size_t length, ObjMesh& mesh,
+                      int numThreads = 0);
+
+   private:
+    // Tamaño mínimo de cada trozo leído en paralelo
+    static const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+    struct Chunk;
+    static void parse_chunk(const char* begin, const char* end, Chunk& chunk);
+};
@@ -1,7 +1,20 @@
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
 #include "our_gl.h"
 #include "pngimage/pngimage.h"
 #include "pngimage/rgbcolor.h"
 
+// Las versiones SIMD se compilan con atributos target de GCC/Clang, así el
+// resto del programa no depende de las extensiones de la CPU
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RASTER_X86
+#include <immintrin.h>
+#endif
+
 void line(int x0, int y0, int x1, int y1, PNGImage& image,
           const RGBColor& color) {
     bool steep = false;
@@ -43,76 +56,884 @@ void line(Vec2i p0, Vec2i p1, PNGImage& image, const RGBColor& color) {
     line(p0.x, p0.y, p1.x, p1.y, image, color);
 }
 
-// coord. baricéntricas de p dentro del triangulo t0-t1-t2
-Vec3f barycentric(Vec3f t0, Vec3f t1, Vec3f t2, Vec3f p) {
-    Vec3f ab = t1 - t0;
-    Vec3f ac = t2 - t0;
-    Vec3f pa = t0 - p;
-    // Obtener u, v tq u*ab + v*ac + pa = 0
-    // Resolver (u v 1)'*(abx acx pax) = 0 y (u v 1)'*(aby acy pay) = 0
-    // producto vectorial de ambos dos, escalado para z = 1 (x/z, y/z, z/z=1)
-    Vec3f cross = Vec3f(ab.x, ac.x, pa.x) ^ Vec3f(ab.y, ac.y, pa.y);
-    // Pertenece si las coordenadas (u, v, 1-u-v) son todas mayores que 0
-    // u = cross.x / cross.z, v = cross.y / cross.z
-    // Es decir, las componentes x, y, z tienen el mismo signo (para u, v)
-    // y (x + y) <= z (para 1-u-v)
-    // También, si la z es 0 el triángulo es degenerado y no se dibuja
-    Vec3f coords(-1.0f, -1.0f, -1.0f);
-    if (std::abs(cross.z) > 0.01f) {  // solo si no es degenerado
-        coords.y = cross.x / cross.z;
-        coords.z = cross.y / cross.z;
-        // se suma una pequeña constante para evitar errores de precisión
-        coords.x = 1.0f + 1e-4f - (cross.x + cross.y) / cross.z;
-    }
-    return coords;
-}
-
-void triangle(Vec3f* t, IShader& shader, PNGImage& image, float* zbuffer) {
-    // Bounding box (dos puntos (xmin, ymin), (xmax, ymax))
-    Vec2i bboxmin(t[0].x, t[0].y), bboxmax(t[0].x, t[0].y);
-    for (int i = 0; i < 2; i++) {
-        if (t[1].raw[i] < bboxmin.raw[i]) bboxmin.raw[i] = t[1].raw[i];
-        if (t[2].raw[i] < bboxmin.raw[i]) bboxmin.raw[i] = t[2].raw[i];
-        if (t[1].raw[i] > bboxmax.raw[i]) bboxmax.raw[i] = t[1].raw[i];
-        if (t[2].raw[i] > bboxmax.raw[i]) bboxmax.raw[i] = t[2].raw[i];
-    }
-    // Recortar el trozo de fuera de la imagen
-    if (bboxmin.x < 0) bboxmin.x = 0;
-    if (bboxmin.y < 0) bboxmin.y = 0;
-    if (bboxmax.x > image.width - 1) bboxmax.x = image.width - 1;
-    if (bboxmax.y > image.height - 1) bboxmax.y = image.height - 1;
-    // Pintar los puntos de bbox que pertenecen al triangulo
-    // es decir, bc_coords tiene todas las componentes positivas
-    for (int y = bboxmin.y; y <= bboxmax.y; y++) {
-        for (int x = bboxmin.x; x <= bboxmax.x; x++) {
-            // Ver si el punto pertenece al triangulo
-            Vec3f bc_coords = barycentric(t[0], t[1], t[2], Vec3f(x, y, 0.0f));
-            if (bc_coords.x >= 0 && bc_coords.y >= 0 && bc_coords.z >= 0) {
-                // zbuffer para dibujar lo más cercano a la cámara
-                float z = bc_coords * Vec3f(t[0].z, t[1].z, t[2].z);
-                if (zbuffer[x + y * image.width] < z) {
-                    // Calcular el color (pixel x-y) de la textura
-                    // y multiplicarlo por la intensidad (luz)
-                    RGBColor color;
-                    bool discard = shader.fragment(bc_coords, color);
-                    if (!discard) {
-                        zbuffer[x + y * image.width] = z;
-                        image.set_pixel(x, y, color);
-                    }
+// Rasterización con funciones de arista en punto fijo
+// Los vértices se redondean a 1/SUBPIXEL_ONE de pixel, y para cada arista
+// a->b del triángulo (en sentido antihorario) se calcula
+//   E(p) = (b - a) ^ (p - a)   (> 0 si p está a la izquierda de la arista)
+// Un pixel pertenece al triángulo si las 3 funciones son positivas
+// Al ser lineales, de un pixel al siguiente solo se suma un incremento
+// Las coordenadas baricéntricas que recibe el shader se calculan en float
+// con los vértices sin redondear (como hasta ahora, ver Barycentric)
+static const int SUBPIXEL_BITS = 8;
+static const int64_t SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+
+static inline int64_t floor_div(int64_t a, int64_t b) {  // b > 0
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static inline int64_t ceil_div(int64_t a, int64_t b) {  // b > 0
+    return -floor_div(-a, b);
+}
+
+bool SnappedTriangle::snap(const Vec3f* t) {
+    for (int i = 0; i < 3; i++) {
+        // (también descarta NaN)
+        if (!(std::abs(t[i].x) < GUARD_BAND &&
+              std::abs(t[i].y) < GUARD_BAND)) {
+            return false;
+        }
+        x[i] = std::llround(t[i].x * SUBPIXEL_ONE);
+        y[i] = std::llround(t[i].y * SUBPIXEL_ONE);
+    }
+    area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    // Bounding box: pixels cuyas coordenadas enteras caen entre los vértices
+    pixels.x0 = ceil_div(std::min(x[0], std::min(x[1], x[2])), SUBPIXEL_ONE);
+    pixels.y0 = ceil_div(std::min(y[0], std::min(y[1], y[2])), SUBPIXEL_ONE);
+    pixels.x1 =
+        floor_div(std::max(x[0], std::max(x[1], x[2])), SUBPIXEL_ONE) + 1;
+    pixels.y1 =
+        floor_div(std::max(y[0], std::max(y[1], y[2])), SUBPIXEL_ONE) + 1;
+    return true;
+}
+
+uint32_t IShader::fragment_block(FragmentBlock& block, uint32_t mask) {
+    uint32_t discarded = 0;
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        if (mask >> i & 1) {
+            Vec3f bar(block.bar[0][i], block.bar[1][i], block.bar[2][i]);
+            if (fragment(bar, block.colors[i])) discarded |= 1u << i;
+        }
+    }
+    return discarded;
+}
+
+ZBuffer::ZBuffer(int width, int height, Format format, float depthRange)
+    : width(width),
+      height(height),
+      format(format),
+      depthRange(depthRange),
+      hierarchical(true) {
+    static_assert(CELL_SIZE == BLOCK_WIDTH && CELL_SIZE % BLOCK_HEIGHT == 0,
+                  "una columna de bloques por celda");
+    // Filas de múltiplos de 16 pixels, alineadas como el buffer
+    this->stride = (width + 15) / 16 * 16;
+    this->rows = (height + BLOCK_HEIGHT - 1) / BLOCK_HEIGHT * BLOCK_HEIGHT;
+    this->scale = 65535.0f / depthRange;
+    size_t pixelSize = format == FLOAT32 ? sizeof(float) : sizeof(uint16_t);
+    this->buffer = new uint8_t[(size_t)this->rows * this->stride * pixelSize +
+                               BUFFER_ALIGNMENT];
+    this->pixels =
+        this->buffer + (-(uintptr_t)this->buffer & (BUFFER_ALIGNMENT - 1));
+    this->cellsX = (width + CELL_SIZE - 1) / CELL_SIZE;
+    this->blockRows = this->rows / BLOCK_HEIGHT;
+    this->cellsY = (height + CELL_SIZE - 1) / CELL_SIZE;
+    this->groupsX = (width + GROUP_SIZE - 1) / GROUP_SIZE;
+    this->groupsY = (height + GROUP_SIZE - 1) / GROUP_SIZE;
+    this->blockMin.resize(this->cellsX * this->blockRows);
+    this->cellMin.resize(this->cellsX * this->cellsY);
+    this->groupMin.resize(this->groupsX * this->groupsY);
+    this->groupDirty.resize(this->groupMin.size());
+    this->groupCleared.resize(this->groupMin.size());
+    fill(-std::numeric_limits<float>::max());
+}
+
+ZBuffer::~ZBuffer() {
+    delete[] this->buffer;
+}
+
+void ZBuffer::fill(float value) {
+    this->clearValue = value;
+    std::fill(this->groupMin.begin(), this->groupMin.end(), key(value));
+    std::fill(this->groupDirty.begin(), this->groupDirty.end(), 0);
+    std::fill(this->groupCleared.begin(), this->groupCleared.end(), 1);
+}
+
+template <typename T>
+static void fill_rect(T* pixels, int stride, int x0, int y0, int x1, int y1,
+                      T value) {
+    for (int y = y0; y < y1; y++) {
+        std::fill(pixels + (size_t)y * stride + x0,
+                  pixels + (size_t)y * stride + x1, value);
+    }
+}
+
+void ZBuffer::clear_group(int group) {
+    int x0 = group % this->groupsX * GROUP_SIZE;
+    int y0 = group / this->groupsX * GROUP_SIZE;
+    int x1 = std::min(this->stride, x0 + GROUP_SIZE);
+    int y1 = std::min(this->rows, y0 + GROUP_SIZE);
+    if (this->format == FLOAT32) {
+        fill_rect(row<float>(0), this->stride, x0, y0, x1, y1,
+                  this->clearValue);
+    } else {
+        fill_rect(row<uint16_t>(0), this->stride, x0, y0, x1, y1,
+                  quantize(this->clearValue));
+    }
+    int cx0 = x0 / CELL_SIZE;
+    int cx1 = std::min(this->cellsX, (x0 + GROUP_SIZE) / CELL_SIZE);
+    for (int by = y0 / BLOCK_HEIGHT; by < y1 / BLOCK_HEIGHT; by++) {
+        std::fill(this->blockMin.begin() + by * this->cellsX + cx0,
+                  this->blockMin.begin() + by * this->cellsX + cx1,
+                  key(this->clearValue));
+    }
+    int cy1 = std::min(this->cellsY, (y0 + GROUP_SIZE) / CELL_SIZE);
+    for (int cy = y0 / CELL_SIZE; cy < cy1; cy++) {
+        std::fill(this->cellMin.begin() + cy * this->cellsX + cx0,
+                  this->cellMin.begin() + cy * this->cellsX + cx1,
+                  key(this->clearValue));
+    }
+    this->groupCleared[group] = 0;
+}
+
+void ZBuffer::prepare(const Rect& rect) {
+    for (int gy = rect.y0 / GROUP_SIZE; gy <= (rect.y1 - 1) / GROUP_SIZE;
+         gy++) {
+        for (int gx = rect.x0 / GROUP_SIZE; gx <= (rect.x1 - 1) / GROUP_SIZE;
+             gx++) {
+            int group = gy * this->groupsX + gx;
+            if (this->groupCleared[group]) clear_group(group);
+        }
+    }
+}
+
+// Mínimo de un bloque de pixels, solo de los que están dentro de la imagen
+// (los de relleno al final de las filas se quedan con el valor de fill)
+template <typename T>
+static float block_min(const T* z, int stride, int width, int height) {
+    T value = z[0];
+    if (width == BLOCK_WIDTH && height == BLOCK_HEIGHT) {
+        for (int i = 0; i < BLOCK_SIZE; i++) {
+            value = std::min(value, z[i / BLOCK_WIDTH * stride +
+                                      i % BLOCK_WIDTH]);
+        }
+        return value;
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            value = std::min(value, z[y * stride + x]);
+        }
+    }
+    return value;
+}
+
+void ZBuffer::written(int x, int y) {
+    const int cellBlocks = CELL_SIZE / BLOCK_HEIGHT;
+    int w = std::min(BLOCK_WIDTH, this->width - x);
+    int h = std::min(BLOCK_HEIGHT, this->height - y);
+    int cx = x / CELL_SIZE, cy = y / CELL_SIZE;
+    this->blockMin[y / BLOCK_HEIGHT * this->cellsX + cx] =
+        this->format == FLOAT32
+            ? block_min(row<float>(y) + x, this->stride, w, h)
+            : block_min(row<uint16_t>(y) + x, this->stride, w, h);
+    int by0 = cy * cellBlocks;
+    int by1 = std::min(this->blockRows, by0 + cellBlocks);
+    float value = this->blockMin[by0 * this->cellsX + cx];
+    for (int by = by0 + 1; by < by1; by++) {
+        value = std::min(value, this->blockMin[by * this->cellsX + cx]);
+    }
+    this->cellMin[cy * this->cellsX + cx] = value;
+    this->groupDirty[y / GROUP_SIZE * this->groupsX + x / GROUP_SIZE] = 1;
+}
+
+float ZBuffer::cell_min(int cx, int cy) {
+    int group = cy * CELL_SIZE / GROUP_SIZE * this->groupsX +
+                cx * CELL_SIZE / GROUP_SIZE;
+    if (this->groupCleared[group]) return key(this->clearValue);
+    return this->cellMin[cy * this->cellsX + cx];
+}
+
+// Mínimo de las celdas [cx0, cx1) x [cy0, cy1)
+static float cells_min(const float* cells, int cellsX, int cx0, int cy0,
+                       int cx1, int cy1) {
+    float value = std::numeric_limits<float>::infinity();
+    for (int cy = cy0; cy < cy1; cy++) {
+        for (int cx = cx0; cx < cx1; cx++) {
+            value = std::min(value, cells[cy * cellsX + cx]);
+        }
+    }
+    return value;
+}
+
+float ZBuffer::region_min(const Rect& rect) {
+    const int groupCells = GROUP_SIZE / CELL_SIZE;
+    float value = std::numeric_limits<float>::infinity();
+    int cx0 = rect.x0 / CELL_SIZE, cx1 = (rect.x1 - 1) / CELL_SIZE + 1;
+    int cy0 = rect.y0 / CELL_SIZE, cy1 = (rect.y1 - 1) / CELL_SIZE + 1;
+    for (int gy = rect.y0 / GROUP_SIZE; gy <= (rect.y1 - 1) / GROUP_SIZE;
+         gy++) {
+        for (int gx = rect.x0 / GROUP_SIZE; gx <= (rect.x1 - 1) / GROUP_SIZE;
+             gx++) {
+            int group = gy * this->groupsX + gx;
+            // Celdas del grupo dentro de rect
+            int x0 = std::max(cx0, gx * groupCells);
+            int x1 = std::min(cx1, (gx + 1) * groupCells);
+            int y0 = std::max(cy0, gy * groupCells);
+            int y1 = std::min(cy1, (gy + 1) * groupCells);
+            int allX1 = std::min(this->cellsX, (gx + 1) * groupCells);
+            int allY1 = std::min(this->cellsY, (gy + 1) * groupCells);
+            if (this->groupCleared[group]) {
+                value = std::min(value, key(this->clearValue));
+            } else if (x0 > gx * groupCells || y0 > gy * groupCells ||
+                       x1 < allX1 || y1 < allY1) {
+                value = std::min(value, cells_min(this->cellMin.data(),
+                                                  this->cellsX, x0, y0, x1,
+                                                  y1));
+            } else {
+                if (this->groupDirty[group]) {
+                    this->groupMin[group] =
+                        cells_min(this->cellMin.data(), this->cellsX, x0, y0,
+                                  x1, y1);
+                    this->groupDirty[group] = 0;
                 }
+                value = std::min(value, this->groupMin[group]);
             }
         }
     }
+    return value;
+}
+
+float ZBuffer::depth(int x, int y) {
+    int group = y / GROUP_SIZE * this->groupsX + x / GROUP_SIZE;
+    if (this->groupCleared[group]) return this->clearValue;
+    if (this->format == FLOAT32) return row<float>(y)[x];
+    return row<uint16_t>(y)[x] / this->scale;
+}
+
+// Operaciones por bloque de triangle(), con una versión por extensión SIMD:
+//   depth_test: calcula las coordenadas baricéntricas y la profundidad de
+//     los pixels del bloque (con las mismas operaciones que Barycentric, así
+//     el resultado no depende de la versión) y devuelve los de coverage que
+//     pasan el test de profundidad
+//   write: escribe la profundidad y el color de los pixels de mask (solo la
+//     profundidad si image es nullptr)
+//   write_colors: solo el color (con ZBuffer::UNORM16 la profundidad se
+//     escribe aparte)
+//   depth_test_unorm16: test de profundidad con ZBuffer::UNORM16 cuando
+//     depth_test ya ha calculado la profundidad del bloque
+// z apunta a la profundidad del pixel (block.x, block.y)
+struct RasterImplementation {
+    const char* name;
+    uint32_t (*depth_test)(const Barycentric& bary, const Vec3f& depths,
+                           uint32_t coverage, const float* z, int zstride,
+                           FragmentBlock& block);
+    void (*write)(const FragmentBlock& block, uint32_t mask, float* z,
+                  int zstride, PNGImage* image);
+    void (*write_colors)(const FragmentBlock& block, uint32_t mask,
+                         PNGImage& image);
+    uint32_t (*depth_test_unorm16)(const FragmentBlock& block,
+                                   uint32_t coverage, const uint16_t* z,
+                                   int zstride, const ZBuffer& zbuffer,
+                                   uint16_t* keys);
+};
+
+static uint32_t depth_test_scalar(const Barycentric& bary, const Vec3f& depths,
+                                  uint32_t coverage, const float* z,
+                                  int zstride, FragmentBlock& block) {
+    uint32_t pass = 0;
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        int dx = i % BLOCK_WIDTH, dy = i / BLOCK_WIDTH;
+        Vec3f bc = bary.at(block.x + dx, block.y + dy);
+        float depth = bc * depths;
+        for (int k = 0; k < 3; k++) block.bar[k][i] = bc.raw[k];
+        block.z[i] = depth;
+        if (z[dy * zstride + dx] < depth) pass |= 1u << i;
+    }
+    return pass & coverage;
+}
+
+static void write_colors_scalar(const FragmentBlock& block, uint32_t mask,
+                                PNGImage& image) {
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        if (mask >> i & 1) {
+            image.set_pixel(block.x + i % BLOCK_WIDTH,
+                            block.y + i / BLOCK_WIDTH, block.colors[i]);
+        }
+    }
+}
+
+static void write_scalar(const FragmentBlock& block, uint32_t mask, float* z,
+                         int zstride, PNGImage* image) {
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        if (mask >> i & 1) {
+            z[i / BLOCK_WIDTH * zstride + i % BLOCK_WIDTH] = block.z[i];
+        }
+    }
+    if (image != nullptr) write_colors_scalar(block, mask, *image);
+}
+
+// Test de profundidad con ZBuffer::UNORM16: la profundidad de block (ya
+// calculada) se pasa a enteros en keys, y devuelve los pixels de coverage
+// más cerca que los de z
+static uint32_t depth_test_unorm16(const FragmentBlock& block,
+                                   uint32_t coverage, const uint16_t* z,
+                                   int zstride, const ZBuffer& zbuffer,
+                                   uint16_t* keys) {
+    uint32_t pass = 0;
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        keys[i] = zbuffer.quantize(block.z[i]);
+        uint16_t old = z[i / BLOCK_WIDTH * zstride + i % BLOCK_WIDTH];
+        pass |= (uint32_t)(old < keys[i]) << i;
+    }
+    return pass & coverage;
+}
+
+static void write_unorm16(const uint16_t* keys, uint32_t mask, uint16_t* z,
+                          int zstride) {
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        if (mask >> i & 1) {
+            z[i / BLOCK_WIDTH * zstride + i % BLOCK_WIDTH] = keys[i];
+        }
+    }
+}
+
+#ifdef RASTER_X86
+// Cada versión calcula las coordenadas baricéntricas y la profundidad de
+// varios pixels de una fila a la vez (4, 8 o los 16 del bloque)
+
+__attribute__((target("sse2"))) static uint32_t depth_test_sse2(
+    const Barycentric& bary, const Vec3f& depths, uint32_t coverage,
+    const float* z, int zstride, FragmentBlock& block) {
+    const __m128 t0x = _mm_set1_ps(bary.t0.x), t0y = _mm_set1_ps(bary.t0.y);
+    const __m128 abx = _mm_set1_ps(bary.ab.x), aby = _mm_set1_ps(bary.ab.y);
+    const __m128 acx = _mm_set1_ps(bary.ac.x), acy = _mm_set1_ps(bary.ac.y);
+    const __m128 inv = _mm_set1_ps(bary.invCrossZ);
+    const __m128 one = _mm_set1_ps(1.0f + 1e-4f);
+    const __m128 z0 = _mm_set1_ps(depths.x), z1 = _mm_set1_ps(depths.y),
+                 z2 = _mm_set1_ps(depths.z);
+    const __m128 iota = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    uint32_t pass = 0;
+    for (int i = 0; i < BLOCK_SIZE; i += 4) {
+        int dx = i % BLOCK_WIDTH, dy = i / BLOCK_WIDTH;
+        __m128 x = _mm_add_ps(_mm_set1_ps(block.x + dx), iota);
+        __m128 y = _mm_set1_ps(block.y + dy);
+        __m128 pax = _mm_sub_ps(t0x, x), pay = _mm_sub_ps(t0y, y);
+        __m128 crossX = _mm_sub_ps(_mm_mul_ps(acx, pay), _mm_mul_ps(pax, acy));
+        __m128 crossY = _mm_sub_ps(_mm_mul_ps(pax, aby), _mm_mul_ps(abx, pay));
+        __m128 b0 =
+            _mm_sub_ps(one, _mm_mul_ps(_mm_add_ps(crossX, crossY), inv));
+        __m128 b1 = _mm_mul_ps(crossX, inv), b2 = _mm_mul_ps(crossY, inv);
+        __m128 depth = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(b0, z0), _mm_mul_ps(b1, z1)),
+            _mm_mul_ps(b2, z2));
+        _mm_store_ps(block.bar[0] + i, b0);
+        _mm_store_ps(block.bar[1] + i, b1);
+        _mm_store_ps(block.bar[2] + i, b2);
+        _mm_store_ps(block.z + i, depth);
+        __m128 old = _mm_loadu_ps(z + dy * zstride + dx);
+        pass |= _mm_movemask_ps(_mm_cmplt_ps(old, depth)) << i;
+    }
+    return pass & coverage;
+}
+
+// Sin comparaciones de enteros de 16 bits sin signo en SSE2: se pasan a con
+// signo restando 32768
+__attribute__((target("sse2"))) static uint32_t depth_test_unorm16_sse2(
+    const FragmentBlock& block, uint32_t coverage, const uint16_t* z,
+    int zstride, const ZBuffer& zbuffer, uint16_t* keys) {
+    const __m128 scale = _mm_set1_ps(zbuffer.quantize_scale());
+    const __m128 half = _mm_set1_ps(0.5f), zero = _mm_setzero_ps();
+    const __m128 top = _mm_set1_ps(65535.0f);
+    const __m128i bias32 = _mm_set1_epi32(32768);
+    const __m128i bias16 = _mm_set1_epi16(-32768);
+    uint32_t pass = 0;
+    for (int dy = 0; dy < BLOCK_HEIGHT; dy++) {
+        int i = dy * BLOCK_WIDTH;
+        __m128i q[2];
+        for (int k = 0; k < 2; k++) {
+            __m128 v = _mm_add_ps(
+                _mm_mul_ps(_mm_load_ps(block.z + i + 4 * k), scale), half);
+            // max(0, v): NaN a 0, como ZBuffer::quantize
+            v = _mm_min_ps(_mm_max_ps(zero, v), top);
+            q[k] = _mm_sub_epi32(_mm_cvttps_epi32(v), bias32);
+        }
+        __m128i key = _mm_packs_epi32(q[0], q[1]);
+        __m128i old = _mm_xor_si128(
+            _mm_loadu_si128((const __m128i*)(z + dy * zstride)), bias16);
+        _mm_storeu_si128((__m128i*)(keys + i), _mm_xor_si128(key, bias16));
+        __m128i gt = _mm_cmpgt_epi16(key, old);
+        pass |= (_mm_movemask_epi8(_mm_packs_epi16(gt, gt)) & 0xFF) << i;
+    }
+    return pass & coverage;
+}
+
+// Sin escrituras con máscara en SSE2: se mezcla con la profundidad anterior
+// y se escriben los 4 valores
+__attribute__((target("sse2"))) static void write_sse2(
+    const FragmentBlock& block, uint32_t mask, float* z, int zstride,
+    PNGImage* image) {
+    const __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+    for (int i = 0; i < BLOCK_SIZE; i += 4) {
+        uint32_t m = mask >> i & 0xF;
+        if (!m) continue;
+        float* dst = z + i / BLOCK_WIDTH * zstride + i % BLOCK_WIDTH;
+        __m128 sel = _mm_castsi128_ps(_mm_cmpeq_epi32(
+            _mm_and_si128(_mm_set1_epi32(m), bits), bits));
+        __m128 value = _mm_or_ps(_mm_and_ps(sel, _mm_load_ps(block.z + i)),
+                                 _mm_andnot_ps(sel, _mm_loadu_ps(dst)));
+        _mm_storeu_ps(dst, value);
+    }
+    if (image != nullptr) write_colors_scalar(block, mask, *image);
+}
+
+__attribute__((target("avx2"))) static uint32_t depth_test_avx2(
+    const Barycentric& bary, const Vec3f& depths, uint32_t coverage,
+    const float* z, int zstride, FragmentBlock& block) {
+    const __m256 t0x = _mm256_set1_ps(bary.t0.x),
+                 t0y = _mm256_set1_ps(bary.t0.y);
+    const __m256 abx = _mm256_set1_ps(bary.ab.x),
+                 aby = _mm256_set1_ps(bary.ab.y);
+    const __m256 acx = _mm256_set1_ps(bary.ac.x),
+                 acy = _mm256_set1_ps(bary.ac.y);
+    const __m256 inv = _mm256_set1_ps(bary.invCrossZ);
+    const __m256 one = _mm256_set1_ps(1.0f + 1e-4f);
+    const __m256 z0 = _mm256_set1_ps(depths.x), z1 = _mm256_set1_ps(depths.y),
+                 z2 = _mm256_set1_ps(depths.z);
+    const __m256 x = _mm256_add_ps(
+        _mm256_set1_ps(block.x),
+        _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+    const __m256 pax = _mm256_sub_ps(t0x, x);
+    uint32_t pass = 0;
+    for (int dy = 0; dy < BLOCK_HEIGHT; dy++) {
+        int i = dy * BLOCK_WIDTH;
+        __m256 pay = _mm256_sub_ps(t0y, _mm256_set1_ps(block.y + dy));
+        __m256 crossX =
+            _mm256_sub_ps(_mm256_mul_ps(acx, pay), _mm256_mul_ps(pax, acy));
+        __m256 crossY =
+            _mm256_sub_ps(_mm256_mul_ps(pax, aby), _mm256_mul_ps(abx, pay));
+        __m256 b0 = _mm256_sub_ps(
+            one, _mm256_mul_ps(_mm256_add_ps(crossX, crossY), inv));
+        __m256 b1 = _mm256_mul_ps(crossX, inv), b2 = _mm256_mul_ps(crossY, inv);
+        __m256 depth = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(b0, z0), _mm256_mul_ps(b1, z1)),
+            _mm256_mul_ps(b2, z2));
+        _mm256_store_ps(block.bar[0] + i, b0);
+        _mm256_store_ps(block.bar[1] + i, b1);
+        _mm256_store_ps(block.bar[2] + i, b2);
+        _mm256_store_ps(block.z + i, depth);
+        __m256 old = _mm256_loadu_ps(z + dy * zstride);
+        pass |= _mm256_movemask_ps(_mm256_cmp_ps(old, depth, _CMP_LT_OQ)) << i;
+    }
+    return pass & coverage;
+}
+
+__attribute__((target("avx2"))) static void write_avx2(
+    const FragmentBlock& block, uint32_t mask, float* z, int zstride,
+    PNGImage* image) {
+    const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    for (int dy = 0; dy < BLOCK_HEIGHT; dy++) {
+        int i = dy * BLOCK_WIDTH;
+        uint32_t m = mask >> i & 0xFF;
+        if (!m) continue;
+        __m256i sel = _mm256_cmpeq_epi32(
+            _mm256_and_si256(_mm256_set1_epi32(m), bits), bits);
+        _mm256_maskstore_ps(z + dy * zstride, sel, _mm256_load_ps(block.z + i));
+    }
+    if (image != nullptr) write_colors_scalar(block, mask, *image);
+}
+
+// Los 16 pixels del bloque en un registro
+// Con AVX-512 GCC puede fusionar productos y sumas en FMA, que redondea
+// distinto que la versión escalar
+__attribute__((target("avx512f,avx512bw,avx512vl"),
+               optimize("fp-contract=off"))) static uint32_t
+depth_test_avx512(const Barycentric& bary, const Vec3f& depths,
+                  uint32_t coverage, const float* z, int zstride,
+                  FragmentBlock& block) {
+    const __m512 lanesX =
+        _mm512_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 0.0f,
+                       1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    const __m512 lanesY =
+        _mm512_setr_ps(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+                       1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f);
+    __m512 x = _mm512_add_ps(_mm512_set1_ps(block.x), lanesX);
+    __m512 y = _mm512_add_ps(_mm512_set1_ps(block.y), lanesY);
+    __m512 pax = _mm512_sub_ps(_mm512_set1_ps(bary.t0.x), x);
+    __m512 pay = _mm512_sub_ps(_mm512_set1_ps(bary.t0.y), y);
+    __m512 crossX =
+        _mm512_sub_ps(_mm512_mul_ps(_mm512_set1_ps(bary.ac.x), pay),
+                      _mm512_mul_ps(pax, _mm512_set1_ps(bary.ac.y)));
+    __m512 crossY =
+        _mm512_sub_ps(_mm512_mul_ps(pax, _mm512_set1_ps(bary.ab.y)),
+                      _mm512_mul_ps(_mm512_set1_ps(bary.ab.x), pay));
+    __m512 inv = _mm512_set1_ps(bary.invCrossZ);
+    __m512 b0 =
+        _mm512_sub_ps(_mm512_set1_ps(1.0f + 1e-4f),
+                      _mm512_mul_ps(_mm512_add_ps(crossX, crossY), inv));
+    __m512 b1 = _mm512_mul_ps(crossX, inv), b2 = _mm512_mul_ps(crossY, inv);
+    __m512 depth = _mm512_add_ps(
+        _mm512_add_ps(_mm512_mul_ps(b0, _mm512_set1_ps(depths.x)),
+                      _mm512_mul_ps(b1, _mm512_set1_ps(depths.y))),
+        _mm512_mul_ps(b2, _mm512_set1_ps(depths.z)));
+    _mm512_store_ps(block.bar[0], b0);
+    _mm512_store_ps(block.bar[1], b1);
+    _mm512_store_ps(block.bar[2], b2);
+    _mm512_store_ps(block.z, depth);
+    __m512 old = _mm512_castpd_ps(_mm512_insertf64x4(
+        _mm512_castps_pd(_mm512_castps256_ps512(_mm256_loadu_ps(z))),
+        _mm256_castps_pd(_mm256_loadu_ps(z + zstride)), 1));
+    return _mm512_mask_cmp_ps_mask(coverage, old, depth, _CMP_LT_OQ);
+}
+
+// Escrituras con máscara: profundidad por floats y color por bytes (cada
+// pixel RGB son 3 bits de la máscara)
+__attribute__((target("avx512f,avx512bw,avx512vl,bmi2"))) static void
+write_colors_avx512(const FragmentBlock& block, uint32_t mask,
+                    PNGImage& image) {
+    if (image.channels != 3) {
+        write_colors_scalar(block, mask, image);
+        return;
+    }
+    for (int dy = 0; dy < BLOCK_HEIGHT; dy++) {
+        int i = dy * BLOCK_WIDTH;
+        uint32_t m = mask >> i & 0xFF;
+        if (!m) continue;
+        // Bit k de m a los bits 3k..3k+2
+        uint32_t bytes = _pdep_u32(m, 0x00249249) * 7;
+        _mm256_mask_storeu_epi8(
+            image.span(block.x, block.y + dy), bytes,
+            _mm256_loadu_si256((const __m256i*)(block.colors + i)));
+    }
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl,bmi2"))) static void
+write_avx512(const FragmentBlock& block, uint32_t mask, float* z, int zstride,
+             PNGImage* image) {
+    for (int dy = 0; dy < BLOCK_HEIGHT; dy++) {
+        int i = dy * BLOCK_WIDTH;
+        uint32_t m = mask >> i & 0xFF;
+        if (m) {
+            _mm256_mask_storeu_ps(z + dy * zstride, m,
+                                  _mm256_load_ps(block.z + i));
+        }
+    }
+    if (image != nullptr) write_colors_avx512(block, mask, *image);
+}
+#endif  // RASTER_X86
+
+static std::vector<RasterImplementation> available_implementations() {
+    std::vector<RasterImplementation> list;
+    list.push_back({"scalar", depth_test_scalar, write_scalar,
+                    write_colors_scalar, depth_test_unorm16});
+#ifdef RASTER_X86
+    if (__builtin_cpu_supports("sse2")) {
+        list.push_back({"sse2", depth_test_sse2, write_sse2,
+                        write_colors_scalar, depth_test_unorm16_sse2});
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        list.push_back({"avx2", depth_test_avx2, write_avx2,
+                        write_colors_scalar, depth_test_unorm16_sse2});
+    }
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vl") &&
+        __builtin_cpu_supports("bmi2")) {
+        list.push_back({"avx512", depth_test_avx512, write_avx512,
+                        write_colors_avx512, depth_test_unorm16_sse2});
+    }
+#endif
+    return list;
+}
+
+static RasterImplementation& selected_implementation() {
+    static RasterImplementation selected = available_implementations().back();
+    return selected;
+}
+
+std::vector<const char*> raster_implementations() {
+    std::vector<const char*> names;
+    for (const RasterImplementation& impl : available_implementations()) {
+        names.push_back(impl.name);
+    }
+    return names;
+}
+
+bool use_raster_implementation(const char* name) {
+    for (const RasterImplementation& impl : available_implementations()) {
+        if (strcmp(impl.name, name) == 0) {
+            selected_implementation() = impl;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Profundidad anterior para las versiones de depth_test cuando no se usa su
+// test (z-buffer UNORM16): todos los pixels de coverage lo pasan
+static const float NO_DEPTH[BLOCK_WIDTH] = {
+    -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(),
+    -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(),
+    -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(),
+    -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()};
+
+// Máscara de los pixels bx..bx+BLOCK_WIDTH-1 que están en [x0, x1]
+static inline uint32_t span_mask(int64_t x0, int64_t x1, int bx) {
+    int64_t lo = std::max<int64_t>(x0 - bx, 0);
+    int64_t hi = std::min<int64_t>(x1 - bx, BLOCK_WIDTH - 1);
+    return lo > hi ? 0 : (2u << hi) - (1u << lo);
+}
+
+void triangle(Vec3f* t, IShader& shader, PNGImage& image, ZBuffer& zbuffer) {
+    triangle<IShader>(t, shader, image, zbuffer,
+                      Rect{0, 0, image.width, image.height});
+}
+
+void triangle(Vec3f* t, IShader& shader, PNGImage& image, ZBuffer& zbuffer,
+              const Rect& clip) {
+    triangle<IShader>(t, shader, image, zbuffer, clip);
+}
+
+bool BlockRasterizer::setup(const Vec3f* t, const Rect& clip,
+                            ZBuffer& zbuffer, const uint32_t* ids,
+                            int idStride, uint32_t id) {
+    // Vértices en punto fijo
+    SnappedTriangle snapped;
+    if (!snapped.snap(t)) return false;
+    const int64_t *vx = snapped.x, *vy = snapped.y;
+    barycentric = Barycentric(t);
+    // degenerado (también si es casi una línea, para evitar divisiones
+    // entre valores muy pequeños)
+    if (snapped.area == 0 || std::abs(barycentric.crossZ) <= 0.01f) {
+        return false;
+    }
+    // Recorrer los vértices en sentido antihorario (área positiva)
+    int order[3] = {0, 1, 2};
+    if (snapped.area < 0) std::swap(order[1], order[2]);
+
+    // Pixels de la bounding box, recortada a clip
+    xmin = std::max(clip.x0, snapped.pixels.x0);
+    ymin = std::max(clip.y0, snapped.pixels.y0);
+    xmax = std::min(clip.x1, snapped.pixels.x1) - 1;
+    ymax = std::min(clip.y1, snapped.pixels.y1) - 1;
+    if (xmin > xmax || ymin > ymax) return false;
+
+    // Arista k: la opuesta al vértice order[k]. Valor de su función en el
+    // pixel (xmin, ymin) e incrementos por pixel en x e y
+    // Regla top-left: los pixels justo sobre una arista solo se pintan si
+    // es superior o izquierda, para que un pixel en la arista común de dos
+    // triángulos se pinte una sola vez (bias -1: exigir E > 0)
+    for (int k = 0; k < 3; k++) {
+        int a = order[(k + 1) % 3], b = order[(k + 2) % 3];
+        int64_t dx = vx[b] - vx[a], dy = vy[b] - vy[a];
+        stepX[k] = -dy * SUBPIXEL_ONE;
+        stepY[k] = dx * SUBPIXEL_ONE;
+        rowValue[k] = dx * (ymin * SUBPIXEL_ONE - vy[a]) -
+                      dy * (xmin * SUBPIXEL_ONE - vx[a]);
+        bool topLeft = dy < 0 || (dy == 0 && dx < 0);
+        bias[k] = topLeft ? 0 : -1;
+    }
+
+    impl = &selected_implementation();
+    depths = Vec3f(t[0].z, t[1].z, t[2].z);
+    // La primera llamada a next pasa a la primera fila de bloques
+    by = ymin / BLOCK_HEIGHT * BLOCK_HEIGHT - BLOCK_HEIGHT;
+    bx = 1;
+    blockX1 = 0;
+    occludedRow = -1;
+    occludedCells = 0;
+    visibleIds = ids;
+    this->idStride = idStride;
+    idX0 = clip.x0;
+    idY0 = clip.y0;
+    visibleId = id;
+    if (ids != nullptr) return true;
+
+    // Plano de la profundidad que calcula depth_test (las mismas
+    // operaciones que Barycentric::at, en double), y cota de la diferencia
+    // con la calculada en float: proporcional a los productos de crossX y
+    // crossY, con mucho margen
+    const Barycentric& b = barycentric;
+    double inv = b.invCrossZ;
+    double dz1 = (double)t[1].z - t[0].z, dz2 = (double)t[2].z - t[0].z;
+    depthA = inv * (b.ac.y * dz1 - b.ab.y * dz2);
+    depthB = inv * (b.ab.x * dz2 - b.ac.x * dz1);
+    depthC = (double)(1.0f + 1e-4f) * t[0].z - depthA * b.t0.x -
+             depthB * b.t0.y;
+    double extent = std::max(
+        std::max(std::abs(b.t0.x - xmin), std::abs(b.t0.x - xmax)),
+        std::max(std::abs(b.t0.y - ymin), std::abs(b.t0.y - ymax)));
+    double edges = std::abs(b.ab.x) + std::abs(b.ab.y) + std::abs(b.ac.x) +
+                   std::abs(b.ac.y);
+    double sumZ = std::abs(t[0].z) + std::abs(t[1].z) + std::abs(t[2].z);
+    depthError = (edges * (extent + 1.0) * std::abs(inv) + 1.0) * sumZ *
+                 std::ldexp(1.0, -18);
+
+    // Triángulo entero detrás de lo dibujado
+    Rect bounds = {xmin, ymin, xmax + 1, ymax + 1};
+    if (zbuffer.hierarchical &&
+        max_key(bounds, zbuffer) <= zbuffer.region_min(bounds)) {
+        counters.occludedTriangles++;
+        return false;
+    }
+    zbuffer.prepare(bounds);
+    return true;
+}
+
+float BlockRasterizer::max_key(const Rect& r, const ZBuffer& zbuffer) const {
+    // El máximo de un plano en un rectángulo está en una esquina. Al pasar
+    // a float cualquier float menor que el double lo sigue siendo
+    double z = depthC +
+               std::max(depthA * r.x0, depthA * (r.x1 - 1)) +
+               std::max(depthB * r.y0, depthB * (r.y1 - 1)) + depthError;
+    return zbuffer.key((float)z);
+}
+
+// Celdas de la fila de celdas de by (como mucho 64) en las que el
+// triángulo no puede pasar el test de profundidad
+void BlockRasterizer::update_occluded_cells(ZBuffer& zbuffer) {
+    const int size = ZBuffer::CELL_SIZE;
+    occludedRow = by / size;
+    occludedCells = 0;
+    if (!zbuffer.hierarchical || visibleIds != nullptr) return;
+    int cx0 = xmin / size, cx1 = std::min(xmax / size, cx0 + 63);
+    int y0 = std::max(ymin, occludedRow * size);
+    int y1 = std::min(ymax + 1, (occludedRow + 1) * size);
+    for (int cx = cx0; cx <= cx1; cx++) {
+        Rect r = {std::max(xmin, cx * size), y0,
+                  std::min(xmax + 1, (cx + 1) * size), y1};
+        if (max_key(r, zbuffer) <= zbuffer.cell_min(cx, occludedRow)) {
+            occludedCells |= 1ull << (cx - cx0);
+        }
+    }
+}
+
+// Recorrido por bloques de BLOCK_WIDTH x BLOCK_HEIGHT pixels: en cada fila
+// se calculan directamente los extremos de los pixels dentro de las 3
+// aristas (sin recorrer los de fuera), y de ahí la máscara de cada bloque.
+// Solo los bloques con algún pixel se procesan
+void BlockRasterizer::next_row() {
+    int64_t blockX0 = xmax + 1;
+    blockX1 = xmin - 1;
+    for (int dy = 0; dy < BLOCK_HEIGHT; dy++) {
+        int64_t x0 = xmin, x1 = xmax;
+        int y = by + dy;
+        if (y < ymin || y > ymax) {
+            x1 = x0 - 1;
+        } else {
+            for (int k = 0; k < 3; k++) {
+                int64_t e = rowValue[k] + bias[k];
+                if (stepX[k] > 0) {
+                    x0 = std::max(x0, xmin + ceil_div(-e, stepX[k]));
+                } else if (stepX[k] < 0) {
+                    x1 = std::min(x1, xmin + floor_div(e, -stepX[k]));
+                } else if (e < 0) {
+                    x1 = x0 - 1;  // arista horizontal, fila fuera
+                }
+                rowValue[k] += stepY[k];
+            }
+        }
+        spanX0[dy] = x0;
+        spanX1[dy] = x1;
+        if (x0 <= x1) {
+            blockX0 = std::min(blockX0, x0);
+            blockX1 = std::max(blockX1, x1);
+        }
+    }
+    bx = blockX0 / BLOCK_WIDTH * BLOCK_WIDTH;
+}
+
+uint32_t BlockRasterizer::next(FragmentBlock& block, ZBuffer& zbuffer) {
+    for (;;) {
+        if (bx > blockX1) {
+            by += BLOCK_HEIGHT;
+            if (by > ymax) return 0;
+            if (by / ZBuffer::CELL_SIZE != occludedRow) {
+                update_occluded_cells(zbuffer);
+            }
+            next_row();
+            continue;
+        }
+        int x = bx;
+        bx += BLOCK_WIDTH;
+        uint32_t coverage = 0;
+        for (int dy = 0; dy < BLOCK_HEIGHT; dy++) {
+            coverage |= span_mask(spanX0[dy], spanX1[dy], x)
+                        << (dy * BLOCK_WIDTH);
+        }
+        if (!coverage) continue;
+        counters.fragments += __builtin_popcount(coverage);
+        int cell = x / ZBuffer::CELL_SIZE - xmin / ZBuffer::CELL_SIZE;
+        if (cell < 64 && (occludedCells >> cell & 1)) {
+            counters.occluded += __builtin_popcount(coverage);
+            continue;
+        }
+        block.x = x;
+        block.y = by;
+        uint32_t mask;
+        if (visibleIds != nullptr) {
+            impl->depth_test(barycentric, depths, coverage, NO_DEPTH, 0, block);
+            mask = 0;
+            for (int i = 0; i < BLOCK_SIZE; i++) {
+                int px = x + i % BLOCK_WIDTH - idX0;
+                int py = by + i / BLOCK_WIDTH - idY0;
+                if (coverage >> i & 1 &&
+                    visibleIds[(size_t)py * idStride + px] == visibleId) {
+                    mask |= 1u << i;
+                }
+            }
+            if (mask) return mask;
+            continue;
+        }
+        if (zbuffer.format == ZBuffer::FLOAT32) {
+            mask = impl->depth_test(barycentric, depths, coverage,
+                                    zbuffer.row<float>(by) + x,
+                                    zbuffer.stride, block);
+        } else {
+            impl->depth_test(barycentric, depths, coverage, NO_DEPTH, 0, block);
+            mask = impl->depth_test_unorm16(block, coverage,
+                                            zbuffer.row<uint16_t>(by) + x,
+                                            zbuffer.stride, zbuffer, keys);
+        }
+        counters.shaded += __builtin_popcount(mask);
+        if (mask) return mask;
+    }
+}
+
+void BlockRasterizer::write(const FragmentBlock& block, uint32_t mask,
+                            ZBuffer& zbuffer, PNGImage* image) {
+    if (zbuffer.format == ZBuffer::FLOAT32) {
+        impl->write(block, mask, zbuffer.row<float>(block.y) + block.x,
+                    zbuffer.stride, image);
+    } else {
+        write_unorm16(keys, mask, zbuffer.row<uint16_t>(block.y) + block.x,
+                      zbuffer.stride);
+        if (image != nullptr) impl->write_colors(block, mask, *image);
+    }
+    zbuffer.written(block.x, block.y);
+}
+
+void BlockRasterizer::write_colors(const FragmentBlock& block, uint32_t mask,
+                                   PNGImage& image) {
+    impl->write_colors(block, mask, image);
+}
+
+void triangle_visibility(Vec3f* t, uint32_t id, ZBuffer& zbuffer,
+                         const Rect& clip, uint32_t* ids, int idStride,
+                         RasterCounters* counters) {
+    BlockRasterizer raster;
+    if (raster.setup(t, clip, zbuffer)) {
+        FragmentBlock block;
+        while (uint32_t mask = raster.next(block, zbuffer)) {
+            raster.write(block, mask, zbuffer, nullptr);
+            for (int i = 0; i < BLOCK_SIZE; i++) {
+                if (mask >> i & 1) {
+                    int x = block.x + i % BLOCK_WIDTH - clip.x0;
+                    int y = block.y + i / BLOCK_WIDTH - clip.y0;
+                    ids[(size_t)y * idStride + x] = id;
+                }
+            }
+        }
+    }
+    if (counters != nullptr) counters->add(raster.counters);
 }
 
 // devuelve la matriz modelview (coordenadas del modelo
 // a coordenadas de la cámara)
-Matrix lookat(Vec3f eye, Vec3f center, Vec3f up) {
+Mat4 lookat(Vec3f eye, Vec3f center, Vec3f up) {
     Vec3f z = (eye - center).normalize();
     Vec3f x = (up ^ z).normalize();
     Vec3f y = (z ^ x).normalize();
-    Matrix Minv = Matrix::identity(4);
-    Matrix Tr = Matrix::identity(4);
+    Mat4 Minv = Mat4::identity();
+    Mat4 Tr = Mat4::identity();
     for (int i = 0; i < 3; i++) {
         Minv[0][i] = x.raw[i];
         Minv[1][i] = y.raw[i];
@@ -121,25 +942,3 @@ Matrix lookat(Vec3f eye, Vec3f center, Vec3f up) {
     }
     return Minv * Tr;
 }
-
-// mapeo del cubo [-1, 1] * [-1, 1] * [-1, 1]
-// al cubo [x, x + w] * [y, y + h] * [0, d]
-Matrix getViewport(int x, int y, int w, int h, int d) {
-    Matrix m = Matrix::identity(4);
-    m[0][3] = x + w / 2.0f;
-    m[1][3] = y + h / 2.0f;
-    m[2][3] = d / 2.0f;
-
-    m[0][0] = w / 2.0f;
-    m[1][1] = h / 2.0f;
-    m[2][2] = d / 2.0f;
-    return m;
-}
-
-// Matriz de proyección en perspectiva
-// c: distancia entre la cámara y el centro de la escena
-Matrix getProjection(float c) {
-    Matrix m = Matrix::identity(4);
-    m[3][2] = -1.0f / c;
-    return m;
-}
\ No newline at end of file
@@ -1,14 +1,402 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
 #include "geometry.h"
 #include "pngimage/pngimage.h"
 #include "pngimage/rgbcolor.h"
 
-Matrix lookat(Vec3f eye, Vec3f center, Vec3f up);
-Matrix getViewport(int x, int y, int w, int h, int d);
-Matrix getProjection(float c);
+// devuelve la matriz modelview (coordenadas del modelo
+// a coordenadas de la cámara)
+Mat4 lookat(Vec3f eye, Vec3f center, Vec3f up);
+
+// mapeo del cubo [-1, 1] * [-1, 1] * [-1, 1]
+// al cubo [x, x + w] * [y, y + h] * [0, d]
+constexpr Mat4 getViewport(int x, int y, int w, int h, int d) {
+    Mat4 m = Mat4::identity();
+    m.m[0][3] = x + w / 2.0f;
+    m.m[1][3] = y + h / 2.0f;
+    m.m[2][3] = d / 2.0f;
+
+    m.m[0][0] = w / 2.0f;
+    m.m[1][1] = h / 2.0f;
+    m.m[2][2] = d / 2.0f;
+    return m;
+}
 
+// Matriz de proyección en perspectiva
+// c: distancia entre la cámara y el centro de la escena
+constexpr Mat4 getProjection(float c) {
+    Mat4 m = Mat4::identity();
+    m.m[3][2] = -1.0f / c;
+    return m;
+}
+
+// triangle() procesa los pixels en bloques de BLOCK_WIDTH x BLOCK_HEIGHT,
+// alineados a múltiplos de su tamaño. El pixel i del bloque (bit i de las
+// máscaras) es el (x + i % BLOCK_WIDTH, y + i / BLOCK_WIDTH)
+const int BLOCK_WIDTH = 8;
+const int BLOCK_HEIGHT = 2;
+const int BLOCK_SIZE = BLOCK_WIDTH * BLOCK_HEIGHT;
+
+struct FragmentBlock {
+    int x, y;
+    // Coordenadas baricéntricas y profundidad de los 16 pixels, también los
+    // de fuera del triángulo (así el shader puede calcular derivadas entre
+    // pixels vecinos)
+    alignas(64) float bar[3][BLOCK_SIZE];
+    alignas(64) float z[BLOCK_SIZE];
+    // Color de cada pixel, lo escribe el shader (con relleno al final para
+    // poder leer las filas con registros de 32 bytes)
+    RGBColor colors[BLOCK_SIZE + 4];
+};
+
+// Los vértices se procesan una sola vez cada uno (ver TileRenderer):
+// vertex escribe los varyings de un vértice en un array plano, y antes de
+// dibujar cada triángulo set_varyings recibe los de sus 3 vértices
 struct IShader {
-    virtual Vec3f vertex(int iface, int nthvert) = 0;
+    // fragment / fragment_block pueden descartar pixels. Los shaders que
+    // nunca descartan lo redefinen a false para poder usar el modo DEFERRED
+    // de TileRenderer (que decide qué triángulo se ve antes de sombrear)
+    static const bool CAN_DISCARD = true;
+
+    virtual ~IShader() {}
+    // Número de floats de varyings por vértice
+    virtual int varying_count() const = 0;
+    // Transforma el vértice ivert del modelo, devuelve su posición en
+    // pantalla en coordenadas homogéneas (sin dividir entre w)
+    virtual Vec4f vertex(int ivert, float* varyings) = 0;
+    virtual void set_varyings(const float* const varyings[3]) = 0;
     virtual bool fragment(Vec3f bar, RGBColor& color) = 0;
+    // Calcula block.colors para los pixels de mask, devuelve la máscara de
+    // los descartados. Por defecto llama a fragment para cada pixel
+    virtual uint32_t fragment_block(FragmentBlock& block, uint32_t mask);
+};
+
+// Base de los shaders que se dibujan con su propio tipo (ver triangle y
+// TileRenderer::draw): su fragment_block por defecto llama a
+// Derived::fragment sin pasar por la tabla virtual, así se puede expandir
+// en el bucle del bloque. Los shaders pueden redefinir fragment_block para
+// calcular todo el bloque a la vez
+template <typename Derived>
+struct ShaderBase : public IShader {
+    uint32_t fragment_block(FragmentBlock& block, uint32_t mask) override {
+        Derived& shader = static_cast<Derived&>(*this);
+        uint32_t discarded = 0;
+        for (int i = 0; i < BLOCK_SIZE; i++) {
+            if (mask >> i & 1) {
+                Vec3f bar(block.bar[0][i], block.bar[1][i], block.bar[2][i]);
+                if (shader.Derived::fragment(bar, block.colors[i])) {
+                    discarded |= 1u << i;
+                }
+            }
+        }
+        return discarded;
+    }
+};
+
+// Rectángulo de pixels [x0, x1) x [y0, y1)
+struct Rect {
+    int x0, y0, x1, y1;
+};
+
+// Buffer de profundidad (mayor z: más cerca). Cada fila ocupa stride pixels
+// (múltiplo de 16, filas alineadas a 64 bytes) y el número de filas se
+// redondea a BLOCK_HEIGHT, así los bloques siempre se pueden leer y escribir
+// enteros
+// Guarda además una pirámide de mínimos: de cada bloque de BLOCK_WIDTH x
+// BLOCK_HEIGHT pixels y cada celda de CELL_SIZE x CELL_SIZE (se actualizan al
+// escribir un bloque) y de cada grupo de GROUP_SIZE x GROUP_SIZE (se
+// recalcula al consultarlo si ha cambiado), para que triangle() descarte
+// triángulos y celdas que quedan detrás de lo ya dibujado sin leer sus
+// pixels
+// fill no escribe los pixels: marca los grupos y cada uno se rellena al
+// dibujar en él por primera vez (ver prepare)
+class ZBuffer {
+   public:
+    // Formato de cada pixel: float, o entero de 16 bits que cubre [0,
+    // depthRange] (la mitad de memoria que leer y escribir)
+    enum Format { FLOAT32, UNORM16 };
+    static const int CELL_SIZE = 8;
+    static const int GROUP_SIZE = 64;
+
+    int width;
+    int height;
+    int stride;
+    Format format;
+    float depthRange;
+    // Usar los mínimos de celdas y grupos para descartar (por defecto sí)
+    bool hierarchical;
+
+    ZBuffer(int width, int height, Format format = FLOAT32,
+            float depthRange = 255.0f);
+    ~ZBuffer();
+    void fill(float value);
+    // Fila y: float con FLOAT32, uint16_t con UNORM16 (solo dentro de los
+    // rectángulos preparados con prepare)
+    template <typename T>
+    inline T* row(int y) {
+        return reinterpret_cast<T*>(pixels) + (size_t)y * stride;
+    }
+    // Profundidad guardada en (x, y), en las unidades de z
+    float depth(int x, int y);
+
+    // Profundidad z en las unidades del buffer (el valor de z con FLOAT32,
+    // el entero con UNORM16), las de los mínimos
+    inline float key(float z) const {
+        return format == FLOAT32 ? z : quantize(z);
+    }
+    inline float quantize_scale() const { return scale; }
+    inline uint16_t quantize(float z) const {
+        // (NaN a 0)
+        return (int)std::min(std::max(0.0f, z * scale + 0.5f), 65535.0f);
+    }
+
+    // Rellena los grupos de rect que tienen pendiente el fill. Hay que
+    // llamarlo antes de leer o escribir pixels en rect
+    void prepare(const Rect& rect);
+    // Mínimo de la celda (cx, cy)
+    float cell_min(int cx, int cy);
+    // Mínimo de las celdas que tocan rect (con el de los grupos enteros
+    // dentro de rect)
+    float region_min(const Rect& rect);
+    // Actualiza los mínimos después de escribir en el bloque (x, y)
+    void written(int x, int y);
+
+   private:
+    const static int BUFFER_ALIGNMENT = 64;
+    int rows;
+    float scale;      // 65535 / depthRange
+    uint8_t* buffer;  // reserva real, pixels apunta a su inicio alineado
+    uint8_t* pixels;
+    float clearValue;
+    // Bloques por fila (uno por celda) y filas de bloques, celdas y grupos
+    int cellsX, blockRows, cellsY, groupsX, groupsY;
+    std::vector<float> blockMin, cellMin, groupMin;
+    // groupDirty: alguno de sus bloques ha cambiado desde que se calculó su
+    // mínimo, groupCleared: el grupo tiene pendiente el fill
+    std::vector<uint8_t> groupDirty, groupCleared;
+
+    void clear_group(int group);
+
+    ZBuffer(const ZBuffer&) = delete;
+    ZBuffer& operator=(const ZBuffer&) = delete;
+};
+
+// Coordenadas máximas (en pixels) que acepta triangle(), para que los
+// productos en punto fijo quepan en 64 bits
+const float GUARD_BAND = 1 << 20;
+
+// Triángulo con los vértices redondeados a la rejilla de subpixels con la
+// que triangle() decide qué pixels cubre
+struct SnappedTriangle {
+    int64_t x[3], y[3];
+    // Doble del área con signo (0: degenerado, > 0: vértices en sentido
+    // antihorario con el eje y hacia arriba)
+    int64_t area;
+    // Pixels cuyo centro cae dentro de la bounding box (sin recortar)
+    Rect pixels;
+
+    // false si algún vértice está fuera de la guard band (o es NaN)
+    bool snap(const Vec3f* pts);
+};
+
+// Coordenadas baricéntricas de p dentro del triángulo t0-t1-t2
+// Obtener u, v tq u*ab + v*ac + pa = 0, con pa = t0 - p
+// Resolver (u v 1)'*(abx acx pax) = 0 y (u v 1)'*(aby acy pay) = 0: producto
+// vectorial de ambos, escalado para z = 1. La parte que no depende de p
+// (ab, ac y la z del producto) se calcula una vez por triángulo
+struct Barycentric {
+    Vec3f t0, ab, ac;
+    float crossZ, invCrossZ;
+
+    Barycentric() : crossZ(0.0f), invCrossZ(0.0f) {}
+    Barycentric(const Vec3f* t)
+        : t0(t[0]), ab(t[1] - t[0]), ac(t[2] - t[0]) {
+        crossZ = ab.x * ac.y - ac.x * ab.y;
+        invCrossZ = 1.0f / crossZ;
+    }
+    inline Vec3f at(float x, float y) const {
+        float pax = t0.x - x, pay = t0.y - y;
+        float crossX = ac.x * pay - pax * ac.y;
+        float crossY = pax * ab.y - ab.x * pay;
+        // se suma una pequeña constante para evitar errores de precisión
+        return Vec3f(1.0f + 1e-4f - (crossX + crossY) * invCrossZ,
+                     crossX * invCrossZ, crossY * invCrossZ);
+    }
+};
+
+struct RasterImplementation;
+
+// Trabajo de triangle()
+struct RasterCounters {
+    // Pixels dentro de los triángulos, los descartados con los mínimos del
+    // z-buffer sin leerlos y los que pasan el test de profundidad
+    uint64_t fragments;
+    uint64_t occluded;
+    uint64_t shaded;
+    // Triángulos descartados enteros con los mínimos del z-buffer
+    uint64_t occludedTriangles;
+    // Pixels que se pasan al shader (con triangle, los que pasan el test de
+    // profundidad; con triangle_visible, solo los visibles)
+    uint64_t invocations;
+
+    void add(const RasterCounters& other) {
+        fragments += other.fragments;
+        occluded += other.occluded;
+        shaded += other.shaded;
+        occludedTriangles += other.occludedTriangles;
+        invocations += other.invocations;
+    }
+};
+
+// Recorrido de los bloques de un triángulo (ver triangle): cobertura,
+// coordenadas baricéntricas, profundidad y test de profundidad
+class BlockRasterizer {
+   public:
+    RasterCounters counters;
+
+    BlockRasterizer() : counters() {}
+    // false si el triángulo no tiene ningún pixel dentro de clip o queda
+    // detrás de lo que ya tiene zbuffer
+    // Con ids (buffer de visibilidad de clip, ver triangle_visibility) no
+    // hay test de profundidad: next devuelve los pixels en los que ids
+    // tiene id
+    bool setup(const Vec3f* pts, const Rect& clip, ZBuffer& zbuffer,
+               const uint32_t* ids = nullptr, int idStride = 0,
+               uint32_t id = 0);
+    // Siguiente bloque con algún pixel que pasa el test de profundidad:
+    // rellena block (salvo los colores) y devuelve la máscara de esos
+    // pixels, o 0 si no quedan bloques
+    uint32_t next(FragmentBlock& block, ZBuffer& zbuffer);
+    // Escribe profundidad y color de los pixels de mask (image nullptr: solo
+    // profundidad)
+    void write(const FragmentBlock& block, uint32_t mask, ZBuffer& zbuffer,
+               PNGImage* image);
+    void write_colors(const FragmentBlock& block, uint32_t mask,
+                      PNGImage& image);
+
+   private:
+    const RasterImplementation* impl;
+    Barycentric barycentric;
+    Vec3f depths;
+    int xmin, ymin, xmax, ymax;
+    // Funciones de arista en punto fijo
+    int64_t rowValue[3], stepX[3], stepY[3], bias[3];
+    // Fila de bloques actual: pixels de cada fila dentro del triángulo,
+    // siguiente bloque y último pixel de la fila de bloques
+    int by, bx;
+    int64_t spanX0[BLOCK_HEIGHT], spanX1[BLOCK_HEIGHT];
+    int64_t blockX1;
+    // Plano de la profundidad, z(x, y) = depthC + depthA * x + depthB * y,
+    // y cota del error de redondeo al calcularla por pixel
+    double depthA, depthB, depthC, depthError;
+    // Celdas de la fila de celdas occludedRow (desde la de xmin) en las que
+    // el triángulo queda detrás de lo dibujado
+    int occludedRow;
+    uint64_t occludedCells;
+    uint16_t keys[BLOCK_SIZE];  // profundidad del bloque con UNORM16
+    // Buffer de visibilidad (ver setup)
+    const uint32_t* visibleIds;
+    int idStride, idX0, idY0;
+    uint32_t visibleId;
+
+    void next_row();
+    // Profundidad máxima del triángulo en los pixels de r, en las unidades
+    // de zbuffer
+    float max_key(const Rect& r, const ZBuffer& zbuffer) const;
+    void update_occluded_cells(ZBuffer& zbuffer);
 };
 
-void triangle(Vec3f* pts, IShader& shader, PNGImage& image, float* zbuffer);
\ No newline at end of file
+// fragment_block del shader: si se conoce su tipo, sin pasar por la tabla
+// virtual (IShader: compatibilidad, llamada virtual)
+template <typename Shader>
+inline uint32_t shade_block(Shader& shader, FragmentBlock& block,
+                            uint32_t mask) {
+    return shader.Shader::fragment_block(block, mask);
+}
+inline uint32_t shade_block(IShader& shader, FragmentBlock& block,
+                            uint32_t mask) {
+    return shader.fragment_block(block, mask);
+}
+
+void triangle(Vec3f* pts, IShader& shader, PNGImage& image, ZBuffer& zbuffer);
+// Solo dibuja los pixels dentro de clip. Si x0 e y0 son múltiplos de
+// ZBuffer::GROUP_SIZE nunca se lee ni escribe nada del z-buffer fuera de
+// clip, así se pueden dibujar rectángulos distintos a la vez desde varios
+// hilos
+void triangle(Vec3f* pts, IShader& shader, PNGImage& image, ZBuffer& zbuffer,
+              const Rect& clip);
+
+// Versiones para un tipo de shader concreto (se eligen al llamar con él en
+// lugar de con IShader&): el bucle de los bloques se compila para ese
+// shader y su fragment_block se puede expandir en él
+// counters (si no es nullptr) acumula los pixels procesados
+template <typename Shader>
+void triangle(Vec3f* pts, Shader& shader, PNGImage& image, ZBuffer& zbuffer,
+              const Rect& clip, RasterCounters* counters = nullptr) {
+    BlockRasterizer raster;
+    if (raster.setup(pts, clip, zbuffer)) {
+        FragmentBlock block;
+        while (uint32_t mask = raster.next(block, zbuffer)) {
+            // Calcular el color de la textura y multiplicarlo por la
+            // intensidad (luz), y escribir los pixels no descartados
+            raster.counters.invocations += __builtin_popcount(mask);
+            mask &= ~shade_block(shader, block, mask);
+            if (mask) raster.write(block, mask, zbuffer, &image);
+        }
+    }
+    if (counters != nullptr) counters->add(raster.counters);
+}
+
+template <typename Shader>
+void triangle(Vec3f* pts, Shader& shader, PNGImage& image, ZBuffer& zbuffer) {
+    triangle(pts, shader, image, zbuffer,
+             Rect{0, 0, image.width, image.height});
+}
+
+// Sombreado diferido: primero se dibuja solo la profundidad de todos los
+// triángulos, apuntando en un buffer de visibilidad cuál queda en cada
+// pixel, y después se vuelve a recorrer cada triángulo sombreando solo sus
+// pixels visibles
+// Solo sirve para shaders con CAN_DISCARD == false: la visibilidad no
+// sabe qué fragmentos descartará el shader. TileRenderer::raster (en
+// renderer.cpp) dibuja los que pueden descartar en modo inmediato
+const uint32_t NO_TRIANGLE = ~0u;
+
+// Como triangle(), pero solo escribe la profundidad y, en los pixels que
+// pasan el test, id en ids (el pixel (x, y) de clip en
+// ids[(y - clip.y0) * idStride + x - clip.x0])
+void triangle_visibility(Vec3f* pts, uint32_t id, ZBuffer& zbuffer,
+                         const Rect& clip, uint32_t* ids, int idStride,
+                         RasterCounters* counters = nullptr);
+
+// Segunda pasada: sombrea los pixels de clip en los que ids tiene id (los
+// visibles del triángulo), con las mismas coordenadas baricéntricas que
+// triangle(). No escribe la profundidad (ya la tiene zbuffer)
+template <typename Shader>
+void triangle_visible(Vec3f* pts, Shader& shader, PNGImage& image,
+                      ZBuffer& zbuffer, const Rect& clip, const uint32_t* ids,
+                      int idStride, uint32_t id,
+                      RasterCounters* counters = nullptr) {
+    BlockRasterizer raster;
+    if (raster.setup(pts, clip, zbuffer, ids, idStride, id)) {
+        FragmentBlock block;
+        while (uint32_t mask = raster.next(block, zbuffer)) {
+            raster.counters.invocations += __builtin_popcount(mask);
+            mask &= ~shade_block(shader, block, mask);
+            if (mask) raster.write_colors(block, mask, image);
+        }
+    }
+    if (counters != nullptr) {
+        counters->invocations += raster.counters.invocations;
+    }
+}
+
+// Implementaciones de las operaciones por bloque de triangle() que puede
+// usar esta CPU (scalar, sse2, avx2, avx512), de más lenta a más rápida
+// Por defecto se usa la última, use_raster_implementation permite elegir
+// otra (devuelve false si no existe)
+std::vector<const char*> raster_implementations();
+bool use_raster_implementation(const char* name);
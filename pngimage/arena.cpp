@@ -0,0 +1,54 @@
+#include "arena.h"
+
+Arena::Arena(size_t blockSize)
+    : blockSize(blockSize),
+      blocks(nullptr),
+      offset(0),
+      usedBytes(0),
+      capacityBytes(0) {}
+
+Arena::~Arena() { free_blocks(); }
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    if (blocks != nullptr) {
+        uintptr_t start = (uintptr_t)(blocks + 1);
+        uintptr_t p = (start + offset + alignment - 1) & ~(alignment - 1);
+        if (p + size <= start + blocks->size) {
+            offset = p + size - start;
+            usedBytes += size;
+            return (void*)p;
+        }
+    }
+    // No cabe: bloque nuevo con sitio para size bytes aunque haya que
+    // alinearlos
+    add_block(size + alignment > blockSize ? size + alignment : blockSize);
+    return allocate(size, alignment);
+}
+
+void Arena::reset() {
+    if (blocks != nullptr && blocks->next != nullptr) {
+        size_t total = capacityBytes;
+        free_blocks();
+        add_block(total);
+    }
+    offset = 0;
+    usedBytes = 0;
+}
+
+void Arena::add_block(size_t size) {
+    Block* block = (Block*)new uint8_t[sizeof(Block) + size];
+    block->next = blocks;
+    block->size = size;
+    blocks = block;
+    offset = 0;
+    capacityBytes += size;
+}
+
+void Arena::free_blocks() {
+    while (blocks != nullptr) {
+        Block* next = blocks->next;
+        delete[] (uint8_t*)blocks;
+        blocks = next;
+    }
+    capacityBytes = 0;
+}
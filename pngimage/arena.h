@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+
+// Memoria para datos temporales que se liberan todos a la vez (los de un
+// dibujo, un chunk o una lectura): allocate toma bytes seguidos de un
+// bloque y reset los devuelve todos en O(1)
+// No se llama a ningún destructor: para tipos con destructor hay que
+// llamarlo a mano antes de reset
+// Si un bloque no basta se reserva otro, y en el siguiente reset se juntan
+// en uno solo con la capacidad total: tras la primera vez que se usa con
+// unos tamaños, no se vuelve a reservar memoria
+// No es thread-safe: reservar antes de repartir el trabajo entre hilos
+class Arena {
+   public:
+    static const size_t DEFAULT_BLOCK_SIZE = 64 << 10;
+
+    explicit Arena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+    ~Arena();
+
+    // size bytes sin inicializar, con la dirección múltiplo de alignment
+    // (potencia de 2)
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    // count elementos de T sin construir
+    template <typename T>
+    T* allocate(size_t count) {
+        return (T*)allocate(count * sizeof(T), alignof(T));
+    }
+    // Libera todo lo reservado desde el último reset
+    void reset();
+
+    // Bytes entregados desde el último reset y bytes reservados en total
+    size_t used() const { return usedBytes; }
+    size_t capacity() const { return capacityBytes; }
+
+   private:
+    // Cabecera de cada bloque, seguida de size bytes de datos
+    struct Block {
+        Block* next;  // bloque anterior (el primero es el más reciente)
+        size_t size;
+    };
+
+    size_t blockSize;
+    Block* blocks;
+    size_t offset;  // bytes ocupados del primer bloque
+    size_t usedBytes, capacityBytes;
+
+    void add_block(size_t size);
+    void free_blocks();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+};
@@ -0,0 +1,386 @@
+#include <algorithm>
+
+#include "checksum.h"
+
+// Las versiones SIMD se compilan con atributos target de GCC/Clang, así el
+// resto del programa no depende de las extensiones de la CPU
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHECKSUM_X86
+#include <immintrin.h>
+#endif
+
+static const uint32_t CRC32_DIVISOR = 0xEDB88320;  // polinomio invertido
+static const uint32_t ADLER_MODULO = 65521;
+// Máximo de bytes que se pueden sumar sin que b desborde 32 bits antes de
+// aplicar el módulo (ver NMAX en zlib)
+static const size_t ADLER_NMAX = 5552;
+
+// Tablas para slicing-by-8: table[0] es la tabla de siempre (un byte),
+// table[k][i] es el CRC de i seguido de k bytes a cero
+struct CrcTables {
+    uint32_t table[8][256];
+
+    CrcTables() {
+        for (int i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int bit = 0; bit < 8; bit++) {
+                c = c & 1 ? (c >> 1) ^ CRC32_DIVISOR : c >> 1;
+            }
+            table[0][i] = c;
+        }
+        for (int k = 1; k < 8; k++) {
+            for (int i = 0; i < 256; i++) {
+                uint32_t c = table[k - 1][i];
+                table[k][i] = (c >> 8) ^ table[0][c & 0xFF];
+            }
+        }
+    }
+};
+
+static const CrcTables& crc_tables() {
+    static const CrcTables tables;  // inicialización segura entre hilos
+    return tables;
+}
+
+static inline uint32_t load_le32(const uint8_t* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Cálculo del CRC de 32 bits, byte a byte
+// Para más info, visitar:
+// - https://archive.org/stream/PainlessCRC/crc_v3.txt
+//   (en especial capitulos del 9 al 11)
+// - https://www.w3.org/TR/PNG-CRCAppendix.html
+//   (ejemplo de código en C)
+static uint32_t crc32_table(uint32_t crc, const uint8_t* data, size_t length) {
+    const uint32_t* table = crc_tables().table[0];
+    uint32_t rem = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        rem = (rem >> 8) ^ table[(rem ^ data[i]) & 0xFF];
+    }
+    return ~rem;
+}
+
+// Slicing-by-8: 8 bytes por iteración con 8 búsquedas independientes
+// Ref: Kounavis y Berry, "A Systematic Approach to Building High
+// Performance Software-based CRC Generators" (Intel, 2005)
+static uint32_t crc32_slice8(uint32_t crc, const uint8_t* data,
+                             size_t length) {
+    const CrcTables& t = crc_tables();
+    uint32_t rem = ~crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint32_t one = load_le32(data) ^ rem;
+        uint32_t two = load_le32(data + 4);
+        rem = t.table[7][one & 0xFF] ^ t.table[6][(one >> 8) & 0xFF] ^
+              t.table[5][(one >> 16) & 0xFF] ^ t.table[4][one >> 24] ^
+              t.table[3][two & 0xFF] ^ t.table[2][(two >> 8) & 0xFF] ^
+              t.table[1][(two >> 16) & 0xFF] ^ t.table[0][two >> 24];
+    }
+    for (; length > 0; length--) {
+        rem = (rem >> 8) ^ t.table[0][(rem ^ *data++) & 0xFF];
+    }
+    return ~rem;
+}
+
+// Adler-32 con el módulo aplazado cada ADLER_NMAX bytes
+// https://en.wikipedia.org/wiki/Adler-32
+static uint32_t adler32_scalar(uint32_t adler, const uint8_t* data,
+                               size_t length) {
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    while (length > 0) {
+        size_t n = std::min(length, ADLER_NMAX);
+        length -= n;
+        for (; n >= 4; n -= 4, data += 4) {
+            a += data[0];
+            b += a;
+            a += data[1];
+            b += a;
+            a += data[2];
+            b += a;
+            a += data[3];
+            b += a;
+        }
+        for (; n > 0; n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= ADLER_MODULO;
+        b %= ADLER_MODULO;
+    }
+    return b << 16 | a;
+}
+
+#ifdef CHECKSUM_X86
+
+// Plegado del CRC con multiplicación sin acarreo (PCLMULQDQ), 64 bytes por
+// iteración en 4 registros. Necesita length >= 64 y múltiplo de 16, y
+// recibe y devuelve el resto sin invertir
+// Ref: Gopal et al., "Fast CRC Computation for Generic Polynomials Using
+// PCLMULQDQ Instruction" (Intel, 2009), constantes para el polinomio
+// invertido 0xEDB88320 (como en Chromium/zlib)
+__attribute__((target("pclmul,sse2"))) static uint32_t crc32_fold_pclmul(
+    const uint8_t* data, size_t length, uint32_t rem) {
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x1 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+    __m128i x2 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+    __m128i x3 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+    __m128i x4 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(rem));
+    data += 64;
+    length -= 64;
+
+    // Plegar 4 bloques de 16 bytes en paralelo
+    for (; length >= 64; data += 64, length -= 64) {
+        __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                           _mm_loadu_si128((const __m128i*)(data + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                           _mm_loadu_si128((const __m128i*)(data + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                           _mm_loadu_si128((const __m128i*)(data + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                           _mm_loadu_si128((const __m128i*)(data + 0x30)));
+    }
+
+    // Juntar los 4 registros en uno
+    __m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // Bloques de 16 bytes restantes
+    for (; length >= 16; data += 16, length -= 16) {
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                           _mm_loadu_si128((const __m128i*)data));
+    }
+
+    // De 128 a 64 bits
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Reducción de Barrett a 32 bits
+    x2 = _mm_and_si128(x1, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t* data,
+                             size_t length) {
+    if (length >= 64) {
+        size_t folded = length & ~(size_t)15;
+        crc = ~crc32_fold_pclmul(data, folded, ~crc);
+        data += folded;
+        length -= folded;
+    }
+    return crc32_slice8(crc, data, length);
+}
+
+// Suma horizontal de 4 enteros de 32 bits
+__attribute__((target("sse2"))) static inline uint32_t hsum_epi32(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+// Adler-32 en bloques de 32 bytes: a suma los bytes (_mm_sad_epu8) y b
+// los bytes por su peso dentro del bloque (32..1, _mm_maddubs_epi16) más
+// 32 veces el a acumulado antes de cada bloque
+// Ref: adler32_simd.c de Chromium
+__attribute__((target("ssse3"))) static uint32_t adler32_ssse3(
+    uint32_t adler, const uint8_t* data, size_t length) {
+    const size_t BLOCK = 32;
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    size_t blocks = length / BLOCK;
+    length -= blocks * BLOCK;
+    const __m128i taps1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24,
+                                        23, 22, 21, 20, 19, 18, 17);
+    const __m128i taps2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7,
+                                        6, 5, 4, 3, 2, 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    while (blocks > 0) {
+        size_t n = std::min(blocks, ADLER_NMAX / BLOCK);
+        blocks -= n;
+        b += a * BLOCK * n;
+        __m128i prevA = zero;  // a acumulado al inicio de cada bloque
+        __m128i vA = zero;
+        __m128i vB = zero;
+        for (size_t i = 0; i < n; i++, data += BLOCK) {
+            __m128i bytes1 = _mm_loadu_si128((const __m128i*)data);
+            __m128i bytes2 = _mm_loadu_si128((const __m128i*)(data + 16));
+            prevA = _mm_add_epi32(prevA, vA);
+            vA = _mm_add_epi32(vA, _mm_sad_epu8(bytes1, zero));
+            vA = _mm_add_epi32(vA, _mm_sad_epu8(bytes2, zero));
+            vB = _mm_add_epi32(
+                vB, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, taps1), ones));
+            vB = _mm_add_epi32(
+                vB, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, taps2), ones));
+        }
+        vB = _mm_add_epi32(vB, _mm_slli_epi32(prevA, 5));
+        a = (a + hsum_epi32(vA)) % ADLER_MODULO;
+        b = (b + hsum_epi32(vB)) % ADLER_MODULO;
+    }
+    return adler32_scalar(b << 16 | a, data, length);
+}
+
+// Igual que adler32_ssse3, con bloques de 64 bytes en dos registros AVX2
+__attribute__((target("avx2"))) static uint32_t adler32_avx2(
+    uint32_t adler, const uint8_t* data, size_t length) {
+    const size_t BLOCK = 64;
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    size_t blocks = length / BLOCK;
+    length -= blocks * BLOCK;
+    const __m256i taps1 = _mm256_setr_epi8(
+        64, 63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49, 48,
+        47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33);
+    const __m256i taps2 = _mm256_setr_epi8(
+        32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16,
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    while (blocks > 0) {
+        size_t n = std::min(blocks, ADLER_NMAX / BLOCK);
+        blocks -= n;
+        b += a * BLOCK * n;
+        __m256i prevA = zero;
+        __m256i vA = zero;
+        __m256i vB = zero;
+        for (size_t i = 0; i < n; i++, data += BLOCK) {
+            __m256i bytes1 = _mm256_loadu_si256((const __m256i*)data);
+            __m256i bytes2 = _mm256_loadu_si256((const __m256i*)(data + 32));
+            prevA = _mm256_add_epi32(prevA, vA);
+            vA = _mm256_add_epi32(vA, _mm256_sad_epu8(bytes1, zero));
+            vA = _mm256_add_epi32(vA, _mm256_sad_epu8(bytes2, zero));
+            vB = _mm256_add_epi32(vB, _mm256_madd_epi16(
+                                          _mm256_maddubs_epi16(bytes1, taps1),
+                                          ones));
+            vB = _mm256_add_epi32(vB, _mm256_madd_epi16(
+                                          _mm256_maddubs_epi16(bytes2, taps2),
+                                          ones));
+        }
+        vB = _mm256_add_epi32(vB, _mm256_slli_epi32(prevA, 6));
+        __m128i sumA = _mm_add_epi32(_mm256_castsi256_si128(vA),
+                                     _mm256_extracti128_si256(vA, 1));
+        __m128i sumB = _mm_add_epi32(_mm256_castsi256_si128(vB),
+                                     _mm256_extracti128_si256(vB, 1));
+        a = (a + hsum_epi32(sumA)) % ADLER_MODULO;
+        b = (b + hsum_epi32(sumB)) % ADLER_MODULO;
+    }
+    return adler32_scalar(b << 16 | a, data, length);
+}
+
+#endif  // CHECKSUM_X86
+
+std::vector<Checksum::Implementation> Checksum::crc32_implementations() {
+    std::vector<Implementation> list;
+    list.push_back({"table", crc32_table});
+    list.push_back({"slice8", crc32_slice8});
+#ifdef CHECKSUM_X86
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse2")) {
+        list.push_back({"pclmul", crc32_pclmul});
+    }
+#endif
+    return list;
+}
+
+std::vector<Checksum::Implementation> Checksum::adler32_implementations() {
+    std::vector<Implementation> list;
+    list.push_back({"scalar", adler32_scalar});
+#ifdef CHECKSUM_X86
+    if (__builtin_cpu_supports("ssse3")) {
+        list.push_back({"ssse3", adler32_ssse3});
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        list.push_back({"avx2", adler32_avx2});
+    }
+#endif
+    return list;
+}
+
+uint32_t Checksum::crc32(uint32_t crc, const uint8_t* data, size_t length) {
+    static const Function best = crc32_implementations().back().update;
+    return best(crc, data, length);
+}
+
+uint32_t Checksum::adler32(uint32_t adler, const uint8_t* data,
+                           size_t length) {
+    static const Function best = adler32_implementations().back().update;
+    return best(adler, data, length);
+}
+
+// Producto de dos polinomios módulo el de CRC-32 (con los bits invertidos,
+// como en el resto del cálculo: el bit 31 es x^0)
+static uint32_t multiply_mod(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+    for (uint32_t m = 1u << 31; m != 0; m >>= 1) {
+        if (a & m) product ^= b;
+        b = b & 1 ? (b >> 1) ^ CRC32_DIVISOR : b >> 1;
+    }
+    return product;
+}
+
+// El CRC de A seguido de B es el de A desplazado length2 bytes (multiplicado
+// por x^(8 * length2)) más el de B. Las potencias x^(2^k) se calculan una
+// vez, así el desplazamiento cuesta O(log length2)
+// Ref: crc32_combine en zlib
+uint32_t Checksum::crc32_combine(uint32_t crc1, uint32_t crc2,
+                                 size_t length2) {
+    struct Powers {
+        uint32_t x2k[64];  // x^(2^k)
+        Powers() {
+            x2k[0] = 1u << 30;  // x^1
+            for (int k = 1; k < 64; k++) {
+                x2k[k] = multiply_mod(x2k[k - 1], x2k[k - 1]);
+            }
+        }
+    };
+    static const Powers powers;  // inicialización segura entre hilos
+    uint32_t shift = 1u << 31;   // x^0
+    // Los bits de length2 empezando en x^8 (un byte)
+    for (int k = 3; length2 != 0; length2 >>= 1, k++) {
+        if (length2 & 1) shift = multiply_mod(powers.x2k[k], shift);
+    }
+    return multiply_mod(shift, crc1) ^ crc2;
+}
+
+// a es 1 + la suma de los bytes y b la suma de los valores de a tras cada
+// byte: al añadir length2 bytes, b1 cuenta length2 veces más a a1 - 1
+// Ref: adler32_combine en zlib
+uint32_t Checksum::adler32_combine(uint32_t adler1, uint32_t adler2,
+                                   size_t length2) {
+    uint64_t rem = length2 % ADLER_MODULO;
+    uint64_t a1 = adler1 & 0xFFFF, b1 = adler1 >> 16;
+    uint64_t a2 = adler2 & 0xFFFF, b2 = adler2 >> 16;
+    uint64_t a = (a1 + a2 + ADLER_MODULO - 1) % ADLER_MODULO;
+    uint64_t b = (b1 + b2 + rem * a1 + ADLER_MODULO - rem) % ADLER_MODULO;
+    return (uint32_t)(b << 16 | a);
+}
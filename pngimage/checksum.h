@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+// Sumas de comprobación usadas en los archivos PNG:
+//   CRC-32 (polinomio 0xEDB88320) al final de cada chunk
+//   Adler-32 al final de los datos zlib de los chunks IDAT
+// Cada una tiene varias implementaciones, la primera vez que se usa se
+// elige la más rápida que soporte la CPU:
+//   CRC-32:   tabla byte a byte, slicing-by-8, PCLMUL (x86)
+//   Adler-32: escalar con módulo diferido, SSSE3, AVX2 (x86)
+class Checksum {
+   public:
+    typedef uint32_t (*Function)(uint32_t, const uint8_t*, size_t);
+    struct Implementation {
+        const char* name;
+        Function update;
+    };
+
+    // Continúa la suma crc (0 al empezar) con length bytes de data
+    static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t length);
+    // Continúa la suma adler (1 al empezar) con length bytes de data
+    static uint32_t adler32(uint32_t adler, const uint8_t* data,
+                            size_t length);
+    // Suma de dos trozos seguidos a partir de la de cada uno (crc2 y
+    // adler2 empezando desde 0 y 1), sin volver a leer los datos
+    // length2: bytes del segundo trozo
+    static uint32_t crc32_combine(uint32_t crc1, uint32_t crc2,
+                                  size_t length2);
+    static uint32_t adler32_combine(uint32_t adler1, uint32_t adler2,
+                                    size_t length2);
+
+    // Implementaciones que puede usar esta CPU, de más lenta a más rápida
+    // (la última es la que usan crc32 y adler32)
+    static std::vector<Implementation> crc32_implementations();
+    static std::vector<Implementation> adler32_implementations();
+};
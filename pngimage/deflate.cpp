@@ -0,0 +1,617 @@
+#include <algorithm>
+#include <cstring>
+
+#include "deflate.h"
+
+static const int NUM_LITLEN_SYMS = 286;  // 0..285 (286 y 287 no se usan)
+// El código fijo sí incluye 286 y 287: sin ellos los códigos de 9 bits
+// (literales 144..255) saldrían desplazados
+static const int NUM_FIXED_LITLEN_SYMS = 288;
+static const int NUM_DIST_SYMS = 30;
+static const int NUM_CODELEN_SYMS = 19;
+static const int MAX_CODE_LENGTH = 15;
+static const int MAX_CODELEN_LENGTH = 7;
+static const int END_OF_BLOCK = 256;
+static const uint16_t MAX_STORED = 65535;  // 16b para length
+// Repeticiones de longitud 3 con distancias mayores no compensan
+static const int TOO_FAR = 4096;
+
+// Longitud base y bits extra de los símbolos 257..285
+static const uint16_t LENGTH_BASE[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                         1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                         4, 4, 4, 4, 5, 5, 5, 5, 0};
+// Distancia base y bits extra de los símbolos 0..29
+static const uint16_t DIST_BASE[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+static const uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                       4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                       9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// Orden en el que se escriben las longitudes del código de longitudes
+static const uint8_t CODELEN_ORDER[NUM_CODELEN_SYMS] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// Parámetros de búsqueda de cada nivel (los mismos que zlib, ver
+// configuration_table en deflate.c), niveles 0 y 1 no usan cadenas hash:
+//   goodLength: si ya hay una repetición así de larga, buscar menos
+//   maxLazy: no buscar en la siguiente posición si ya hay una así de larga
+//            (sin evaluación perezosa: longitud máxima para insertar todas
+//            las posiciones de la repetición en las cadenas hash)
+//   niceLength: dejar de buscar al encontrar una así de larga
+//   maxChain: posiciones a probar en la cadena hash
+struct LevelConfig {
+    int goodLength, maxLazy, niceLength, maxChain;
+    bool lazy;
+};
+static const LevelConfig LEVELS[Deflater::MAX_LEVEL + 1] = {
+    {0, 0, 0, 0, false},       {0, 0, 0, 0, false},
+    {4, 5, 16, 8, false},      {4, 6, 32, 32, false},
+    {4, 4, 16, 16, true},      {8, 16, 32, 32, true},
+    {8, 16, 128, 128, true},   {8, 32, 128, 256, true},
+    {32, 128, 258, 1024, true}, {32, 258, 258, 4096, true}};
+
+// Símbolo (0..28) de una longitud de repetición
+static inline int length_symbol(int length) {
+    int sym = std::upper_bound(LENGTH_BASE, LENGTH_BASE + 29, length) -
+              LENGTH_BASE - 1;
+    return sym;
+}
+
+// Símbolo (0..29) de una distancia
+static inline int dist_symbol(int dist) {
+    return std::upper_bound(DIST_BASE, DIST_BASE + 30, dist) - DIST_BASE - 1;
+}
+
+// Tablas precalculadas para longitudes 3..258 y distancias 1..512
+// (las distancias mayores se calculan con (dist - 1) >> 7)
+static uint8_t LENGTH_SYMBOL[259];
+static uint8_t DIST_SYMBOL[512];
+static uint8_t DIST_SYMBOL_HIGH[256];
+
+static void fill_symbol_tables() {
+    for (int len = 3; len <= 258; len++) LENGTH_SYMBOL[len] = length_symbol(len);
+    for (int d = 1; d <= 512; d++) DIST_SYMBOL[d - 1] = dist_symbol(d);
+    for (int i = 0; i < 256; i++) DIST_SYMBOL_HIGH[i] = dist_symbol((i << 7) + 1);
+}
+
+// Una sola vez aunque se comprima desde varios hilos a la vez (la
+// inicialización de un static local es segura entre hilos)
+static void init_symbol_tables() {
+    static const bool initialized = (fill_symbol_tables(), true);
+    (void)initialized;
+}
+
+static inline int fast_dist_symbol(int dist) {
+    return dist <= 512 ? DIST_SYMBOL[dist - 1]
+                       : DIST_SYMBOL_HIGH[(dist - 1) >> 7];
+}
+
+// Escritura de bits de menor a mayor peso, con un buffer de 64 bits
+struct Deflater::BitWriter {
+    uint8_t* out;
+    size_t pos;
+    uint64_t bitbuf;
+    int bitcount;
+
+    BitWriter(uint8_t* _out) : out(_out), pos(0), bitbuf(0), bitcount(0) {}
+
+    // n <= 32 bits
+    inline void put(uint32_t bits, int n) {
+        bitbuf |= (uint64_t)bits << bitcount;
+        bitcount += n;
+        if (bitcount >= 32) {
+            out[pos++] = bitbuf & 0xFF;
+            out[pos++] = bitbuf >> 8 & 0xFF;
+            out[pos++] = bitbuf >> 16 & 0xFF;
+            out[pos++] = bitbuf >> 24 & 0xFF;
+            bitbuf >>= 32;
+            bitcount -= 32;
+        }
+    }
+    // Completa el último byte con ceros
+    inline void align_to_byte() {
+        while (bitcount > 0) {
+            out[pos++] = bitbuf & 0xFF;
+            bitbuf >>= 8;
+            bitcount = bitcount > 8 ? bitcount - 8 : 0;
+        }
+        bitbuf = 0;
+    }
+};
+
+// Longitudes de un código Huffman de como mucho maxBits bits para las
+// frecuencias freq (símbolos sin frecuencia tienen longitud 0)
+// Se construye el árbol de Huffman con dos colas (hojas ordenadas por
+// frecuencia y nodos internos, que se crean ya ordenados) y, si alguna
+// longitud se pasa de maxBits, se reparten de nuevo manteniendo la
+// desigualdad de Kraft
+// n <= NUM_LITLEN_SYMS: todo cabe en la pila, sin reservar memoria en cada
+// bloque
+static void build_lengths(const uint32_t* freq, int n, int maxBits,
+                          uint8_t* lens) {
+    memset(lens, 0, n);
+    std::pair<uint32_t, int> sorted[NUM_LITLEN_SYMS];
+    int m = 0;
+    for (int s = 0; s < n; s++) {
+        if (freq[s] > 0) sorted[m++] = std::make_pair(freq[s], s);
+    }
+    if (m == 0) return;
+    if (m == 1) {
+        lens[sorted[0].second] = 1;
+        return;
+    }
+    std::sort(sorted, sorted + m);
+
+    uint64_t weight[2 * NUM_LITLEN_SYMS - 1];
+    int parent[2 * NUM_LITLEN_SYMS - 1];
+    for (int i = 0; i < m; i++) weight[i] = sorted[i].first;
+    int leaf = 0, node = m;
+    for (int next = m; next < 2 * m - 1; next++) {
+        int pick[2];
+        for (int k = 0; k < 2; k++) {
+            if (leaf < m && (node >= next || weight[leaf] <= weight[node])) {
+                pick[k] = leaf++;
+            } else {
+                pick[k] = node++;
+            }
+        }
+        weight[next] = weight[pick[0]] + weight[pick[1]];
+        parent[pick[0]] = parent[pick[1]] = next;
+    }
+    // Profundidad de cada nodo (la raíz es el último)
+    int depth[2 * NUM_LITLEN_SYMS - 1];
+    depth[2 * m - 2] = 0;
+    for (int i = 2 * m - 3; i >= 0; i--) depth[i] = depth[parent[i]] + 1;
+
+    // Número de códigos de cada longitud, limitado a maxBits
+    int count[32] = {0};
+    for (int i = 0; i < m; i++) count[std::min(depth[i], maxBits)]++;
+    uint32_t total = 0;
+    for (int len = 1; len <= maxBits; len++) {
+        total += (uint32_t)count[len] << (maxBits - len);
+    }
+    while (total > (1u << maxBits)) {
+        // Alargar un código más corto para hacer sitio
+        count[maxBits]--;
+        for (int len = maxBits - 1; len > 0; len--) {
+            if (count[len] > 0) {
+                count[len]--;
+                count[len + 1] += 2;
+                break;
+            }
+        }
+        total--;
+    }
+    // Los símbolos menos frecuentes reciben los códigos más largos
+    int idx = 0;
+    for (int len = maxBits; len > 0; len--) {
+        for (int k = 0; k < count[len]; k++) {
+            lens[sorted[idx++].second] = len;
+        }
+    }
+}
+
+// Algunos descompresores (zlib) no aceptan códigos incompletos: si solo se
+// usa un símbolo (o ninguno), se añade otro de longitud 1
+static void ensure_two_codes(uint8_t* lens, int n) {
+    int used = 0;
+    for (int s = 0; s < n; s++) used += lens[s] > 0;
+    for (int s = 0; s < n && used < 2; s++) {
+        if (lens[s] == 0) {
+            lens[s] = 1;
+            used++;
+        }
+    }
+}
+
+// Códigos Huffman canónicos a partir de sus longitudes, con los bits
+// invertidos (se escriben empezando por el de menor peso)
+static void build_codes(const uint8_t* lens, int n, uint16_t* codes) {
+    int count[MAX_CODE_LENGTH + 1] = {0};
+    for (int s = 0; s < n; s++) count[lens[s]]++;
+    count[0] = 0;
+    uint32_t nextCode[MAX_CODE_LENGTH + 1];
+    uint32_t code = 0;
+    for (int len = 1; len <= MAX_CODE_LENGTH; len++) {
+        code = (code + count[len - 1]) << 1;
+        nextCode[len] = code;
+    }
+    for (int s = 0; s < n; s++) {
+        int len = lens[s];
+        uint32_t c = len > 0 ? nextCode[len]++ : 0;
+        uint32_t rev = 0;
+        for (int i = 0; i < len; i++) {
+            rev = (rev << 1) | (c & 1);
+            c >>= 1;
+        }
+        codes[s] = rev;
+    }
+}
+
+Deflater::Deflater(int _level)
+    : level(_level < MIN_LEVEL ? MIN_LEVEL
+                               : (_level > MAX_LEVEL ? MAX_LEVEL : _level)),
+      goodLength(LEVELS[level].goodLength),
+      maxLazy(LEVELS[level].maxLazy),
+      niceLength(LEVELS[level].niceLength),
+      maxChain(LEVELS[level].maxChain),
+      lazy(LEVELS[level].lazy) {
+    init_symbol_tables();
+    tokens.reserve(BLOCK_TOKENS + 1);
+    if (level > 1) {
+        head.resize(1 << HASH_BITS);
+        prev.resize(WINDOW_SIZE);
+    }
+}
+
+size_t Deflater::bound(size_t length) {
+    // Peor caso: todo en bloques sin comprimir (5 bytes de cabecera cada
+    // uno, más el byte a medias del bloque anterior). Cada bloque de
+    // write_block cubre al menos BLOCK_TOKENS bytes (salvo el último), y
+    // sobra para el bloque vacío de deflate(in, start, end, out, false)
+    return length + 6 * (length / BLOCK_TOKENS + 2) + 8;
+}
+
+// Nivel 1: solo repeticiones del byte anterior (distancia 1)
+void Deflater::find_matches_rle(const uint8_t* in, size_t start,
+                                size_t end) {
+    size_t p = start;
+    while (p < end) {
+        if (p > 0) {
+            uint8_t value = in[p - 1];
+            size_t maxLen = std::min<size_t>(MAX_MATCH, end - p);
+            size_t len = 0;
+            while (len < maxLen && in[p + len] == value) len++;
+            if (len >= MIN_MATCH) {
+                tokens.push_back((uint32_t)len << 16 | 1);
+                p += len;
+                continue;
+            }
+        }
+        tokens.push_back(in[p++]);
+    }
+}
+
+// Hash de los 3 bytes que empiezan en p
+static inline uint32_t hash3(const uint8_t* p, int bits) {
+    uint32_t v = p[0] | p[1] << 8 | p[2] << 16;
+    return (v * 2654435761u) >> (32 - bits);
+}
+
+void Deflater::insert_dictionary(const uint8_t* in, size_t start,
+                                 size_t end) {
+    for (size_t p = start; p < end; p++) {
+        uint32_t h = hash3(&in[p], HASH_BITS);
+        prev[p & (WINDOW_SIZE - 1)] = head[h];
+        head[h] = p + 1;
+    }
+}
+
+// Niveles 2-9: LZ77 con cadenas hash de 3 bytes
+// Añade símbolos desde pos hasta llenar un bloque, devuelve la nueva pos
+size_t Deflater::find_matches_lz77(const uint8_t* in, size_t length,
+                                   size_t start) {
+    const uint32_t WMASK = WINDOW_SIZE - 1;
+    uint32_t* headp = head.data();
+    uint32_t* prevp = prev.data();
+    auto hash = [&](size_t p) -> uint32_t {
+        return hash3(&in[p], HASH_BITS);
+    };
+    auto insert = [&](size_t p) {
+        if (p + MIN_MATCH > length) return;
+        uint32_t h = hash(p);
+        prevp[p & WMASK] = headp[h];
+        headp[h] = p + 1;
+    };
+    // Repetición más larga que empieza en p y supera a minLength
+    auto longest_match = [&](size_t p, int minLength, int& bestLen,
+                             int& bestDist) {
+        bestLen = 0;
+        bestDist = 0;
+        int maxLen = std::min<size_t>(MAX_MATCH, length - p);
+        if (maxLen < MIN_MATCH) return;
+        int best = std::max(minLength, MIN_MATCH - 1);
+        int chain = maxChain;
+        // Si ya hay una buena repetición, buscar menos
+        if (minLength >= goodLength) chain >>= 2;
+        uint32_t cand = headp[hash(p)];
+        const uint8_t* cur = &in[p];
+        while (cand != 0 && chain-- > 0) {
+            size_t c = cand - 1;
+            size_t dist = p - c;
+            if (dist > (size_t)WINDOW_SIZE) break;
+            const uint8_t* m = &in[c];
+            if (best < maxLen && m[best] == cur[best] && m[0] == cur[0]) {
+                int len = 0;
+                // Comparar de 8 en 8 bytes mientras sea posible
+                while (len + 8 <= maxLen) {
+                    uint64_t a, b;
+                    memcpy(&a, m + len, 8);
+                    memcpy(&b, cur + len, 8);
+                    uint64_t diff = a ^ b;
+                    if (diff != 0) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                        len += __builtin_clzll(diff) >> 3;
+#else
+                        len += __builtin_ctzll(diff) >> 3;
+#endif
+                        goto compared;
+                    }
+                    len += 8;
+                }
+                while (len < maxLen && m[len] == cur[len]) len++;
+            compared:
+                if (len > best && !(len == MIN_MATCH && dist > TOO_FAR)) {
+                    best = len;
+                    bestLen = len;
+                    bestDist = dist;
+                    if (len >= niceLength || len >= maxLen) break;
+                }
+            }
+            uint32_t next = prevp[c & WMASK];
+            if (next > cand) break;  // posición ya sobrescrita
+            cand = next;
+        }
+    };
+
+    size_t p = start;
+    int prevLen = 0, prevDist = 0;
+    bool pending = false;  // hay un símbolo en p - 1 sin emitir (lazy)
+    while (p < length && tokens.size() < (size_t)BLOCK_TOKENS) {
+        int len = 0, dist = 0;
+        if (!lazy || prevLen < maxLazy) {
+            longest_match(p, lazy ? prevLen : 0, len, dist);
+        }
+        insert(p);
+        if (!lazy) {
+            if (len >= MIN_MATCH) {
+                tokens.push_back((uint32_t)len << 16 | dist);
+                // Repeticiones largas: solo se inserta la primera posición
+                if (len <= maxLazy) {
+                    for (size_t q = p + 1; q < p + len; q++) insert(q);
+                }
+                p += len;
+            } else {
+                tokens.push_back(in[p++]);
+            }
+            continue;
+        }
+        // Evaluación perezosa: la repetición en p - 1 se emite solo si la
+        // de p no es mejor
+        if (pending && prevLen >= MIN_MATCH && len <= prevLen) {
+            tokens.push_back((uint32_t)prevLen << 16 | prevDist);
+            size_t end = p - 1 + prevLen;
+            for (size_t q = p + 1; q < end; q++) insert(q);
+            p = end;
+            prevLen = 0;
+            pending = false;
+            continue;
+        }
+        if (pending) tokens.push_back(in[p - 1]);
+        pending = true;
+        prevLen = len;
+        prevDist = dist;
+        p++;
+    }
+    if (pending) {
+        if (prevLen >= MIN_MATCH) {
+            tokens.push_back((uint32_t)prevLen << 16 | prevDist);
+            size_t end = p - 1 + prevLen;
+            for (size_t q = p; q < end; q++) insert(q);
+            p = end;
+        } else {
+            tokens.push_back(in[p - 1]);
+        }
+    }
+    return p;
+}
+
+// Bloques sin comprimir de como mucho MAX_STORED bytes
+void Deflater::write_stored(BitWriter& bw, const uint8_t* in, size_t start,
+                            size_t end, bool last) {
+    size_t pos = start;
+    do {
+        uint16_t chunk = std::min<size_t>(MAX_STORED, end - pos);
+        bool lastChunk = pos + chunk == end;
+        bw.put(last && lastChunk ? 1 : 0, 3);  // BTYPE = 00
+        bw.align_to_byte();
+        bw.put(chunk | (uint32_t)(uint16_t)~chunk << 16, 32);
+        memcpy(&bw.out[bw.pos], &in[pos], chunk);
+        bw.pos += chunk;
+        pos += chunk;
+    } while (pos < end);
+}
+
+// Emite los símbolos del bloque [start, end) con el tipo de bloque que
+// ocupe menos bits
+void Deflater::write_block(BitWriter& bw, const uint8_t* in, size_t start,
+                           size_t end, bool last) {
+    uint32_t litFreq[NUM_LITLEN_SYMS] = {0};
+    uint32_t distFreq[NUM_DIST_SYMS] = {0};
+    uint64_t extraBits = 0;
+    for (uint32_t t : tokens) {
+        if (t >> 16 == 0) {
+            litFreq[t]++;
+        } else {
+            int lsym = LENGTH_SYMBOL[t >> 16];
+            int dsym = fast_dist_symbol(t & 0xFFFF);
+            litFreq[257 + lsym]++;
+            distFreq[dsym]++;
+            extraBits += LENGTH_EXTRA[lsym] + DIST_EXTRA[dsym];
+        }
+    }
+    litFreq[END_OF_BLOCK] = 1;
+
+    // Códigos dinámicos
+    uint8_t litLens[NUM_LITLEN_SYMS], distLens[NUM_DIST_SYMS];
+    build_lengths(litFreq, NUM_LITLEN_SYMS, MAX_CODE_LENGTH, litLens);
+    build_lengths(distFreq, NUM_DIST_SYMS, MAX_CODE_LENGTH, distLens);
+    ensure_two_codes(distLens, NUM_DIST_SYMS);
+    int hlit = NUM_LITLEN_SYMS, hdist = NUM_DIST_SYMS;
+    while (hlit > 257 && litLens[hlit - 1] == 0) hlit--;
+    while (hdist > 1 && distLens[hdist - 1] == 0) hdist--;
+
+    // Longitudes de ambos códigos comprimidas con RLE (símbolos 16, 17, 18)
+    uint8_t allLens[NUM_LITLEN_SYMS + NUM_DIST_SYMS];
+    memcpy(allLens, litLens, hlit);
+    memcpy(&allLens[hlit], distLens, hdist);
+    int total = hlit + hdist;
+    uint8_t rleSyms[NUM_LITLEN_SYMS + NUM_DIST_SYMS];
+    uint8_t rleExtra[NUM_LITLEN_SYMS + NUM_DIST_SYMS];
+    int nrle = 0;
+    for (int i = 0; i < total;) {
+        uint8_t value = allLens[i];
+        int run = 1;
+        while (i + run < total && allLens[i + run] == value) run++;
+        i += run;
+        if (value == 0) {
+            while (run >= 11) {
+                int r = std::min(run, 138);
+                rleSyms[nrle] = 18, rleExtra[nrle++] = r - 11;
+                run -= r;
+            }
+            if (run >= 3) {
+                rleSyms[nrle] = 17, rleExtra[nrle++] = run - 3;
+                run = 0;
+            }
+        } else {
+            rleSyms[nrle] = value, rleExtra[nrle++] = 0;
+            run--;
+            while (run >= 3) {
+                int r = std::min(run, 6);
+                rleSyms[nrle] = 16, rleExtra[nrle++] = r - 3;
+                run -= r;
+            }
+        }
+        while (run-- > 0) rleSyms[nrle] = value, rleExtra[nrle++] = 0;
+    }
+    uint32_t codelenFreq[NUM_CODELEN_SYMS] = {0};
+    for (int i = 0; i < nrle; i++) codelenFreq[rleSyms[i]]++;
+    uint8_t codelenLens[NUM_CODELEN_SYMS];
+    build_lengths(codelenFreq, NUM_CODELEN_SYMS, MAX_CODELEN_LENGTH,
+                  codelenLens);
+    ensure_two_codes(codelenLens, NUM_CODELEN_SYMS);
+    int hclen = NUM_CODELEN_SYMS;
+    while (hclen > 4 && codelenLens[CODELEN_ORDER[hclen - 1]] == 0) hclen--;
+
+    // Tamaño (en bits) de cada tipo de bloque
+    static const uint8_t RLE_EXTRA_BITS[3] = {2, 3, 7};
+    uint64_t dynamicBits = 3 + 5 + 5 + 4 + 3 * hclen + extraBits;
+    for (int s = 0; s < NUM_CODELEN_SYMS; s++) {
+        dynamicBits += (uint64_t)codelenFreq[s] *
+                       (codelenLens[s] + (s >= 16 ? RLE_EXTRA_BITS[s - 16] : 0));
+    }
+    uint8_t fixedLit[NUM_FIXED_LITLEN_SYMS], fixedDist[NUM_DIST_SYMS];
+    memset(&fixedLit[0], 8, 144);
+    memset(&fixedLit[144], 9, 112);
+    memset(&fixedLit[256], 7, 24);
+    memset(&fixedLit[280], 8, NUM_FIXED_LITLEN_SYMS - 280);
+    memset(fixedDist, 5, NUM_DIST_SYMS);
+    uint64_t fixedBits = 3 + extraBits;
+    for (int s = 0; s < NUM_LITLEN_SYMS; s++) {
+        dynamicBits += (uint64_t)litFreq[s] * litLens[s];
+        fixedBits += (uint64_t)litFreq[s] * fixedLit[s];
+    }
+    for (int s = 0; s < NUM_DIST_SYMS; s++) {
+        dynamicBits += (uint64_t)distFreq[s] * distLens[s];
+        fixedBits += (uint64_t)distFreq[s] * fixedDist[s];
+    }
+    size_t length = end - start;
+    uint64_t storedBits =
+        (length + 5 * (length / MAX_STORED + 1)) * 8 + 7;
+
+    if (storedBits <= dynamicBits && storedBits <= fixedBits) {
+        write_stored(bw, in, start, end, last);
+        return;
+    }
+
+    const uint8_t* useLit = litLens;
+    const uint8_t* useDist = distLens;
+    int numLit = NUM_LITLEN_SYMS;
+    if (fixedBits <= dynamicBits) {
+        bw.put((last ? 1 : 0) | 1 << 1, 3);  // BTYPE = 01
+        useLit = fixedLit;
+        numLit = NUM_FIXED_LITLEN_SYMS;
+        useDist = fixedDist;
+    } else {
+        bw.put((last ? 1 : 0) | 2 << 1, 3);  // BTYPE = 10
+        bw.put(hlit - 257, 5);
+        bw.put(hdist - 1, 5);
+        bw.put(hclen - 4, 4);
+        for (int i = 0; i < hclen; i++) bw.put(codelenLens[CODELEN_ORDER[i]], 3);
+        uint16_t codelenCodes[NUM_CODELEN_SYMS];
+        build_codes(codelenLens, NUM_CODELEN_SYMS, codelenCodes);
+        for (int i = 0; i < nrle; i++) {
+            uint8_t s = rleSyms[i];
+            bw.put(codelenCodes[s], codelenLens[s]);
+            if (s >= 16) bw.put(rleExtra[i], RLE_EXTRA_BITS[s - 16]);
+        }
+    }
+    uint16_t litCodes[NUM_FIXED_LITLEN_SYMS], distCodes[NUM_DIST_SYMS];
+    build_codes(useLit, numLit, litCodes);
+    build_codes(useDist, NUM_DIST_SYMS, distCodes);
+    for (uint32_t t : tokens) {
+        if (t >> 16 == 0) {
+            bw.put(litCodes[t], useLit[t]);
+        } else {
+            int len = t >> 16, dist = t & 0xFFFF;
+            int lsym = LENGTH_SYMBOL[len];
+            int dsym = fast_dist_symbol(dist);
+            bw.put(litCodes[257 + lsym], useLit[257 + lsym]);
+            bw.put(len - LENGTH_BASE[lsym], LENGTH_EXTRA[lsym]);
+            bw.put(distCodes[dsym], useDist[dsym]);
+            bw.put(dist - DIST_BASE[dsym], DIST_EXTRA[dsym]);
+        }
+    }
+    bw.put(litCodes[END_OF_BLOCK], useLit[END_OF_BLOCK]);
+}
+
+size_t Deflater::deflate(const uint8_t* in, size_t length, uint8_t* out) {
+    return deflate(in, 0, length, out, true);
+}
+
+size_t Deflater::deflate(const uint8_t* in, size_t start, size_t end,
+                         uint8_t* out, bool last) {
+    BitWriter bw(out);
+    if (level > 1) {
+        // Solo hace falta vaciar head: las cadenas empiezan en head y cada
+        // posición a la que llegan ha escrito antes su prev en esta llamada
+        std::fill(head.begin(), head.end(), 0);
+        // Diccionario: las posiciones anteriores dentro de la ventana (su
+        // hash lee hasta in[start + 1])
+        if (end - start >= MIN_MATCH) {
+            size_t window = std::min<size_t>(start, WINDOW_SIZE);
+            insert_dictionary(in, start - window, start);
+        }
+    }
+    if (level == 0) {
+        // Los bloques sin comprimir ya terminan en un byte completo
+        write_stored(bw, in, start, end, last);
+        bw.align_to_byte();
+        return bw.pos;
+    }
+    size_t pos = start;
+    do {
+        size_t blockStart = pos;
+        tokens.clear();
+        if (level == 1) {
+            pos = std::min<size_t>(end, blockStart + BLOCK_TOKENS);
+            find_matches_rle(in, blockStart, pos);
+        } else {
+            pos = find_matches_lz77(in, end, blockStart);
+        }
+        write_block(bw, in, blockStart, pos, last && pos == end);
+    } while (pos < end);
+    if (!last) {
+        // Bloque sin comprimir vacío: BTYPE = 00, LEN = 0, NLEN = 0xFFFF
+        bw.put(0, 3);
+        bw.align_to_byte();
+        bw.put(0xFFFFu << 16, 32);
+    }
+    bw.align_to_byte();
+    return bw.pos;
+}
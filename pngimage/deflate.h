@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+// Compresor DEFLATE (RFC 1951), usado al escribir los chunks IDAT
+// https://www.ietf.org/rfc/rfc1951.txt
+// Niveles de compresión (como en zlib):
+//   0:    sin compresión (bloques BTYPE = 00)
+//   1:    solo RLE (repeticiones a distancia 1), muy rápido
+//   2-9:  LZ77 con cadenas hash cada vez más largas (9: máxima compresión)
+// Cada bloque se emite con Huffman dinámico, fijo o sin comprimir,
+// el que ocupe menos
+class Deflater {
+   public:
+    static const int MIN_LEVEL = 0;
+    static const int MAX_LEVEL = 9;
+    static const int DEFAULT_LEVEL = 6;
+
+    // Reserva aquí las tablas: se puede reutilizar el mismo Deflater para
+    // muchas llamadas a deflate sin reservar memoria
+    Deflater(int level = DEFAULT_LEVEL);
+
+    // Tamaño máximo de la salida para length bytes de entrada
+    static size_t bound(size_t length);
+    // Comprime in en out (de tamaño al menos bound(length))
+    // Devuelve los bytes escritos en out
+    size_t deflate(const uint8_t* in, size_t length, uint8_t* out);
+    // Comprime solo in[start, end) (out de al menos bound(end - start)),
+    // con los 32K anteriores a start como diccionario: las repeticiones
+    // pueden apuntar a ellos. Si no es el último trozo, termina con un
+    // bloque vacío sin comprimir (sync flush en zlib) para acabar en un
+    // byte completo: los trozos comprimidos por separado (p.ej. en varios
+    // hilos) se concatenan y forman un único stream DEFLATE
+    size_t deflate(const uint8_t* in, size_t start, size_t end, uint8_t* out,
+                   bool last);
+
+   private:
+    static const int WINDOW_BITS = 15;  // ventana de 32K
+    static const int WINDOW_SIZE = 1 << WINDOW_BITS;
+    static const int HASH_BITS = 15;
+    static const int MIN_MATCH = 3;
+    static const int MAX_MATCH = 258;
+    static const int BLOCK_TOKENS = 1 << 15;  // símbolos por bloque
+
+    int level;
+    int goodLength;   // longitud a partir de la cual se busca menos
+    int maxLazy;      // longitud a partir de la cual no se busca más
+    int niceLength;   // longitud suficiente para dejar de buscar
+    int maxChain;     // posiciones a probar en la cadena hash
+    bool lazy;        // probar la siguiente posición antes de emitir
+
+    // Símbolos LZ77 del bloque en curso:
+    //   literal: byte, repetición: (longitud << 16) | distancia
+    std::vector<uint32_t> tokens;
+    std::vector<uint32_t> head;  // última posición (+1) de cada hash
+    std::vector<uint32_t> prev;  // posición anterior con el mismo hash
+
+    struct BitWriter;
+    void find_matches_rle(const uint8_t* in, size_t start, size_t end);
+    // Añade a las cadenas hash las posiciones de in[start, end)
+    void insert_dictionary(const uint8_t* in, size_t start, size_t end);
+    size_t find_matches_lz77(const uint8_t* in, size_t length, size_t start);
+    void write_stored(BitWriter& bw, const uint8_t* in, size_t start,
+                      size_t end, bool last);
+    void write_block(BitWriter& bw, const uint8_t* in, size_t start,
+                     size_t end, bool last);
+};
@@ -0,0 +1,521 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "inflate.h"
+
+// Formato de una entrada de las tablas de decodificación (32 bits):
+//   bits 0-4:   bits de la entrada que ocupa el código (a consumir)
+//   bits 5-7:   tipo de entrada (ver ENTRY_*)
+//   bits 8-15:  literal | bits extra (longitud/distancia) | bits subtabla
+//   bits 16-31: 2o literal | valor base (longitud/distancia) | inicio subtabla
+enum {
+    ENTRY_LITERAL = 0,   // un literal (o símbolo de longitudes de código)
+    ENTRY_LITERAL2 = 1,  // dos literales seguidos
+    ENTRY_LENGTH = 2,    // longitud (o distancia) base + bits extra
+    ENTRY_END = 3,       // fin de bloque (256)
+    ENTRY_SUBTABLE = 4,  // el código es más largo que la tabla
+    ENTRY_INVALID = 5
+};
+
+static inline uint32_t entry_bits(uint32_t e) { return e & 0x1F; }
+static inline uint32_t entry_kind(uint32_t e) { return (e >> 5) & 0x07; }
+static inline uint32_t entry_low(uint32_t e) { return (e >> 8) & 0xFF; }
+static inline uint32_t entry_high(uint32_t e) { return e >> 16; }
+static inline uint32_t make_entry(uint32_t kind, uint32_t low, uint32_t high) {
+    return kind << 5 | low << 8 | high << 16;
+}
+
+static const int MAX_CODE_LENGTH = 15;
+static const int MAX_TABLE_BITS = 11;  // tabla principal más grande
+static const int NUM_LITLEN_SYMS = 288;
+static const int NUM_DIST_SYMS = 32;
+static const int NUM_CODELEN_SYMS = 19;
+
+// Símbolos 257..285: longitud base y bits extra
+static const uint16_t LENGTH_BASE[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                         1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                         4, 4, 4, 4, 5, 5, 5, 5, 0};
+// Símbolos de distancia 0..29: distancia base y bits extra
+static const uint16_t DIST_BASE[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+static const uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                       4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                       9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// Orden en el que se leen las longitudes del código de longitudes
+static const uint8_t CODELEN_ORDER[NUM_CODELEN_SYMS] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// Plantillas de entrada (sin el número de bits) de cada símbolo
+static uint32_t LITLEN_SYMS[NUM_LITLEN_SYMS];
+static uint32_t DIST_SYMS[NUM_DIST_SYMS];
+static uint32_t CODELEN_SYMS[NUM_CODELEN_SYMS];
+
+static void fill_symbol_entries() {
+    for (int s = 0; s < NUM_LITLEN_SYMS; s++) {
+        if (s < 256) {
+            LITLEN_SYMS[s] = make_entry(ENTRY_LITERAL, s, 0);
+        } else if (s == 256) {
+            LITLEN_SYMS[s] = make_entry(ENTRY_END, 0, 0);
+        } else if (s < 286) {
+            LITLEN_SYMS[s] = make_entry(ENTRY_LENGTH, LENGTH_EXTRA[s - 257],
+                                        LENGTH_BASE[s - 257]);
+        } else {
+            LITLEN_SYMS[s] = make_entry(ENTRY_INVALID, 0, 0);
+        }
+    }
+    for (int s = 0; s < NUM_DIST_SYMS; s++) {
+        DIST_SYMS[s] = s < 30 ? make_entry(ENTRY_LENGTH, DIST_EXTRA[s],
+                                           DIST_BASE[s])
+                              : make_entry(ENTRY_INVALID, 0, 0);
+    }
+    for (int s = 0; s < NUM_CODELEN_SYMS; s++) {
+        CODELEN_SYMS[s] = make_entry(ENTRY_LITERAL, s, 0);
+    }
+}
+
+// Una sola vez aunque se lea desde varios hilos a la vez (la inicialización
+// de un static local es segura entre hilos)
+static void init_symbol_entries() {
+    static const bool initialized = (fill_symbol_entries(), true);
+    (void)initialized;
+}
+
+// Invierte los primeros n bits de code (DEFLATE guarda los códigos Huffman
+// empezando por el bit más significativo, pero se leen de menor a mayor peso)
+static inline uint32_t reverse_bits(uint32_t code, int n) {
+    uint32_t rev = 0;
+    for (int i = 0; i < n; i++) {
+        rev = (rev << 1) | (code & 1);
+        code >>= 1;
+    }
+    return rev;
+}
+
+// Construye la tabla de decodificación de un código Huffman canónico
+// a partir de las longitudes de código de cada símbolo
+// Ref: RFC 1951, punto 3.2.2
+static bool build_table(const uint8_t* lens, int nsyms,
+                        const uint32_t* symEntries, int tableBits,
+                        std::vector<uint32_t>& table) {
+    int count[MAX_CODE_LENGTH + 1] = {0};
+    for (int s = 0; s < nsyms; s++) count[lens[s]]++;
+    count[0] = 0;
+
+    const uint32_t invalid = make_entry(ENTRY_INVALID, 0, 0);
+    const int tableSize = 1 << tableBits;
+    // Comprobar que el código no tiene demasiados símbolos de una longitud
+    // Un código incompleto solo se permite si tiene un único símbolo de
+    // longitud 1 (p.ej. un solo código de distancia)
+    int left = 1, maxLength = 0;
+    for (int len = 1; len <= MAX_CODE_LENGTH; len++) {
+        left = (left << 1) - count[len];
+        if (left < 0) return false;
+        if (count[len] > 0) maxLength = len;
+    }
+    if (left > 0 && maxLength > 1) return false;
+
+    // Primer código de cada longitud
+    uint32_t nextCode[MAX_CODE_LENGTH + 1];
+    uint32_t code = 0;
+    for (int len = 1; len <= MAX_CODE_LENGTH; len++) {
+        code = (code + count[len - 1]) << 1;
+        nextCode[len] = code;
+    }
+
+    // Códigos más largos que la tabla: se agrupan por sus primeros
+    // tableBits bits, cada grupo tiene una subtabla tan grande como su
+    // código más largo
+    uint8_t prefixMax[1 << MAX_TABLE_BITS];
+    table.assign(tableSize, invalid);
+    if (maxLength > tableBits) {
+        memset(prefixMax, 0, tableSize);
+        uint32_t next[MAX_CODE_LENGTH + 1];
+        memcpy(next, nextCode, sizeof(next));
+        for (int s = 0; s < nsyms; s++) {
+            int len = lens[s];
+            if (len <= tableBits) {
+                if (len > 0) next[len]++;
+                continue;
+            }
+            uint32_t prefix = reverse_bits(next[len]++, len) & (tableSize - 1);
+            if (len > prefixMax[prefix]) prefixMax[prefix] = len;
+        }
+        uint32_t offset = tableSize;
+        for (int p = 0; p < tableSize; p++) {
+            if (prefixMax[p] == 0) continue;
+            int subBits = prefixMax[p] - tableBits;
+            table[p] = make_entry(ENTRY_SUBTABLE, subBits, offset) | tableBits;
+            offset += 1 << subBits;
+        }
+        table.resize(offset, invalid);
+    }
+
+    // Rellenar todas las entradas cuyos primeros bits coinciden con el código
+    for (int s = 0; s < nsyms; s++) {
+        int len = lens[s];
+        if (len == 0) continue;
+        uint32_t rev = reverse_bits(nextCode[len]++, len);
+        if (len <= tableBits) {
+            for (uint32_t i = rev; i < (uint32_t)tableSize; i += 1 << len) {
+                table[i] = symEntries[s] | len;
+            }
+        } else {
+            uint32_t sub = table[rev & (tableSize - 1)];
+            uint32_t subSize = 1 << entry_low(sub);
+            int remaining = len - tableBits;
+            for (uint32_t i = rev >> tableBits; i < subSize;
+                 i += 1 << remaining) {
+                table[entry_high(sub) + i] = symEntries[s] | remaining;
+            }
+        }
+    }
+    return true;
+}
+
+// Combina en una sola entrada dos literales consecutivos cuyos códigos
+// caben juntos en la tabla principal
+static void pack_literal_pairs(std::vector<uint32_t>& table, int tableBits) {
+    const int tableSize = 1 << tableBits;
+    uint32_t single[1 << MAX_TABLE_BITS];
+    memcpy(single, table.data(), tableSize * sizeof(uint32_t));
+    for (int i = 0; i < tableSize; i++) {
+        uint32_t first = single[i];
+        if (entry_kind(first) != ENTRY_LITERAL) continue;
+        uint32_t len = entry_bits(first);
+        // Los bits siguientes al primer código (solo se conocen
+        // tableBits - len, la entrada es válida si no necesita más)
+        uint32_t second = single[i >> len];
+        if (entry_kind(second) == ENTRY_LITERAL &&
+            entry_bits(second) <= tableBits - len) {
+            table[i] = make_entry(ENTRY_LITERAL2, entry_low(first),
+                                  entry_low(second)) |
+                       (len + entry_bits(second));
+        }
+    }
+}
+
+// Lectura de bits de menor a mayor peso, con un buffer de 64 bits
+// La entrada puede estar repartida en varios fragmentos (uno por chunk IDAT),
+// se pasa al siguiente al agotar el actual
+// Si se leen bits más allá del final, se rellenan con 0 (y se cuentan en
+// overrun para detectar datos truncados)
+struct Inflater::BitReader {
+    const Segment* segment;  // fragmento actual
+    const Segment* lastSegment;
+    const uint8_t* in;
+    const uint8_t* end;
+    size_t passed;  // bytes de los fragmentos anteriores al actual
+    uint64_t bitbuf;
+    int bitcount;
+    size_t overrun;
+
+    BitReader(const Segment* segments, size_t numSegments)
+        : segment(segments),
+          lastSegment(segments + numSegments - 1),
+          in(segments[0].data),
+          end(segments[0].data + segments[0].length),
+          passed(0),
+          bitbuf(0),
+          bitcount(0),
+          overrun(0) {}
+
+    // Avanza al siguiente fragmento no vacío, false si no quedan
+    inline bool next_segment() {
+        while (segment < lastSegment) {
+            passed += segment->length;
+            segment++;
+            in = segment->data;
+            end = in + segment->length;
+            if (in < end) return true;
+        }
+        return false;
+    }
+    // Deja al menos 56 bits en el buffer
+    inline void refill() {
+        if (end - in >= 8) {
+            uint64_t word;
+            memcpy(&word, in, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            word = __builtin_bswap64(word);
+#endif
+            bitbuf |= word << bitcount;
+            in += (63 - bitcount) >> 3;
+            bitcount |= 56;
+        } else {
+            // Cerca del final del fragmento: byte a byte
+            while (bitcount <= 56) {
+                uint64_t byte = 0;
+                if (in < end || next_segment()) {
+                    byte = *in++;
+                } else {
+                    overrun++;
+                }
+                bitbuf |= byte << bitcount;
+                bitcount += 8;
+            }
+        }
+    }
+    inline uint32_t peek(int n) const {
+        return (uint32_t)(bitbuf & ((1ull << n) - 1));
+    }
+    inline void consume(int n) {
+        bitbuf >>= n;
+        bitcount -= n;
+    }
+    inline uint32_t bits(int n) {
+        uint32_t value = peek(n);
+        consume(n);
+        return value;
+    }
+    // Descarta los bits hasta el siguiente byte
+    inline void align_to_byte() { consume(bitcount & 7); }
+    // Copia length bytes alineados a dst: primero los que quedan en el
+    // buffer y después directamente de la entrada
+    bool read_bytes(uint8_t* dst, size_t length) {
+        size_t buffered = bitcount >> 3;
+        if (buffered < overrun) return false;
+        buffered -= overrun;  // los de overrun no son datos reales
+        for (; length > 0 && buffered > 0; length--, buffered--) {
+            *dst++ = bits(8);
+        }
+        if (length == 0) return true;
+        // Buffer vacío: los bits que quedan por encima de bitcount son
+        // de bytes que aún no se han dado por leídos, se descartan
+        bitbuf = 0;
+        bitcount = 0;
+        overrun = 0;
+        while (length > 0) {
+            if (in == end && !next_segment()) return false;
+            size_t n = std::min(length, (size_t)(end - in));
+            memcpy(dst, in, n);
+            in += n;
+            dst += n;
+            length -= n;
+        }
+        return true;
+    }
+    // Bytes de la entrada usados hasta ahora (sin contar los completos
+    // que quedan en el buffer)
+    inline size_t position() const {
+        size_t buffered = bitcount >> 3;
+        return passed + (in - segment->data) - (buffered - overrun);
+    }
+};
+
+Inflater::Inflater() { init_symbol_entries(); }
+
+// Códigos Huffman fijos (BTYPE = 01)
+// Ref: RFC 1951, punto 3.2.6
+bool Inflater::build_fixed_tables() {
+    uint8_t lens[NUM_LITLEN_SYMS];
+    memset(&lens[0], 8, 144);
+    memset(&lens[144], 9, 112);
+    memset(&lens[256], 7, 24);
+    memset(&lens[280], 8, 8);
+    if (!build_table(lens, NUM_LITLEN_SYMS, LITLEN_SYMS, LITLEN_BITS,
+                     litlenTable)) {
+        return false;
+    }
+    pack_literal_pairs(litlenTable, LITLEN_BITS);
+    memset(lens, 5, NUM_DIST_SYMS);
+    return build_table(lens, NUM_DIST_SYMS, DIST_SYMS, DIST_BITS, distTable);
+}
+
+// Códigos Huffman dinámicos (BTYPE = 10), descritos al inicio del bloque
+// Ref: RFC 1951, punto 3.2.7
+bool Inflater::read_dynamic_tables(BitReader& br) {
+    br.refill();
+    int hlit = br.bits(5) + 257;
+    int hdist = br.bits(5) + 1;
+    int hclen = br.bits(4) + 4;
+    if (hlit > 286 || hdist > 30) {
+        std::cerr << "Invalid DEFLATE dynamic block header" << std::endl;
+        return false;
+    }
+    // Longitudes del código usado para comprimir las longitudes
+    uint8_t codelenLens[NUM_CODELEN_SYMS] = {0};
+    for (int i = 0; i < hclen; i++) {
+        if (br.bitcount < 3) br.refill();
+        codelenLens[CODELEN_ORDER[i]] = br.bits(3);
+    }
+    if (!build_table(codelenLens, NUM_CODELEN_SYMS, CODELEN_SYMS, CODELEN_BITS,
+                     codelenTable)) {
+        std::cerr << "Invalid DEFLATE code length codes" << std::endl;
+        return false;
+    }
+
+    // Longitudes de los códigos de literales/longitudes y distancias
+    uint8_t lens[NUM_LITLEN_SYMS + NUM_DIST_SYMS];
+    int total = hlit + hdist;
+    int n = 0;
+    while (n < total) {
+        // 7 bits de código + 7 bits extra como mucho
+        if (br.bitcount < 14) br.refill();
+        uint32_t e = codelenTable[br.peek(CODELEN_BITS)];
+        if (entry_kind(e) == ENTRY_INVALID) return false;
+        br.consume(entry_bits(e));
+        uint32_t sym = entry_low(e);
+        if (sym < 16) {
+            lens[n++] = sym;
+            continue;
+        }
+        int repeat;
+        uint8_t value = 0;
+        if (sym == 16) {  // repetir la longitud anterior 3-6 veces
+            if (n == 0) return false;
+            value = lens[n - 1];
+            repeat = 3 + br.bits(2);
+        } else if (sym == 17) {  // 3-10 ceros
+            repeat = 3 + br.bits(3);
+        } else {  // 11-138 ceros
+            repeat = 11 + br.bits(7);
+        }
+        if (n + repeat > total) return false;
+        memset(&lens[n], value, repeat);
+        n += repeat;
+    }
+    if (lens[256] == 0) {
+        std::cerr << "DEFLATE block has no end-of-block code" << std::endl;
+        return false;
+    }
+
+    if (!build_table(lens, hlit, LITLEN_SYMS, LITLEN_BITS, litlenTable) ||
+        !build_table(&lens[hlit], hdist, DIST_SYMS, DIST_BITS, distTable)) {
+        std::cerr << "Invalid DEFLATE Huffman code" << std::endl;
+        return false;
+    }
+    pack_literal_pairs(litlenTable, LITLEN_BITS);
+    return true;
+}
+
+// Decodifica los símbolos de un bloque comprimido hasta el fin de bloque
+bool Inflater::decode_block(BitReader& br, uint8_t* out, size_t outLength,
+                            size_t& outPos) {
+    const uint32_t* litlen = litlenTable.data();
+    const uint32_t* dist = distTable.data();
+    for (;;) {
+        // 56 bits: suficiente para longitud (15 + 5) y distancia (15 + 13)
+        br.refill();
+        uint32_t e = litlen[br.peek(LITLEN_BITS)];
+        if (entry_kind(e) == ENTRY_SUBTABLE) {
+            br.consume(LITLEN_BITS);
+            e = litlen[entry_high(e) + br.peek(entry_low(e))];
+        }
+        br.consume(entry_bits(e));
+
+        switch (entry_kind(e)) {
+            case ENTRY_LITERAL:
+                if (outPos >= outLength) return false;
+                out[outPos++] = entry_low(e);
+                break;
+            case ENTRY_LITERAL2:
+                if (outPos + 2 > outLength) return false;
+                out[outPos++] = entry_low(e);
+                out[outPos++] = entry_high(e);
+                break;
+            case ENTRY_END:
+                return true;
+            case ENTRY_LENGTH: {
+                uint32_t length = entry_high(e) + br.bits(entry_low(e));
+                uint32_t d = dist[br.peek(DIST_BITS)];
+                if (entry_kind(d) == ENTRY_SUBTABLE) {
+                    br.consume(DIST_BITS);
+                    d = dist[entry_high(d) + br.peek(entry_low(d))];
+                }
+                if (entry_kind(d) != ENTRY_LENGTH) return false;
+                br.consume(entry_bits(d));
+                uint32_t distance = entry_high(d) + br.bits(entry_low(d));
+                if (distance > outPos || length > outLength - outPos) {
+                    return false;
+                }
+                // Copiar length bytes desde distance bytes atrás (pueden
+                // solaparse con los que se están escribiendo)
+                uint8_t* dst = &out[outPos];
+                const uint8_t* src = dst - distance;
+                if (distance >= 8 && outLength - outPos >= length + 8) {
+                    // De 8 en 8 bytes, puede escribir hasta 7 de más
+                    uint8_t* dstEnd = dst + length;
+                    do {
+                        memcpy(dst, src, 8);
+                        dst += 8;
+                        src += 8;
+                    } while (dst < dstEnd);
+                } else if (distance == 1) {
+                    memset(dst, *src, length);
+                } else {
+                    for (uint32_t i = 0; i < length; i++) dst[i] = src[i];
+                }
+                outPos += length;
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+}
+
+bool Inflater::inflate(const uint8_t* in, size_t inLength, uint8_t* out,
+                       size_t outLength, size_t& written, size_t& consumed) {
+    Segment segment = {in, inLength};
+    return inflate(&segment, 1, out, outLength, written, consumed);
+}
+
+bool Inflater::inflate(const Segment* segments, size_t numSegments,
+                       uint8_t* out, size_t outLength, size_t& written,
+                       size_t& consumed) {
+    written = 0;
+    consumed = 0;
+    if (numSegments == 0) return false;
+    BitReader br(segments, numSegments);
+    size_t outPos = 0;
+    bool lastBlock = false;
+    bool ok = true;
+    while (ok && !lastBlock) {
+        // Cabecera del bloque: BFINAL (1 bit) + BTYPE (2 bits)
+        br.refill();
+        lastBlock = br.bits(1);
+        int blockType = br.bits(2);
+        if (blockType == 0) {
+            // Bloque sin comprimir: LEN y NLEN (Ca1) alineados a byte
+            br.align_to_byte();
+            uint8_t header[4];
+            if (!br.read_bytes(header, 4)) {
+                ok = false;
+                break;
+            }
+            uint16_t length = header[0] | header[1] << 8;
+            uint16_t inverted = header[2] | header[3] << 8;
+            if ((uint16_t)~length != inverted ||
+                outLength - outPos < length ||
+                !br.read_bytes(&out[outPos], length)) {
+                std::cerr << "Invalid DEFLATE block length" << std::endl;
+                ok = false;
+                break;
+            }
+            outPos += length;
+        } else if (blockType == 1) {
+            ok = build_fixed_tables() &&
+                 decode_block(br, out, outLength, outPos);
+        } else if (blockType == 2) {
+            ok = read_dynamic_tables(br) &&
+                 decode_block(br, out, outLength, outPos);
+        } else {
+            std::cerr << "Invalid DEFLATE block type" << std::endl;
+            ok = false;
+        }
+    }
+    // Los bytes completos que quedan en el buffer no se han usado
+    if (ok && (size_t)(br.bitcount >> 3) < br.overrun) {
+        std::cerr << "DEFLATE data is truncated" << std::endl;
+        ok = false;
+    }
+    written = outPos;
+    consumed = ok ? br.position() : 0;
+    return ok;
+}
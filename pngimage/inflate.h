@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+// Descompresor DEFLATE (RFC 1951), usado por los chunks IDAT
+// https://www.ietf.org/rfc/rfc1951.txt
+// Soporta los tres tipos de bloque: sin comprimir (BTYPE = 00),
+// Huffman fijo (BTYPE = 01) y Huffman dinámico (BTYPE = 10)
+//
+// La decodificación usa tablas de búsqueda de LITLEN_BITS bits indexadas
+// directamente con los siguientes bits de la entrada (un buffer de 64 bits
+// que se rellena de 8 en 8 bytes). Una entrada de la tabla puede contener
+// hasta dos literales seguidos si sus códigos caben en LITLEN_BITS bits, y
+// los códigos más largos que la tabla se resuelven con una subtabla
+class Inflater {
+   public:
+    // Fragmento contiguo de la entrada (p.ej. los datos de un chunk IDAT)
+    struct Segment {
+        const uint8_t* data;
+        size_t length;
+    };
+
+    Inflater();
+
+    // in/inLength: datos DEFLATE (sin cabecera ni checksum zlib)
+    // out/outLength: buffer destino, se escriben como mucho outLength bytes
+    // written: bytes escritos en out, consumed: bytes leidos de in
+    // Devuelve false si los datos no son válidos o no caben en out
+    bool inflate(const uint8_t* in, size_t inLength, uint8_t* out,
+                 size_t outLength, size_t& written, size_t& consumed);
+    // Igual, con la entrada repartida en numSegments fragmentos seguidos
+    // (sin copiarlos a un único buffer). consumed cuenta desde el inicio
+    // del primer fragmento
+    bool inflate(const Segment* segments, size_t numSegments, uint8_t* out,
+                 size_t outLength, size_t& written, size_t& consumed);
+
+   private:
+    static const int LITLEN_BITS = 11;  // bits de la tabla principal
+    static const int DIST_BITS = 8;
+    static const int CODELEN_BITS = 7;  // códigos de longitudes (dinámico)
+
+    // Tablas reutilizadas entre bloques (tabla principal + subtablas)
+    std::vector<uint32_t> litlenTable;
+    std::vector<uint32_t> distTable;
+    std::vector<uint32_t> codelenTable;
+
+    struct BitReader;
+    bool build_fixed_tables();
+    bool read_dynamic_tables(BitReader& br);
+    bool decode_block(BitReader& br, uint8_t* out, size_t outLength,
+                      size_t& outPos);
+};
@@ -0,0 +1,82 @@
+#include <fstream>
+#include <iostream>
+
+#include "mappedfile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    : bytes(nullptr), length(0), isOpen(false), isMapped(false) {}
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const char* filename, bool writable) {
+    close();
+#ifndef _WIN32
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Can't open file " << filename << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        std::cerr << "Can't read size of " << filename << std::endl;
+        ::close(fd);
+        return false;
+    }
+    this->length = info.st_size;
+    if (this->length > 0) {
+        int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        void* addr =
+            mmap(nullptr, this->length, protection, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            std::cerr << "Can't map file " << filename << std::endl;
+            ::close(fd);
+            this->length = 0;
+            return false;
+        }
+        // Se va a leer de principio a fin
+        madvise(addr, this->length, MADV_SEQUENTIAL);
+        this->bytes = static_cast<uint8_t*>(addr);
+        this->isMapped = true;
+    }
+    ::close(fd);  // la proyección sigue siendo válida
+#else
+    std::ifstream is(filename, std::ios::binary | std::ios::ate);
+    if (!is.is_open()) {
+        std::cerr << "Can't open file " << filename << std::endl;
+        return false;
+    }
+    this->length = is.tellg();
+    is.seekg(0, std::ios::beg);
+    if (this->length > 0) {
+        this->bytes = new uint8_t[this->length];
+        is.read((char*)this->bytes, this->length);
+        if (!is.good()) {
+            std::cerr << "Can't read file " << filename << std::endl;
+            close();
+            return false;
+        }
+    }
+#endif
+    this->isOpen = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (this->bytes != nullptr) {
+#ifndef _WIN32
+        if (this->isMapped) munmap(this->bytes, this->length);
+#endif
+        if (!this->isMapped) delete[] this->bytes;
+    }
+    this->bytes = nullptr;
+    this->length = 0;
+    this->isOpen = false;
+    this->isMapped = false;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+
+// Archivo de solo lectura proyectado en memoria (mmap), para leer sus datos
+// sin copiarlos. En sistemas sin mmap se lee entero a un buffer
+class MappedFile {
+   public:
+    MappedFile();
+    ~MappedFile();
+    // writable: permite modificar los datos en memoria (copia privada de
+    // las páginas modificadas, el archivo no cambia)
+    bool open(const char* filename, bool writable = false);
+    void close();
+    bool is_open() const { return isOpen; }
+    uint8_t* data() { return bytes; }
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+
+   private:
+    uint8_t* bytes;
+    size_t length;
+    bool isOpen;
+    bool isMapped;  // false: bytes reservado con new[]
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+};
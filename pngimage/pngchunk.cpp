@@ -1,14 +1,21 @@
 #include <stdint.h>
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
 
+#include "checksum.h"
+#include "inflate.h"
 #include "pngchunk.h"
 
-uint32_t PNGChunk::CRC_TABLE[256];
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // Convierte de Big Endian (archivo .png) al local de la máquina
-uint32_t read_endian(uint8_t* read) {
+uint32_t read_endian(const uint8_t* read) {
     return read[3] | read[2] << 8 | read[1] << 16 | read[0] << 24;
 }
 
@@ -21,94 +28,45 @@ void write_endian(uint32_t value, uint8_t* write) {
 }
 
 // Cálculo del CRC de 32 bits de un chunk de la imágen PNG
-// Para más info, visitar:
-// - https://archive.org/stream/PainlessCRC/crc_v3.txt
-//   (en especial capitulos del 9 al 11)
 // - https://www.w3.org/TR/2003/REC-PNG-20031110/
 //   (punto 5.5, CRC de 32 bits para uso en PNG)
-// - https://www.w3.org/TR/PNG-CRCAppendix.html
-//   (ejemplo de código en C)
-uint32_t PNGChunk::calculate_crc(uint8_t* stream, int streamLength) {
-    uint32_t rem = 0xFFFFFFFF;
-    for (int byte = 0; byte < streamLength; byte++) {
-        rem = (rem >> 8) ^ this->CRC_TABLE[(rem ^ stream[byte]) & 0xFF];
-    }
-    return rem ^ 0xFFFFFFFF;
+// Implementaciones en checksum.cpp
+uint32_t PNGChunk::calculate_crc(const uint8_t* stream, int streamLength) {
+    return Checksum::crc32(0, stream, streamLength);
 }
 
 // Constructor sin chunkInfo
 PNGChunk::PNGChunk() : PNGChunk(nullptr) {}
 
-// Crear tabla para el cálculo de CRC si es necesario
 PNGChunk::PNGChunk(ChunkInfo* _chunkInfo)
-    : chunkCrcDividend(nullptr),
-      length(0),
+    : length(0),
       chunkType(nullptr),
       data(nullptr),
       crc(0),
-      chunkInfo(_chunkInfo) {
-    static bool crcTableCalculated = false;
-    if (!crcTableCalculated) {
-        for (int i = 0; i < 256; i++) {
-            uint32_t c = i;
-            for (int bit = 0; bit < 8; bit++) {
-                if (c & 1) {
-                    c = (c >> 1) ^ this->CRC32_DIVISOR;
-                } else {
-                    c = (c >> 1);
-                }
-            }
-            this->CRC_TABLE[i] = c;
-        }
-        crcTableCalculated = true;
-    }
-}
+      chunkInfo(_chunkInfo) {}
 
-// Leer solo length y tipo de chunk
-// No está hecho para leer los datos del chunk, solo su cabecera
-bool PNGChunk::read_header(std::ifstream& is) {
-    // Longitud y tipo
-    uint8_t length_aux[4];
-    is.read((char*)length_aux, 4);
-    this->length = read_endian(length_aux);
-    this->chunkCrcDividend = new uint8_t[4];
-    this->chunkType = this->chunkCrcDividend;
-    is.read((char*)this->chunkCrcDividend, 4);
-
-    // Comprobar que la lectura ha ido bien
-    if (!is.good()) {
+// Obtener datos del chunk que empieza en file[pos], sin copiarlos
+// Avanza pos hasta el inicio del siguiente chunk
+bool PNGChunk::read_data(const uint8_t* file, size_t fileLength, size_t& pos) {
+    // Longitud (4 bytes) y tipo (4 bytes)
+    if (fileLength - pos < 8) {
         std::cerr << "An error ocurred while reading the data" << std::endl;
         return false;
-    } else {
-        return true;
     }
-}
-
-// Obtener datos del chunk a partir de un ifstream
-bool PNGChunk::read_data(std::ifstream& is) {
-    if (!is.good()) {
-        std::cerr << "An error ocurred while reading the data" << std::endl;
+    this->length = read_endian(&file[pos]);
+    if (fileLength - pos - 8 < (size_t)this->length + 4) {
+        std::cerr << "Chunk is truncated" << std::endl;
         return false;
     }
-
-    // Longitud (4 bytes)
-    uint8_t length_aux[4];
-    is.read((char*)length_aux, 4);
-    this->length = read_endian(length_aux);
-
-    // Tipo y datos (4 bytes)
-    this->chunkCrcDividend = new uint8_t[length + 4];
-    is.read((char*)this->chunkCrcDividend, length + 4);
-    this->chunkType = this->chunkCrcDividend;
-    this->data = &this->chunkCrcDividend[4];
+    this->chunkType = &file[pos + 4];
+    this->data = &file[pos + 8];
 
     // CRC
-    uint8_t crc_aux[4];
-    is.read((char*)crc_aux, 4);
-    this->crc = read_endian(crc_aux);
+    this->crc = read_endian(&file[pos + 8 + this->length]);
+    pos += 12 + (size_t)this->length;
 
-    // Comprobar CRC correcto
-    uint32_t calc_crc = calculate_crc(this->chunkCrcDividend, this->length + 4);
+    // Comprobar CRC correcto (tipo y datos)
+    uint32_t calc_crc = calculate_crc(this->chunkType, this->length + 4);
     if (calc_crc != this->crc) {
         std::cerr << "Incorrect chunk CRC" << std::endl;
         return false;
@@ -117,11 +75,10 @@ bool PNGChunk::read_data(std::ifstream& is) {
     }
 }
 
-// Obtener datos del chunk a partir de un ifstream
+// Obtener datos del chunk a partir del archivo en memoria
 // Devuelve true si la lectura es correcta, false si no
-bool PNGChunk::read_file(std::ifstream& is) {
-    // Leer ifstream
-    bool isChunkOk = this->read_data(is);
+bool PNGChunk::read_file(const uint8_t* file, size_t fileLength, size_t& pos) {
+    bool isChunkOk = this->read_data(file, fileLength, pos);
     if (!isChunkOk) {
         return false;
     }
@@ -135,50 +92,16 @@ bool PNGChunk::read_file(std::ifstream& is) {
         PNGChunk::IDATInfo* info = new PNGChunk::IDATInfo();
         this->chunkInfo = info;
         isChunkOk = info->read_info(this->data, this->length);
-        if (!isChunkOk) {
-            return false;
-        }
 
-        // Leer la longitud del resto de chunks IDAT
-        int totalLength = info->blockLength;
-        int startPos = is.tellg();  // marcar para poder volver
-        PNGChunk nextChunk;
-        while (nextChunk.read_header(is) && nextChunk.is_type("IDAT")) {
-            totalLength += nextChunk.length;
-            is.seekg(nextChunk.length + 4, std::ios_base::cur);
-        }
-        if (!is.good()) {
-            return false;
-        }
-        // Volver a la posición inicial
-        is.seekg(startPos, std::ios_base::beg);
-        // Si hay chunks que faltan por leer, hacerlo
-        // Juntar todos sus datos en blockData del chunkInfo
-        if (info->blockLength < totalLength) {
-            uint8_t* firstChunkData = info->blockData;
-            info->blockData = new uint8_t[totalLength];
-            memcpy(info->blockData, firstChunkData, info->blockLength);
-            // Leer el resto de bloques IDAT
-            while (info->blockLength < totalLength) {
-                // Leer datos del siguiente chunk
-                PNGChunk moreChunk;
-                if (!moreChunk.read_data(is) || !moreChunk.is_type("IDAT")) {
-                    std::cerr << "Error: Invalid chunk after first IDAT chunk"
-                              << std::endl;
-                    return false;
-                }
-                // Copiarlos al chunk actual
-                memcpy(&info->blockData[info->blockLength], moreChunk.data,
-                       moreChunk.length);
-                info->blockLength += moreChunk.length;
-
-                // Actualizar checksum del chunkInfo del chunk actual
-                PNGChunk::IDATInfo* moreInfo = new PNGChunk::IDATInfo();
-                moreChunk.chunkInfo = moreInfo;
-                moreInfo->read_info(moreChunk.data, moreChunk.length);
-                info->checksum = moreInfo->checksum;
-            }
+        // Los datos zlib pueden seguir en más chunks IDAT: se añaden a la
+        // lista de fragmentos de info en una sola pasada
+        while (isChunkOk && fileLength - pos >= 8 &&
+               memcmp(&file[pos + 4], "IDAT", 4) == 0) {
+            PNGChunk moreChunk;
+            isChunkOk = moreChunk.read_data(file, fileLength, pos) &&
+                        info->read_info(moreChunk.data, moreChunk.length);
         }
+        return isChunkOk;
     }
 
     return true;
@@ -191,8 +114,12 @@ bool PNGChunk::write_file(std::ofstream& os) {
     }
     uint8_t* data;
     uint32_t dataLength;
+    if (!chunkInfo->get_writable_info(data, dataLength)) {
+        return false;
+    }
     // Comprobar información correcta (al menos 8 bytes)
-    if (!chunkInfo->get_writable_info(data, dataLength) || dataLength < 8) {
+    if (dataLength < 8) {
+        delete[] data;
         return false;
     }
     os.write((char*)data, dataLength);
@@ -213,34 +140,36 @@ bool PNGChunk::is_type(const char* type) {
 }
 
 PNGChunk::~PNGChunk() {
-    if (this->chunkCrcDividend) {
-        delete[] this->chunkCrcDividend;
-    }
     if (this->chunkInfo) {
         delete this->chunkInfo;
     }
 }
 
-PNGChunk::IHDRInfo::IHDRInfo(int _width, int _height)
+PNGChunk::IHDRInfo::IHDRInfo(int _width, int _height, int _channels)
     : width(_width),
       height(_height),
       bitDepth(IHDR_BIT_DEPTH),
-      colorType(IHDR_COLOR_TYPE),
+      colorType(_channels == 4 ? IHDR_COLOR_TYPE_ALPHA : IHDR_COLOR_TYPE),
       compression(IHDR_COMPRESSION),
       filter(IHDR_FILTER),
       interlace(IHDR_INTERLACE) {}
 
 bool PNGChunk::IHDRInfo::is_supported() {
-    return this->bitDepth == IHDR_BIT_DEPTH &&
-           this->colorType == IHDR_COLOR_TYPE &&
+    return valid_size(this->width, this->height, channels()) &&
+           this->bitDepth == IHDR_BIT_DEPTH &&
+           (this->colorType == IHDR_COLOR_TYPE ||
+            this->colorType == IHDR_COLOR_TYPE_ALPHA) &&
            this->compression == IHDR_COMPRESSION &&
-           this->filter == IHDR_COMPRESSION &&
-           this->interlace == IHDR_INTERLACE;
+           this->filter == IHDR_FILTER && this->interlace == IHDR_INTERLACE;
+}
+
+int PNGChunk::IHDRInfo::channels() {
+    return this->colorType == IHDR_COLOR_TYPE_ALPHA ? 4 : 3;
 }
 
 // Más info:
 // http://www.libpng.org/pub/png/spec/1.2/PNG-Chunks.html
-bool PNGChunk::IHDRInfo::read_info(uint8_t* data, uint32_t length) {
+bool PNGChunk::IHDRInfo::read_info(const uint8_t* data, uint32_t length) {
     if (length != IHDR_LENGTH) {
         std::cerr << "IHDR chunk has wrong length" << std::endl;
         return false;
@@ -252,9 +181,25 @@ bool PNGChunk::IHDRInfo::read_info(uint8_t* data, uint32_t length) {
     this->compression = data[10];
     this->filter = data[11];
     this->interlace = data[12];
+    if (!valid_size(this->width, this->height, channels())) {
+        std::cerr << "Invalid image size " << this->width << "x"
+                  << this->height << std::endl;
+        return false;
+    }
     return true;
 }
 
+bool PNGChunk::IHDRInfo::valid_size(uint32_t width, uint32_t height,
+                                    int channels) {
+    const uint64_t maxInt = std::numeric_limits<int>::max();
+    if (width == 0 || height == 0 || width > maxInt || height > maxInt) {
+        return false;
+    }
+    uint64_t rowBytes = (uint64_t)width * channels + 1;
+    return rowBytes <= maxInt &&
+           rowBytes <= std::numeric_limits<size_t>::max() / height;
+}
+
 bool PNGChunk::IHDRInfo::get_writable_info(uint8_t*& data, uint32_t& length) {
     length = IHDR_LENGTH + 8;    // 8 bytes (4 length + 4 type)
     data = new uint8_t[length];  // borrado en write_file
@@ -270,72 +215,229 @@ bool PNGChunk::IHDRInfo::get_writable_info(uint8_t*& data, uint32_t& length) {
     return true;
 }
 
-PNGChunk::IDATInfo::IDATInfo(int width, int height, RGBColor*** pixels)
-    : pixelData(pixels) {
-    // 24 bits per pixel RGB + tipo de filtro al inicio de cada fila
-    int pixelLength = (3 * width + 1) * height;
-    // Calcular tamaño total (varios bloques)
-    int numBlocks = 1 + (pixelLength / MAX_BLOCK);
-    int totalLength = pixelLength + IDAT_LENGTH_ZLIB +
-                      numBlocks * IDAT_LENGTH_BLOCK + IDAT_LENGTH_CHECKSUM;
-    this->blockLength = totalLength;
-    this->blockData = new uint8_t[this->blockLength];
-    // Calcular datos de pixeles (uso de 'new' para imagenes grandes)
-    uint8_t* rawPixelData = new uint8_t[pixelLength];
-    int pixelPos = 0;  // posicion en rawPixelData
-    for (int y = 0; y < height; y++) {
-        rawPixelData[pixelPos++] = 0;  // tipo de filtro 0 (sin filtro)
-        for (int x = 0; x < width; x++) {
-            rawPixelData[pixelPos++] = pixels[y][x]->r;
-            rawPixelData[pixelPos++] = pixels[y][x]->g;
-            rawPixelData[pixelPos++] = pixels[y][x]->b;
+// Llama a f(i, thread) para cada i en [0, count), repartidos entre los
+// hilos de pool: cada hilo toma el siguiente que quede
+template <typename F>
+static void parallel_for(WorkerPool& pool, int count, F f) {
+    std::atomic<int> next(0);
+    pool.run([&](int thread) {
+        for (int i = next++; i < count; i = next++) f(i, thread);
+    });
+}
+
+PNGChunk::IDATEncoder::IDATEncoder(int width, int channels, int level,
+                                   int numThreads)
+    : width(width),
+      channels(channels),
+      level(level),
+      pool(numThreads),
+      deflaters(pool.threads(), Deflater(level)),
+      started(false),
+      adler(1) {}
+
+// Filtra las filas (eligiendo el mejor filtro de cada una) y las comprime
+// Referencia: https://www.w3.org/TR/PNG-Encoders.html (punto 9.6)
+void PNGChunk::IDATEncoder::encode(const uint8_t* rows, int count,
+                                   ptrdiff_t stride, bool last,
+                                   uint8_t*& data, size_t& length,
+                                   uint32_t& crc) {
+    // 24/32 bits per pixel RGB(A) + tipo de filtro al inicio de cada fila
+    int rowBytes = channels * width;
+    size_t filteredRow = rowBytes + 1;
+    int stripRows = std::max(1, (int)(STRIP_BYTES / filteredRow));
+    // (al menos una, para terminar el stream aunque no queden filas)
+    int strips = std::max(1, (count + stripRows - 1) / stripRows);
+
+    // Toda la memoria de la llamada sale de arena, reservada aquí antes de
+    // repartir las franjas entre los hilos
+    arena.reset();
+    // Datos filtrados detrás de los de la parte anterior
+    // Cada franja se filtra entera antes de comprimir ninguna, porque la
+    // siguiente la usa como diccionario
+    size_t historyLength = history.size();
+    size_t pixelLength = historyLength + filteredRow * count;
+    uint8_t* rawPixelData = arena.allocate<uint8_t>(pixelLength);
+    if (historyLength > 0) {
+        memcpy(rawPixelData, history.data(), historyLength);
+    }
+    // Por franja: fila filtrada de prueba y mejor fila hasta ahora
+    uint8_t* rowBuffers =
+        arena.allocate<uint8_t>((size_t)2 * rowBytes * strips);
+    parallel_for(pool, strips, [&](int strip, int) {
+        uint8_t* candidate = &rowBuffers[(size_t)2 * rowBytes * strip];
+        uint8_t* best = candidate + rowBytes;
+        int y1 = std::min(count, (strip + 1) * stripRows);
+        for (int y = strip * stripRows; y < y1; y++) {
+            const uint8_t* row = rows + y * stride;
+            const uint8_t* prior =
+                y > 0 ? row - stride
+                      : (priorRow.empty() ? nullptr : priorRow.data());
+            uint8_t* out = &rawPixelData[historyLength + y * filteredRow];
+            if (level == 0) {
+                // Sin compresión filtrar no sirve de nada
+                out[0] = 0;
+                memcpy(&out[1], row, rowBytes);
+                continue;
+            }
+            // Heurística: el filtro con menor suma de diferencias (con
+            // signo) suele ser el que mejor se comprime
+            uint64_t bestSum = UINT64_MAX;
+            for (int filterType = 0; filterType <= 4; filterType++) {
+                uint64_t sum = IDATInfo::filter_row(
+                    filterType, row, prior, rowBytes, channels, candidate);
+                if (sum < bestSum) {
+                    bestSum = sum;
+                    out[0] = filterType;
+                    std::swap(candidate, best);
+                }
+            }
+            memcpy(&out[1], best, rowBytes);
         }
+    });
+
+    // Comprimir cada franja por separado, con sus sumas de comprobación
+    struct Strip {
+        uint8_t* compressed;
+        size_t length;     // comprimida
+        size_t rawLength;  // filtrada, sin comprimir
+        uint32_t adler, crc;
+    };
+    Strip* parts = arena.allocate<Strip>(strips);
+    for (int strip = 0; strip < strips; strip++) {
+        size_t start = historyLength + strip * stripRows * filteredRow;
+        size_t end = std::min(pixelLength, start + stripRows * filteredRow);
+        parts[strip].compressed =
+            arena.allocate<uint8_t>(Deflater::bound(end - start));
     }
-    // Escribir pixels en bloques
-    pixelPos = 0;
-    int blockPos = 0;
-    int remainingLength = pixelLength;
-    // ZLIB Header
-    this->blockData[blockPos++] = IDAT_ZLIB_HEADER >> 8 & 0xFF;
-    this->blockData[blockPos++] = IDAT_ZLIB_HEADER & 0xFF;
-    while (remainingLength > 0) {
-        uint16_t checksumLength;
-        // Block header
-        if (remainingLength > MAX_BLOCK) {
-            this->blockData[blockPos++] = IDAT_BLOCK_HEADER;
-            checksumLength = MAX_BLOCK;
-        } else {
-            this->blockData[blockPos++] = IDAT_BLOCK_HEADER | IDAT_BLOCK_LAST;
-            checksumLength = remainingLength;
+    parallel_for(pool, strips, [&](int strip, int thread) {
+        size_t start = historyLength + strip * stripRows * filteredRow;
+        size_t end = std::min(pixelLength, start + stripRows * filteredRow);
+        Strip& part = parts[strip];
+        part.length =
+            deflaters[thread].deflate(rawPixelData, start, end,
+                                      part.compressed,
+                                      last && strip == strips - 1);
+        part.rawLength = end - start;
+        part.adler = Checksum::adler32(1, &rawPixelData[start], end - start);
+        part.crc = Checksum::crc32(0, part.compressed, part.length);
+    });
+
+    // Diccionario y fila anterior de la parte siguiente
+    if (!last) {
+        size_t keep = std::min<size_t>(pixelLength, HISTORY_BYTES);
+        history.assign(rawPixelData + pixelLength - keep,
+                       rawPixelData + pixelLength);
+        if (count > 0) {
+            const uint8_t* lastRow = rows + (count - 1) * stride;
+            priorRow.assign(lastRow, lastRow + rowBytes);
         }
-        // Longitud y su invertido Ca1 (máximo)
-        this->blockData[blockPos++] = checksumLength & 0xFF;
-        this->blockData[blockPos++] = checksumLength >> 8 & 0xFF;
-        this->blockData[blockPos++] = ~checksumLength & 0xFF;
-        this->blockData[blockPos++] = ~checksumLength >> 8 & 0xFF;
-        // Datos de pixeles
-        memcpy(&this->blockData[blockPos], &rawPixelData[pixelPos],
-               checksumLength);
-        pixelPos += checksumLength;
-        blockPos += checksumLength;
-        remainingLength -= checksumLength;
-    }
-    // Checksum
-    write_endian(adler_checksum(rawPixelData, pixelLength),
-                 &this->blockData[blockPos]);
-    delete[] rawPixelData;  // ya no se usa
+    }
+
+    // Cabecera ZLIB (la primera vez) + bloques DEFLATE + checksum (la
+    // última vez)
+    int headerLength = started ? 0 : IDATInfo::IDAT_LENGTH_ZLIB;
+    int checksumLength = last ? IDATInfo::IDAT_LENGTH_CHECKSUM : 0;
+    length = headerLength + checksumLength;
+    for (int strip = 0; strip < strips; strip++) length += parts[strip].length;
+    data = arena.allocate<uint8_t>(length);
+    if (!started) {
+        // FLEVEL (informativo) y FCHECK para que la cabecera sea múltiplo
+        // de 31
+        uint8_t flevel =
+            level < 2 ? 0 : (level < 6 ? 1 : (level == 6 ? 2 : 3));
+        uint16_t zlibHeader = IDATInfo::IDAT_ZLIB_CMF << 8 | flevel << 6;
+        zlibHeader += 31 - zlibHeader % 31;
+        data[0] = zlibHeader >> 8 & 0xFF;
+        data[1] = zlibHeader & 0xFF;
+        started = true;
+    }
+    crc = Checksum::crc32(0, data, headerLength);
+    size_t pos = headerLength;
+    for (int strip = 0; strip < strips; strip++) {
+        const Strip& part = parts[strip];
+        memcpy(&data[pos], part.compressed, part.length);
+        pos += part.length;
+        adler = Checksum::adler32_combine(adler, part.adler, part.rawLength);
+        crc = Checksum::crc32_combine(crc, part.crc, part.length);
+    }
+    if (last) {
+        write_endian(adler, &data[pos]);
+        crc = Checksum::crc32(crc, &data[pos], checksumLength);
+        // Listo para otra imagen
+        started = false;
+        adler = 1;
+        history.clear();
+        priorRow.clear();
+    }
 }
 
-// Cálculo del checksum Adler-32:
+// Aplica un filtro a la fila row (prior: fila anterior, nullptr si es la
+// primera) y devuelve la suma de los valores filtrados como bytes con signo
+// Cada filtro tiene su propio bucle, los primeros bpp bytes (sin pixel a
+// la izquierda) se tratan aparte
+uint64_t PNGChunk::IDATInfo::filter_row(int filterType, const uint8_t* row,
+                                        const uint8_t* prior, int rowBytes,
+                                        int bpp, uint8_t* out) {
+    int first = std::min(bpp, rowBytes);
+    switch (filterType) {
+        case 0:  // None
+            memcpy(out, row, rowBytes);
+            break;
+        case 1:  // Sub
+            memcpy(out, row, first);
+            for (int i = bpp; i < rowBytes; i++) out[i] = row[i] - row[i - bpp];
+            break;
+        case 2:  // Up
+            if (!prior) {
+                memcpy(out, row, rowBytes);
+                break;
+            }
+            for (int i = 0; i < rowBytes; i++) out[i] = row[i] - prior[i];
+            break;
+        case 3:  // Average
+            for (int i = 0; i < first; i++) {
+                out[i] = row[i] - (prior ? prior[i] : 0) / 2;
+            }
+            if (prior) {
+                for (int i = bpp; i < rowBytes; i++) {
+                    out[i] = row[i] - (row[i - bpp] + prior[i]) / 2;
+                }
+            } else {
+                for (int i = bpp; i < rowBytes; i++) {
+                    out[i] = row[i] - row[i - bpp] / 2;
+                }
+            }
+            break;
+        case 4:  // Paeth
+            if (!prior) {
+                // Sin fila anterior Paeth equivale a Sub
+                memcpy(out, row, first);
+                for (int i = bpp; i < rowBytes; i++) {
+                    out[i] = row[i] - row[i - bpp];
+                }
+                break;
+            }
+            for (int i = 0; i < first; i++) {
+                out[i] = row[i] - paeth_pred(0, prior[i], 0);
+            }
+            for (int i = bpp; i < rowBytes; i++) {
+                out[i] = row[i] - paeth_pred(row[i - bpp], prior[i],
+                                             prior[i - bpp]);
+            }
+            break;
+    }
+    uint64_t sum = 0;
+    for (int i = 0; i < rowBytes; i++) {
+        sum += out[i] < 128 ? out[i] : 256 - out[i];
+    }
+    return sum;
+}
+
+// Cálculo del checksum Adler-32 (ver checksum.cpp):
 // https://en.wikipedia.org/wiki/Adler-32
-uint32_t PNGChunk::IDATInfo::adler_checksum(uint8_t* data, uint32_t length) {
-    int a = 1;
-    int b = 0;
-    for (int i = 0; i < length; i++) {
-        a = (a + data[i]) % ADLER_MODULO;
-        b = (b + a) % ADLER_MODULO;
-    }
-    return b * 65536 + a;
+uint32_t PNGChunk::IDATInfo::adler_checksum(const uint8_t* data,
+                                            size_t length) {
+    return Checksum::adler32(1, data, length);
 }
 
 // Modo de filtrado #4, mira los pixeles a la izquierda y derecha
@@ -350,182 +452,330 @@ uint8_t PNGChunk::IDATInfo::paeth_pred(uint8_t a, uint8_t b, uint8_t c) {
     return pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
 }
 
-// Leer los datos de pixeles de la imagen, sin cabeceras
+#ifdef __SSE2__
+// Deshacer los filtros Sub, Average y Paeth de pixel en pixel con SSE2
+// (cada pixel depende del de su izquierda, no se puede hacer la fila entera
+// a la vez), con los BPP bytes del pixel en un registro
+// Ref: filter_sse2_intrinsics.c de libpng
+
+// Para BPP = 3 se leen/escriben 2 + 1 bytes en registros enteros (con
+// memcpy de 3 bytes el compilador pasa por la pila, mucho más lento)
+template <int BPP>
+static inline __m128i load_pixel(const uint8_t* p) {
+    uint32_t v;
+    if (BPP == 4) {
+        memcpy(&v, p, 4);
+    } else {
+        uint16_t low;
+        memcpy(&low, p, 2);
+        v = low | (uint32_t)p[2] << 16;
+    }
+    return _mm_cvtsi32_si128(v);
+}
+
+template <int BPP>
+static inline void store_pixel(uint8_t* p, __m128i v) {
+    uint32_t w = _mm_cvtsi128_si32(v);
+    if (BPP == 4) {
+        memcpy(p, &w, 4);
+    } else {
+        uint16_t low = w;
+        memcpy(p, &low, 2);
+        p[2] = w >> 16;
+    }
+}
+
+template <int BPP>
+static void unfilter_sub_sse2(const uint8_t* src, int rowBytes,
+                              uint8_t* out) {
+    __m128i a = _mm_setzero_si128();
+    for (int i = 0; i < rowBytes; i += BPP) {
+        a = _mm_add_epi8(a, load_pixel<BPP>(&src[i]));
+        store_pixel<BPP>(&out[i], a);
+    }
+}
+
+template <int BPP>
+static void unfilter_avg_sse2(const uint8_t* src, const uint8_t* prior,
+                              int rowBytes, uint8_t* out) {
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i a = _mm_setzero_si128();
+    for (int i = 0; i < rowBytes; i += BPP) {
+        __m128i b = load_pixel<BPP>(&prior[i]);
+        // _mm_avg_epu8 redondea hacia arriba: restar 1 si a + b es impar
+        __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b),
+                                   _mm_and_si128(_mm_xor_si128(a, b), one));
+        a = _mm_add_epi8(load_pixel<BPP>(&src[i]), avg);
+        store_pixel<BPP>(&out[i], a);
+    }
+}
+
+// Paeth con a, b y c en 16 bits: |p - a| = |b - c|, |p - b| = |a - c| y
+// |p - c| = |(a - c) + (b - c)|, en caso de empate a > b > c
+// Solo lo que depende de a (el pixel recién calculado) queda en la cadena
+// de dependencias entre pixeles: |b - c|, Raw + b y Raw + c se calculan
+// antes, y el resultado se elige directamente entre Raw + a, b o c
+template <int BPP>
+static void unfilter_paeth_sse2(const uint8_t* src, const uint8_t* prior,
+                                int rowBytes, uint8_t* out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lowByte = _mm_set1_epi16(0xFF);
+    __m128i a = zero, c = zero;
+    for (int i = 0; i < rowBytes; i += BPP) {
+        __m128i b = _mm_unpacklo_epi8(load_pixel<BPP>(&prior[i]), zero);
+        __m128i x = _mm_unpacklo_epi8(load_pixel<BPP>(&src[i]), zero);
+        __m128i bc = _mm_sub_epi16(b, c);
+        __m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+        __m128i xb = _mm_add_epi16(x, b);
+        __m128i xc = _mm_add_epi16(x, c);
+        __m128i ac = _mm_sub_epi16(a, c);
+        __m128i xa = _mm_add_epi16(x, a);
+        __m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+        __m128i pc = _mm_add_epi16(ac, bc);
+        pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+        __m128i notA = _mm_or_si128(_mm_cmpgt_epi16(pa, pb),
+                                    _mm_cmpgt_epi16(pa, pc));
+        __m128i notB = _mm_cmpgt_epi16(pb, pc);
+        __m128i xbc = _mm_or_si128(_mm_andnot_si128(notB, xb),
+                                   _mm_and_si128(notB, xc));
+        __m128i d = _mm_or_si128(_mm_andnot_si128(notA, xa),
+                                 _mm_and_si128(notA, xbc));
+        a = _mm_and_si128(d, lowByte);
+        store_pixel<BPP>(&out[i], _mm_packus_epi16(a, a));
+        c = b;
+    }
+}
+#endif
+
+// Deshace el filtro filterType de una fila: out = src + predicción
+// (prior: fila anterior ya reconstruida, nullptr si es la primera)
+// https://www.w3.org/TR/PNG-Filters.html
+// out puede solaparse con src si empieza antes (ver process_pixel_data):
+// cada byte de src se lee antes de escribir encima
+void PNGChunk::IDATInfo::unfilter_row(int filterType, const uint8_t* src,
+                                      const uint8_t* prior, int rowBytes,
+                                      int bpp, uint8_t* out) {
+    int first = std::min(bpp, rowBytes);
+    int i = 0;
+    switch (filterType) {
+        case 0:  // None(x) = Raw(x)
+            memmove(out, src, rowBytes);
+            break;
+        case 1:  // Sub(x) = Raw(x) - Raw(x-bpp)
+#ifdef __SSE2__
+            if (bpp == 3) return unfilter_sub_sse2<3>(src, rowBytes, out);
+            if (bpp == 4) return unfilter_sub_sse2<4>(src, rowBytes, out);
+#endif
+            for (; i < first; i++) out[i] = src[i];
+            for (; i < rowBytes; i++) out[i] = src[i] + out[i - bpp];
+            break;
+        case 2:  // Up(x) = Raw(x) - Prior(x)
+            if (!prior) {
+                memmove(out, src, rowBytes);
+                break;
+            }
+#ifdef __SSE2__
+            // Sin dependencias dentro de la fila: de 16 en 16 bytes
+            for (; i + 16 <= rowBytes; i += 16) {
+                __m128i x = _mm_loadu_si128((const __m128i*)&src[i]);
+                __m128i b = _mm_loadu_si128((const __m128i*)&prior[i]);
+                _mm_storeu_si128((__m128i*)&out[i], _mm_add_epi8(x, b));
+            }
+#endif
+            for (; i < rowBytes; i++) out[i] = src[i] + prior[i];
+            break;
+        case 3:  // Average(x) = Raw(x) - floor((Raw(x-bpp)+Prior(x))/2)
+            if (!prior) {
+                for (; i < first; i++) out[i] = src[i];
+                for (; i < rowBytes; i++) out[i] = src[i] + out[i - bpp] / 2;
+                break;
+            }
+#ifdef __SSE2__
+            if (bpp == 3) return unfilter_avg_sse2<3>(src, prior, rowBytes, out);
+            if (bpp == 4) return unfilter_avg_sse2<4>(src, prior, rowBytes, out);
+#endif
+            for (; i < first; i++) out[i] = src[i] + prior[i] / 2;
+            for (; i < rowBytes; i++) {
+                out[i] = src[i] + (out[i - bpp] + prior[i]) / 2;
+            }
+            break;
+        case 4:  // Paeth(x) = Raw(x) - PaethPredictor(Raw(x-bpp),
+                 //                        Prior(x), Prior(x-bpp))
+            if (!prior) {
+                // Sin fila anterior Paeth equivale a Sub
+                unfilter_row(1, src, prior, rowBytes, bpp, out);
+                break;
+            }
+#ifdef __SSE2__
+            if (bpp == 3) {
+                return unfilter_paeth_sse2<3>(src, prior, rowBytes, out);
+            }
+            if (bpp == 4) {
+                return unfilter_paeth_sse2<4>(src, prior, rowBytes, out);
+            }
+#endif
+            for (; i < first; i++) out[i] = src[i] + prior[i];
+            for (; i < rowBytes; i++) {
+                out[i] = src[i] + paeth_pred(out[i - bpp], prior[i],
+                                             prior[i - bpp]);
+            }
+            break;
+    }
+}
+
+// Leer los datos de pixeles de la imagen, sin cabeceras, y escribirlos
+// fila a fila en pixels (stride bytes por fila)
 // Más info:
 // https://stackoverflow.com/questions/49017937/png-decompressed-idat-chunk-how-to-read
+// data puede ser el propio pixels (ver process_pixels): cada byte se lee
+// antes de escribir encima, ya que la fila y de pixels empieza y + 1 bytes
+// antes que la de data (o 1 byte antes como mucho si hay relleno)
 bool PNGChunk::IDATInfo::process_pixel_data(int width, int height,
-                                            uint8_t* data, int length) {
-    int pos = 0;                 // posición de memoria apuntada
-    int pixelX = 0, pixelY = 0;  // pixeles X, Y apuntados
-    int filterType = 0;          // tipo de filtro en la fila en curso
-    bool readOk = true;
-    this->pixelData = new RGBColor**[height];
-    while (readOk && pos < length) {
+                                            int channels, const uint8_t* data,
+                                            size_t length, uint8_t* pixels,
+                                            int stride) {
+    // Tamaño ya comprobado en process_pixels
+    int rowBytes = channels * width;
+    size_t filteredRow = (size_t)rowBytes + 1;
+    if (length != filteredRow * height) {
+        std::cerr << "Error: pixel data has incorrect size" << std::endl;
+        return false;
+    }
+    for (int y = 0; y < height; y++) {
         // Cada fila comienza con un byte para indicar tipo de filtro
-        // Solo se soporta tipos 0, 1 y 2 (None, Sub y Add)
-        // https://www.w3.org/TR/PNG-Filters.html
-        if (pixelX == 0) {
-            if (data[pos] > 4) {
-                std::cerr << "Error: invalid filter type (" << (int)data[pos]
-                          << ")" << std::endl;
-                readOk = false;
-            } else {
-                this->pixelData[pixelY] = new RGBColor*[width];
-                filterType = data[pos++];  // leer un byte
-            }
+        const uint8_t* src = &data[y * filteredRow];
+        int filterType = *src++;
+        if (filterType > 4) {
+            std::cerr << "Error: invalid filter type (" << filterType << ")"
+                      << std::endl;
+            return false;
         }
-        // Leer datos del pixel (r, g, b 3 bytes en ese orden)
-        if (readOk) {
-            uint8_t r = data[pos], g = data[pos + 1], b = data[pos + 2];
-            pos += 3;  // leidos 3 bytes
-            const RGBColor *left, *top, *leftTop;
-            left = pixelX > 0 ? this->pixelData[pixelY][pixelX - 1]
-                              : &RGBColor::Black;
-            top = pixelY > 0 ? this->pixelData[pixelY - 1][pixelX]
-                             : &RGBColor::Black;
-            leftTop = pixelX > 0 && pixelY > 0
-                          ? this->pixelData[pixelY - 1][pixelX - 1]
-                          : &RGBColor::Black;
-            switch (filterType) {
-                case 1:  // Sub(x) = Raw(x) - Raw(x-bpp)
-                    r += left->r;
-                    g += left->g;
-                    b += left->b;
-                    break;
-                case 2:  // Up(x) = Raw(x) - Prior(x)
-                    r += top->r;
-                    g += top->g;
-                    b += top->b;
-                    break;
-                case 3:  // Average(x) = Raw(x) - floor((Raw(x-bpp)+Prior(x))/2)
-                    r += (left->r + top->r) / 2;
-                    g += (left->g + top->g) / 2;
-                    b += (left->b + top->b) / 2;
-                    break;
-                case 4:  // Paeth(x) = Raw(x) - PaethPredictor(Raw(x-bpp),
-                         //                        Prior(x), Prior(x-bpp))
-                    r += paeth_pred(left->r, top->r, leftTop->r);
-                    g += paeth_pred(left->g, top->g, leftTop->g);
-                    b += paeth_pred(left->b, top->b, leftTop->b);
-                    break;
-            }
-            this->pixelData[pixelY][pixelX] = new RGBColor(r, g, b);
-            pixelX++;
-            if (pixelX == width) {
-                pixelX = 0;
-                pixelY++;
-            }
+        uint8_t* dst = &pixels[(size_t)y * stride];
+        const uint8_t* prior = y > 0 ? dst - stride : nullptr;
+        unfilter_row(filterType, src, prior, rowBytes, channels, dst);
+    }
+    return true;
+}
+
+// Copia length bytes de los fragmentos a partir de la posición offset
+// (contada desde el inicio del primero)
+static bool read_segment_bytes(const std::vector<Inflater::Segment>& segments,
+                               size_t offset, uint8_t* dst, size_t length) {
+    for (size_t i = 0; i < segments.size() && length > 0; i++) {
+        if (offset >= segments[i].length) {
+            offset -= segments[i].length;
+            continue;
         }
+        size_t n = std::min(length, segments[i].length - offset);
+        memcpy(dst, &segments[i].data[offset], n);
+        dst += n;
+        length -= n;
+        offset = 0;
     }
-    return readOk;
+    return length == 0;
 }
 
 // Ya obtenidos los datos de todos los chunks IDAT,
 // leer los diferentes bloques y obtener los píxeles de la imagen
-bool PNGChunk::IDATInfo::process_pixels(int width, int height) {
-    int pixelLength = (3 * width + 1) * height;
-    uint8_t* rawPixelData =
-        new uint8_t[pixelLength];  // solo pixeles, sin cabeceras
+bool PNGChunk::IDATInfo::process_pixels(int width, int height, int channels,
+                                        uint8_t* pixels, int stride,
+                                        size_t capacity) {
+    // Con los mismos límites que IHDRInfo: las cuentas con filas de
+    // rowBytes + 1 bytes no se desbordan
+    if (width <= 0 || height <= 0 ||
+        !IHDRInfo::valid_size(width, height, channels) ||
+        stride < channels * width) {
+        std::cerr << "Invalid image size " << width << "x" << height
+                  << std::endl;
+        return false;
+    }
+    int rowBytes = channels * width;
+    size_t filteredRow = (size_t)rowBytes + 1;
+    size_t pixelLength = filteredRow * height;
     // Cabecera ZLIB (2 bytes)
-    uint16_t compressionHeader = this->blockData[0] << 8 | this->blockData[1];
+    uint8_t zlib[IDAT_LENGTH_ZLIB];
+    if (!read_segment_bytes(this->segments, 0, zlib, IDAT_LENGTH_ZLIB)) {
+        std::cerr << "IDAT chunk has wrong length" << std::endl;
+        return false;
+    }
+    uint16_t compressionHeader = zlib[0] << 8 | zlib[1];
     if (compressionHeader % 31 != 0) {
         std::cerr << "ZLIB header has invalid CHECK bits" << std::endl;
         return false;
     }
-    // Comprobar que CM = 8, FLEVEL = 0 y FDICT = 0
-    if (static_cast<uint16_t>(compressionHeader & 0x0FE0) !=
-        (IDAT_ZLIB_HEADER & 0x0FE0)) {
+    // Comprobar que CM = 8 (DEFLATE), CINF <= 7 (ventana de 32K como mucho)
+    // y FDICT = 0 (sin diccionario). FLEVEL es solo informativo
+    uint8_t cmf = compressionHeader >> 8, flg = compressionHeader & 0xFF;
+    if ((cmf & 0x0F) != (IDAT_ZLIB_CMF & 0x0F) || (cmf >> 4) > 7 ||
+        (flg & 0x20) != 0) {
         std::cerr << "Unsupported ZLIB compression type" << std::endl;
         return false;
     }
-    // Leer todos los bloques DEFLATE
-    int pixelPos = 0;  // rawPixelData leido
-    int blockPos = 2;  // posicion en los datos
-    uint8_t blockHeader = IDAT_BLOCK_HEADER;
-    while ((blockHeader & 0x01) !=
-           IDAT_BLOCK_LAST) {  // quedan bloques por leer
-        // Cabecera del bloque (3 bits + 5 sin usar: 1 byte)
-        blockHeader = this->blockData[blockPos++];
-        // Bloque sin comprimir (BTYPE = 00), el resto del byte
-        // no contiene información (todo 0)
-        if ((blockHeader & 0xFE) != IDAT_BLOCK_HEADER) {
-            std::cerr << "Unsupported DEFLATE block type" << std::endl;
-            return false;
-        }
-        // Longitud del bloque (2 bytes) + invertido Ca1 (2 bytes)
-        uint16_t blockLength =
-            this->blockData[blockPos + 1] << 8 | this->blockData[blockPos];
-        uint16_t invertedLength =
-            this->blockData[blockPos + 3] << 8 | this->blockData[blockPos + 2];
-        blockPos += 4;  // 4 bytes longitud + invertido
-        if ((blockLength & invertedLength) != 0) {
-            std::cerr << "Invalid DEFLATE block length" << std::endl;
-            return false;
-        }
-
-        // Asegurar que el tamaño no se pasa y copiar la información
-        if (pixelPos + blockLength > pixelLength) {
-            std::cerr << "DEFLATE data has incorrect size" << std::endl;
-            return false;
-        }
-        memcpy(&rawPixelData[pixelPos], &this->blockData[blockPos],
-               blockLength);
-        pixelPos += blockLength;
-        blockPos += blockLength;
+    // Descomprimir sobre el propio buffer de la imagen si es posible
+    // (solo pixeles, sin cabeceras)
+    scratch.reset();
+    bool inPlace = capacity >= pixelLength && (size_t)stride <= filteredRow;
+    uint8_t* rawPixelData =
+        inPlace ? pixels : scratch.allocate<uint8_t>(pixelLength);
+    // Descomprimir todos los bloques DEFLATE, leyendo directamente de los
+    // fragmentos (la cabecera zlib se salta en el primero)
+    size_t numSegments = this->segments.size();
+    Inflater::Segment* deflateSegments =
+        scratch.allocate<Inflater::Segment>(numSegments);
+    std::copy(this->segments.begin(), this->segments.end(), deflateSegments);
+    size_t skip = IDAT_LENGTH_ZLIB;
+    for (size_t i = 0; i < numSegments && skip > 0; i++) {
+        size_t n = std::min(skip, deflateSegments[i].length);
+        deflateSegments[i].data += n;
+        deflateSegments[i].length -= n;
+        skip -= n;
     }
-
-    // Comprobar que todo ha ido bien, falta el checksum por leer
-    // (pero ya se encuentra en this->checksum)
-    if (pixelPos != pixelLength ||
-        blockPos != this->blockLength - IDAT_LENGTH_CHECKSUM) {
-        std::cerr << "DEFLATE data has incorrect size" << std::endl;
+    size_t written, consumed;
+    if (!inflater.inflate(deflateSegments, numSegments, rawPixelData,
+                          pixelLength, written, consumed) ||
+        written != pixelLength) {
+        std::cerr << "DEFLATE data is invalid or has incorrect size"
+                  << std::endl;
         return false;
     }
-    // Comprobar CRC
-    uint32_t calc_checksum = adler_checksum(rawPixelData, pixelLength);
-    if (this->checksum != calc_checksum) {
+    // Checksum Adler-32, justo después del último bloque DEFLATE
+    uint8_t adler[IDAT_LENGTH_CHECKSUM];
+    if (!read_segment_bytes(this->segments, IDAT_LENGTH_ZLIB + consumed, adler,
+                            IDAT_LENGTH_CHECKSUM) ||
+        read_endian(adler) != adler_checksum(rawPixelData, pixelLength)) {
         std::cerr << "Invalid data adler checksum" << std::endl;
         return false;
     }
 
     // Procesar los datos obtenidos en rawPixelData
-    if (!process_pixel_data(width, height, rawPixelData, pixelLength)) {
+    bool isDataOk = process_pixel_data(width, height, channels, rawPixelData,
+                                       pixelLength, pixels, stride);
+    if (!isDataOk) {
         std::cerr << "An error ocurred reading pixel data" << std::endl;
-        return false;
     }
-
-    delete[] rawPixelData;
-    return true;
+    return isDataOk;
 }
 
 // Más info:
 // https://stackoverflow.com/questions/33535388/deflate-compression-spec-clarifications
 // https://github.com/libyal/assorted/blob/master/documentation/Deflate%20(zlib)%20compressed%20data%20format.asciidoc
-bool PNGChunk::IDATInfo::read_info(uint8_t* data, uint32_t length) {
-    if (length < IDAT_LENGTH_CHECKSUM) {
-        std::cerr << "IDAT chunk has wrong length" << std::endl;
-        return false;
-    }
-
-    // Checksum Adler-32 de los datos (data, length)
-    this->blockData = data;
-    this->blockLength = length;
-    this->checksum = read_endian(&data[length - 4]);
+bool PNGChunk::IDATInfo::read_info(const uint8_t* data, uint32_t length) {
+    // Los datos zlib pueden partirse en cualquier punto entre chunks IDAT,
+    // la cabecera y el checksum se comprueban al descomprimir
+    Inflater::Segment segment = {data, length};
+    this->segments.push_back(segment);
     return true;
 }
 
-bool PNGChunk::IDATInfo::get_writable_info(uint8_t*& data, uint32_t& length) {
-    length = this->blockLength + 8;
-    data = new uint8_t[length];
-    write_endian(this->blockLength, data);
-    memcpy(&data[4], &"IDAT", 4);
-    // Copiar y borrar no es la opción más rápida, pero es simple
-    memcpy(&data[8], this->blockData, this->blockLength);
-    delete[] this->blockData;
-    return true;
+bool PNGChunk::IDATInfo::get_writable_info(uint8_t*& /* data */,
+                                           uint32_t& /* length */) {
+    std::cerr << "IDAT chunks are written with PNGChunk::IDATEncoder"
+              << std::endl;
+    return false;
 }
 
-bool PNGChunk::IENDInfo::read_info(uint8_t* data, uint32_t length) {
+bool PNGChunk::IENDInfo::read_info(const uint8_t* /* data */,
+                                   uint32_t /* length */) {
     return true;
 }
 
@@ -1,7 +1,13 @@
 #pragma once
 
 #include <stdint.h>
+#include <cstddef>
+#include <vector>
+#include "arena.h"
+#include "deflate.h"
+#include "inflate.h"
 #include "rgbcolor.h"
+#include "workerpool.h"
 
 // Una imagen PNG está formada por varios chunks de este tipo
 // http://www.libpng.org/pub/png/spec/1.2/PNG-Chunks.html
@@ -12,19 +18,15 @@
 //   4 bytes: CRC
 class PNGChunk {
    private:
-    static const uint32_t CRC32_DIVISOR = 0xEDB88320;  // ver calculate_crc
-    static uint32_t CRC_TABLE[256];
-    uint8_t* chunkCrcDividend;
-
-    uint32_t calculate_crc(uint8_t* stream, int streamLength);
-    bool read_header(std::ifstream& is);
-    bool read_data(std::ifstream& is);
+    uint32_t calculate_crc(const uint8_t* stream, int streamLength);
+    bool read_data(const uint8_t* file, size_t fileLength, size_t& pos);
 
    public:
     // Posibilidad de ampliar a más tipos: PLTE, etc.
     class ChunkInfo {
        public:
-        virtual bool read_info(uint8_t* data, uint32_t length) = 0;
+        virtual ~ChunkInfo() {}
+        virtual bool read_info(const uint8_t* data, uint32_t length) = 0;
         virtual bool get_writable_info(uint8_t*& data, uint32_t& length) = 0;
     };
 
@@ -35,7 +37,8 @@ class PNGChunk {
         static const int IHDR_LENGTH = 13;
         // Valores soportados
         static const int IHDR_BIT_DEPTH = 8;
-        static const int IHDR_COLOR_TYPE = 2;
+        static const int IHDR_COLOR_TYPE = 2;        // RGB
+        static const int IHDR_COLOR_TYPE_ALPHA = 6;  // RGBA
         static const int IHDR_COMPRESSION = 0;
         static const int IHDR_FILTER = 0;
         static const int IHDR_INTERLACE = 0;
@@ -45,57 +48,124 @@ class PNGChunk {
         uint8_t bitDepth, colorType, compression, filter, interlace;
 
         IHDRInfo() = default;
-        IHDRInfo(int _width, int _height);
+        IHDRInfo(int _width, int _height, int _channels = 3);
+        // Tamaño que se puede guardar en un PNGImage: ancho y alto de 1 a
+        // 2^31 - 1, filas de width * channels + 1 bytes (con el de filtro)
+        // que caben en un int y height filas así que caben en un size_t
+        static bool valid_size(uint32_t width, uint32_t height, int channels);
         bool is_supported();
-        bool read_info(uint8_t* data, uint32_t length) override;
+        int channels();  // bytes por pixel (3 o 4)
+        bool read_info(const uint8_t* data, uint32_t length) override;
         bool get_writable_info(uint8_t*& data, uint32_t& length) override;
     };
 
+    class IDATEncoder;
+
     // Datos (colores) de la imagen
     class IDATInfo : public ChunkInfo {
        private:
-        // CINF = 0, CM = 8, FLEVEL = FDICT = 0, FCHECK = 1D (mult. 31)
-        static const uint16_t IDAT_ZLIB_HEADER = 0x081D;
-        // Last block marker 0, block type 00 (menor a mayor peso)
-        static const uint8_t IDAT_BLOCK_HEADER = 0x00;
-        // Marcador de último bloque (OR con BLOCK_HEADER)
-        static const uint8_t IDAT_BLOCK_LAST = 0x01;
-        static const uint16_t MAX_BLOCK = 65535;  // 16b para length
-        static const int ADLER_MODULO = 65521;    // ver adler_checksum
-
-        uint8_t paeth_pred(uint8_t a, uint8_t b, uint8_t c);
-        bool process_pixel_data(int width, int height, uint8_t* data,
-                                int length);
+        // CINF = 7 (ventana de 32K), CM = 8 (DEFLATE)
+        static const uint8_t IDAT_ZLIB_CMF = 0x78;
+
+        // Memoria temporal de process_pixels (fragmentos sin la cabecera
+        // zlib y, si no caben en pixels, los datos filtrados) y sus tablas
+        // de Huffman: al volver a llamarla se reutilizan
+        Arena scratch;
+        Inflater inflater;
+
+        static uint8_t paeth_pred(uint8_t a, uint8_t b, uint8_t c);
+        static uint64_t filter_row(int filterType, const uint8_t* row,
+                                   const uint8_t* prior, int rowBytes,
+                                   int bpp, uint8_t* out);
+        void unfilter_row(int filterType, const uint8_t* src,
+                          const uint8_t* prior, int rowBytes, int bpp,
+                          uint8_t* out);
+        bool process_pixel_data(int width, int height, int channels,
+                                const uint8_t* data, size_t length,
+                                uint8_t* pixels, int stride);
 
        public:
         // Tamaño mínimo (headers sin datos)
-        // 2 header + 5 block header | 4 block length
+        // 2 header zlib | 4 checksum
         static const int IDAT_LENGTH_ZLIB = 2;
-        static const int IDAT_LENGTH_BLOCK = 5;
         static const int IDAT_LENGTH_CHECKSUM = 4;
 
-        uint8_t* blockData;
-        int blockLength;    // son 16b pero almacena todos bloques DEFLATE
-        uint32_t checksum;  // solo valido para el ultimo chunk
-        RGBColor*** pixelData;
-
-        IDATInfo() = default;
-        IDATInfo(int width, int height, RGBColor*** pixels);
-        uint32_t adler_checksum(uint8_t* data, uint32_t length);
-        bool process_pixels(int width, int height);
-        bool read_info(uint8_t* data, uint32_t length) override;
+        // Datos zlib de los chunks IDAT consecutivos, apuntando
+        // directamente al archivo (sin copiarlos)
+        std::vector<Inflater::Segment> segments;
+
+        uint32_t adler_checksum(const uint8_t* data, size_t length);
+        // Descomprime y escribe los pixeles directamente en pixels
+        // capacity: bytes disponibles a partir de pixels. Si caben los
+        // datos filtrados ((width * channels + 1) * height) y
+        // stride <= width * channels + 1, se descomprime sobre el propio
+        // buffer y se deshace el filtro ahí mismo, sin memoria adicional
+        bool process_pixels(int width, int height, int channels,
+                            uint8_t* pixels, int stride, size_t capacity = 0);
+        // Añade los datos de un chunk IDAT a segments
+        bool read_info(const uint8_t* data, uint32_t length) override;
+        // Los chunks IDAT se escriben con IDATEncoder (ver PNGWriter)
         bool get_writable_info(uint8_t*& data, uint32_t& length) override;
+
+        friend class IDATEncoder;
+    };
+
+    // Filtrado y compresión de las filas de una imagen en los datos zlib
+    // de los chunks IDAT, de una vez o por partes (ver PNGWriter): las
+    // partes seguidas forman un único stream zlib
+    // Cada parte se divide en franjas de filas de unos STRIP_BYTES, que se
+    // filtran y se comprimen en paralelo: cada franja es un trozo del
+    // stream DEFLATE que usa los datos anteriores como diccionario (ver
+    // Deflater::deflate). El Adler-32 y el CRC se combinan a partir de los
+    // de cada franja, sin volver a recorrer los datos
+    // Las franjas no dependen del número de hilos, así la salida tampoco
+    // Los hilos y sus Deflater se crean con el encoder y se reutilizan en
+    // cada llamada
+    class IDATEncoder {
+       public:
+        // Bytes (filtrados) aproximados de cada franja
+        static const int STRIP_BYTES = 1 << 20;
+
+        // numThreads <= 0: uno por núcleo de la CPU
+        IDATEncoder(int width, int channels, int level, int numThreads = 0);
+        // Filtra y comprime count filas, la fila i en rows + i * stride
+        // (stride < 0 para recorrer un buffer de abajo arriba)
+        // last: son las últimas filas de la imagen (después se puede empezar
+        // otra con el mismo encoder)
+        // Devuelve en data (length bytes) lo siguiente del stream zlib, con
+        // la cabecera delante en la primera parte y el Adler-32 detrás en la
+        // última, y en crc su CRC-32. data es memoria del encoder, válida
+        // hasta la siguiente llamada
+        void encode(const uint8_t* rows, int count, ptrdiff_t stride,
+                    bool last, uint8_t*& data, size_t& length,
+                    uint32_t& crc);
+
+       private:
+        // Datos filtrados anteriores que se guardan como diccionario de la
+        // parte siguiente (la ventana de DEFLATE)
+        static const int HISTORY_BYTES = 1 << 15;
+
+        int width, channels, level;
+        WorkerPool pool;
+        std::vector<Deflater> deflaters;  // uno por hilo de pool
+        bool started;
+        uint32_t adler;
+        std::vector<uint8_t> history;   // últimos datos filtrados
+        std::vector<uint8_t> priorRow;  // última fila, sin filtrar
+        // Memoria de cada llamada a encode: datos filtrados, franjas
+        // comprimidas y salida. Se vacía al empezar la siguiente
+        Arena arena;
     };
 
     class IENDInfo : public ChunkInfo {
        public:
-        bool read_info(uint8_t* data, uint32_t length) override;
+        bool read_info(const uint8_t* data, uint32_t length) override;
         bool get_writable_info(uint8_t*& data, uint32_t& length) override;
     };
 
     uint32_t length;
-    uint8_t* chunkType;
-    uint8_t* data;
+    const uint8_t* chunkType;  // apuntan al archivo leído, no se copian
+    const uint8_t* data;
     uint32_t crc;
     ChunkInfo* chunkInfo;
 
@@ -103,7 +173,14 @@ class PNGChunk {
     PNGChunk(ChunkInfo* _chunkInfo);
     ~PNGChunk();
 
-    bool read_file(std::ifstream& is);
+    // Lee el chunk que empieza en file[pos] y avanza pos hasta el siguiente
+    // Los chunks IDAT seguidos se leen juntos (ver IDATInfo::segments)
+    bool read_file(const uint8_t* file, size_t fileLength, size_t& pos);
     bool write_file(std::ofstream& os);
     bool is_type(const char* type);
+
+   private:
+    // chunkInfo es de este chunk: se borra con él
+    PNGChunk(const PNGChunk&) = delete;
+    PNGChunk& operator=(const PNGChunk&) = delete;
 };
\ No newline at end of file
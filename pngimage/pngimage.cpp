@@ -1,40 +1,111 @@
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
+#include "mappedfile.h"
 #include "pngchunk.h"
 #include "pngimage.h"
+#include "pngwriter.h"
 
-PNGImage::PNGImage() : width(0), height(0), pixels(nullptr) {}
+PNGImage::PNGImage()
+    : width(0),
+      height(0),
+      channels(3),
+      stride(0),
+      buffer(nullptr),
+      pixels(nullptr) {}
 
-PNGImage::PNGImage(int width, int height, const RGBColor& backgroundColor) {
-    this->width = width;
-    this->height = height;
-    this->pixels = new RGBColor**[height];
-    for (int h = 0; h < height; h++) {
-        this->pixels[h] = new RGBColor*[width];
-        for (int w = 0; w < width; w++) {
-            this->pixels[h][w] = new RGBColor(backgroundColor);
+PNGImage::PNGImage(int width, int height, const RGBColor& backgroundColor,
+                   int channels, int rowAlignment)
+    : buffer(nullptr), pixels(nullptr) {
+    allocate(width, height, channels, rowAlignment);
+    fill(backgroundColor);
+}
+
+PNGImage::PNGImage(const PNGImage& other) : buffer(nullptr), pixels(nullptr) {
+    *this = other;
+}
+
+PNGImage& PNGImage::operator=(const PNGImage& other) {
+    if (this != &other) {
+        release();
+        this->width = other.width;
+        this->height = other.height;
+        this->channels = other.channels;
+        this->stride = other.stride;
+        if (other.pixels != nullptr) {
+            this->buffer = new uint8_t[other.size_bytes() + BUFFER_ALIGNMENT];
+            this->pixels = this->buffer + (-(uintptr_t)this->buffer &
+                                           (BUFFER_ALIGNMENT - 1));
+            memcpy(this->pixels, other.pixels, other.size_bytes());
         }
     }
+    return *this;
 }
 
+// Reserva un único bloque de memoria para toda la imagen
+// Cada fila ocupa stride bytes, múltiplo de rowAlignment
+void PNGImage::allocate(int width, int height, int channels,
+                        int rowAlignment, size_t extraBytes) {
+    release();
+    this->width = width;
+    this->height = height;
+    this->channels = channels;
+    size_t rowBytes = (size_t)width * channels;
+    if (rowAlignment < 1) rowAlignment = 1;
+    this->stride =
+        (rowBytes + rowAlignment - 1) / rowAlignment * rowAlignment;
+    // Memoria sin inicializar, quien reserva se encarga de rellenarla
+    this->buffer = new uint8_t[size_bytes() + extraBytes + BUFFER_ALIGNMENT];
+    this->pixels =
+        this->buffer + (-(uintptr_t)this->buffer & (BUFFER_ALIGNMENT - 1));
+}
+
+void PNGImage::wrap(uint8_t* pixels, int width, int height, int channels,
+                    int stride) {
+    release();
+    this->width = width;
+    this->height = height;
+    this->channels = channels;
+    this->stride = stride;
+    this->pixels = pixels;
+}
+
+void PNGImage::swap(PNGImage& other) {
+    std::swap(this->width, other.width);
+    std::swap(this->height, other.height);
+    std::swap(this->channels, other.channels);
+    std::swap(this->stride, other.stride);
+    std::swap(this->buffer, other.buffer);
+    std::swap(this->pixels, other.pixels);
+}
+
+void PNGImage::release() {
+    delete[] this->buffer;
+    this->buffer = nullptr;
+    this->pixels = nullptr;
+    this->width = 0;
+    this->height = 0;
+    this->stride = 0;
+}
+
+// El archivo se proyecta en memoria y los chunks se leen sin copiarlos:
+// los datos de los chunks IDAT se descomprimen directamente desde el archivo
+// sobre el buffer de la imagen, que se reserva con height bytes de más para
+// que quepan los bytes de filtro de cada fila
 bool PNGImage::read_png_file(const char* filename) {
-    std::ifstream is(filename, std::ios::binary);
-    if (!is.is_open()) {
-        std::cerr << "Can't open file " << filename << std::endl;
-        is.close();
+    MappedFile file;
+    if (!file.open(filename)) {
         return false;
     }
+    const uint8_t* bytes = file.data();
     // Comparar la cabecera del archivo para verificar que es PNG
-    uint8_t header[HEADER_LENGTH];
-    is.read((char*)header, HEADER_LENGTH);
-    if (!is.good()) {
+    if (file.size() < HEADER_LENGTH) {
         std::cerr << "Can't read header for " << filename << std::endl;
-        is.close();
         return false;
     } else {
         for (int i = 0; i < HEADER_LENGTH; i++) {
-            if (header[i] != HEADER_SIGNATURE[i]) {
+            if (bytes[i] != HEADER_SIGNATURE[i]) {
                 std::cerr << "File " << filename
                           << " is not recognized as a PNG file" << std::endl;
                 std::cerr << "Expected header: ";
@@ -43,30 +114,27 @@ bool PNGImage::read_png_file(const char* filename) {
                 }
                 std::cerr << std::endl << "Instead got: ";
                 for (int j = 0; j < HEADER_LENGTH; j++) {
-                    std::cerr << std::hex << int(header[j]) << " ";
+                    std::cerr << std::hex << int(bytes[j]) << " ";
                 }
                 std::cerr << std::endl;
-                is.close();
                 return false;
             }
         }
     }
 
     // Leer información de la imagen, chunk a chunk
+    size_t pos = HEADER_LENGTH;
     bool endChunkRead = false;
     bool headerChunkRead = false;
     bool isImageOk = true;  // lectura ha ido bien
-    int pixelX = 0;         // ej: imagen 2x2, el pixel (1, 1) (abajo derecha)
-    int pixelY = 0;         // corresponde con pixelX = 1, pixelY = 1
     while (isImageOk && !endChunkRead) {
         PNGChunk chunk;
-        if (!is.good() || !chunk.read_file(is)) {
-            if (is.eof()) {
-                std::cerr << "Warning: finished reading without IEND chunk"
-                          << std::endl;
-            } else {
-                std::cerr << "Read invalid chunk, stopping" << std::endl;
-            }
+        if (pos >= file.size()) {
+            std::cerr << "Warning: finished reading without IEND chunk"
+                      << std::endl;
+            isImageOk = false;
+        } else if (!chunk.read_file(bytes, file.size(), pos)) {
+            std::cerr << "Read invalid chunk, stopping" << std::endl;
             isImageOk = false;
         } else {
             if (chunk.is_type("IHDR")) {
@@ -75,8 +143,8 @@ bool PNGImage::read_png_file(const char* filename) {
                 // Solo se da soporte a imagenes PNG sencillas (solo color, sin
                 // paletas ni alpha)
                 if (info->is_supported()) {
-                    this->width = info->width;
-                    this->height = info->height;
+                    allocate(info->width, info->height, info->channels(), 1,
+                             info->height);
                     headerChunkRead = true;
                 } else {
                     isImageOk = false;
@@ -85,8 +153,9 @@ bool PNGImage::read_png_file(const char* filename) {
                 if (chunk.is_type("IDAT")) {
                     PNGChunk::IDATInfo* info =
                         dynamic_cast<PNGChunk::IDATInfo*>(chunk.chunkInfo);
-                    isImageOk = info->process_pixels(width, height);
-                    this->pixels = info->pixelData;
+                    isImageOk = info->process_pixels(
+                        width, height, channels, pixels, stride,
+                        size_bytes() + (size_t)height);
                 } else if (chunk.is_type("IEND")) {
                     endChunkRead = true;
                 } else {
@@ -103,62 +172,36 @@ bool PNGImage::read_png_file(const char* filename) {
 
     // Evitar acceso a los datos de la imagen si no se ha leido correctamente
     if (!isImageOk) {
-        this->width = 0;
-        this->height = 0;
+        release();
     }
 
     return isImageOk;
 }
 
-// Escribe los chunks mínimos para poder ver la imagen
-// - Chunk IHDR (24 bit RGB, color, sin paletas)
-// - Chunk(s) IDAT (tamaño maximo 8192 bits)
-//   24 bits por pixel (RGB)
-//   Sin ningún tipo de filtrado ni compresión
+// Escribe los chunks mínimos para poder ver la imagen (ver PNGWriter)
+// - Chunk IHDR (24 bit RGB o 32 bit RGBA, color, sin paletas)
+// - Chunk IDAT
+//   24 bits por pixel (RGB) o 32 bits por pixel (RGBA)
+//   Filtro adaptativo por fila y compresión DEFLATE de nivel
+//   compressionLevel (0: sin filtrado ni compresión), por franjas en
+//   numThreads hilos
 // - Chunk IEND
-bool PNGImage::write_png_file(const char* filename) {
-    std::ofstream os(filename, std::ios::binary);
-    if (!os.is_open()) {
-        std::cerr << "Can't open file " << filename << std::endl;
-        os.close();
-        return false;
-    }
-    // Header archivo PNG
-    os.write((char*)HEADER_SIGNATURE, HEADER_LENGTH);
-    // Chunk IHDR
-    PNGChunk::IHDRInfo* infoIHDR = new PNGChunk::IHDRInfo(width, height);
-    PNGChunk chunkIHDR(infoIHDR);
-    if (!chunkIHDR.write_file(os)) {
-        std::cerr << "An error ocurred while writing the IHDR chunk"
-                  << std::endl;
-        return false;
-    }
-    // Chunk IDAT (se escribe en un unico chunk)
-    PNGChunk::IDATInfo* infoIDAT =
-        new PNGChunk::IDATInfo(width, height, pixels);
-    PNGChunk chunkIDAT(infoIDAT);
-    if (!chunkIDAT.write_file(os)) {
-        std::cerr << "An error ocurred while writing the IDAT chunk"
-                  << std::endl;
-        return false;
-    }
-    // Chunk IEND
-    PNGChunk::IENDInfo* infoIEND = new PNGChunk::IENDInfo();
-    PNGChunk chunkIEND(infoIEND);
-    if (!chunkIEND.write_file(os)) {
-        std::cerr << "An error ocurred while writing the IEND chunk"
-                  << std::endl;
-        return false;
-    }
-
-    return true;
+bool PNGImage::write_png_file(const char* filename, int compressionLevel,
+                              int numThreads) {
+    PNGWriter writer;
+    return writer.open(filename, width, height, channels, compressionLevel,
+                       numThreads) &&
+           writer.write_rows(pixels, height, stride) && writer.close();
 }
 
 // Si devuelve true, color toma el valor del pixel
 // en la posicion (x, y) de la imagen
-bool PNGImage::get_pixel(int x, int y, RGBColor& color) {
+bool PNGImage::get_pixel(int x, int y, RGBColor& color) const {
     if (x >= 0 && x < this->width && y >= 0 && y < this->height) {
-        color.set_values(*pixels[y][x]);
+        const uint8_t* p = span(x, y);
+        color.r = p[0];
+        color.g = p[1];
+        color.b = p[2];
         return true;
     } else {
         return false;
@@ -166,45 +209,54 @@ bool PNGImage::get_pixel(int x, int y, RGBColor& color) {
 }
 
 // Si las coordenadas (x, y) pertenecen a la foto (no se salen),
-// modifica el color de dicho pixel
+// modifica el color de dicho pixel (alpha opaco si es RGBA)
 void PNGImage::set_pixel(int x, int y, const RGBColor& color) {
     if (x >= 0 && x < this->width && y >= 0 && y < this->height) {
-        pixels[y][x] = new RGBColor(color);
+        uint8_t* p = span(x, y);
+        p[0] = color.r;
+        p[1] = color.g;
+        p[2] = color.b;
+        if (this->channels == 4) p[3] = 0xFF;
     }
 }
 
-// Volteo vertical
-void PNGImage::flip_vertically() {
+// Rellena toda la imagen con un color: se construye la primera fila
+// y se copia al resto
+void PNGImage::fill(const RGBColor& color) {
+    if (this->height == 0) return;
     for (int x = 0; x < this->width; x++) {
-        for (int y = 0; y < this->height / 2; y++) {
-            RGBColor leftColor, rightColor;
-            this->get_pixel(x, y, leftColor);
-            this->get_pixel(x, this->height - y, rightColor);
-            this->set_pixel(x, this->height - y, leftColor);
-            this->set_pixel(x, y, rightColor);
-        }
+        set_pixel(x, 0, color);
+    }
+    for (int y = 1; y < this->height; y++) {
+        memcpy(row(y), row(0), (size_t)this->width * this->channels);
+    }
+}
+
+// Volteo vertical (intercambio de filas completas)
+void PNGImage::flip_vertically() {
+    size_t rowBytes = (size_t)this->width * this->channels;
+    uint8_t* aux = new uint8_t[rowBytes];
+    for (int y = 0; y < this->height / 2; y++) {
+        uint8_t* top = row(y);
+        uint8_t* bottom = row(this->height - 1 - y);
+        memcpy(aux, top, rowBytes);
+        memcpy(top, bottom, rowBytes);
+        memcpy(bottom, aux, rowBytes);
     }
+    delete[] aux;
 }
 
 // Volteo horizontal
 void PNGImage::flip_horizontally() {
     for (int y = 0; y < this->height; y++) {
-        for (int x = 0; x < this->width / 2; x++) {
-            RGBColor leftColor, rightColor;
-            this->get_pixel(x, y, leftColor);
-            this->get_pixel(this->width - x, y, rightColor);
-            this->set_pixel(this->width - x, y, leftColor);
-            this->set_pixel(x, y, rightColor);
+        uint8_t* left = row(y);
+        uint8_t* right = span(this->width - 1, y);
+        for (; left < right; left += channels, right -= channels) {
+            for (int c = 0; c < this->channels; c++) {
+                std::swap(left[c], right[c]);
+            }
         }
     }
 }
 
-PNGImage::~PNGImage() {
-    for (int h = 0; h < this->height; h++) {
-        for (int w = 0; w < this->width; w++) {
-            delete this->pixels[h][w];
-        }
-        delete[] this->pixels[h];
-    }
-    delete[] this->pixels;
-}
\ No newline at end of file
+PNGImage::~PNGImage() { release(); }
@@ -1,29 +1,61 @@
 #pragma once
 
 #include <stdint.h>
+#include <cstddef>
 #include <cstring>
 #include "pngchunk.h"
 #include "rgbcolor.h"
 
 // Métodos de apoyo para la lectura/escritura de imágenes PNG y su modificación
 // Referencia: https://en.wikipedia.org/wiki/Portable_Network_Graphics
-// De momento solo soporta imágenes sin paleta de colores ni alpha
+// De momento solo soporta imágenes sin paleta de colores, RGB o RGBA
 // y con 8 bits de profundidad de color
 class PNGImage {
    public:
     int width;
     int height;
+    int channels;  // bytes por pixel: 3 (RGB) o 4 (RGBA)
+    int stride;    // bytes por fila, >= width * channels (puede tener relleno)
 
     PNGImage();
     PNGImage(int width, int height,
-             const RGBColor& backgroundColor = RGBColor::White);
+             const RGBColor& backgroundColor = RGBColor::White,
+             int channels = 3, int rowAlignment = 1);
+    PNGImage(const PNGImage& other);
+    PNGImage& operator=(const PNGImage& other);
     ~PNGImage();
     bool read_png_file(const char* filename);
-    bool write_png_file(const char* filename);
-    bool get_pixel(int x, int y, RGBColor& color);
+    // compressionLevel: 0 (sin compresión) a 9 (máxima), ver Deflater
+    // numThreads: hilos para comprimir las imágenes grandes por franjas
+    // (<= 0: uno por núcleo), ver PNGChunk::IDATEncoder
+    bool write_png_file(const char* filename,
+                        int compressionLevel = Deflater::DEFAULT_LEVEL,
+                        int numThreads = 0);
+    bool get_pixel(int x, int y, RGBColor& color) const;
     void set_pixel(int x, int y, const RGBColor& color);
+    void fill(const RGBColor& color);
     void flip_vertically();
     void flip_horizontally();
+    // Usa memoria externa (p.ej. un archivo proyectado) como imagen, sin
+    // copiarla ni liberarla: debe seguir siendo válida mientras se use
+    void wrap(uint8_t* pixels, int width, int height, int channels,
+              int stride);
+    // Intercambia el contenido (tamaño y memoria) con other, sin copiarlo
+    void swap(PNGImage& other);
+
+    // Acceso directo a la memoria de la imagen (sin comprobar límites)
+    // row(y)[x * channels + c] = canal c del pixel (x, y)
+    inline uint8_t* row(int y) { return pixels + (size_t)y * stride; }
+    inline const uint8_t* row(int y) const {
+        return pixels + (size_t)y * stride;
+    }
+    inline uint8_t* span(int x, int y) { return row(y) + x * channels; }
+    inline const uint8_t* span(int x, int y) const {
+        return row(y) + x * channels;
+    }
+    inline uint8_t* data() { return pixels; }
+    inline const uint8_t* data() const { return pixels; }
+    inline size_t size_bytes() const { return (size_t)height * stride; }
 
    private:
     // Todos los archivos PNG tienen comienzan con estos 8 bytes (ver
@@ -31,7 +63,17 @@ class PNGImage {
     const static int HEADER_LENGTH = 8;
     const uint8_t HEADER_SIGNATURE[HEADER_LENGTH] = {0x89, 0x50, 0x4E, 0x47,
                                                      0x0D, 0x0A, 0x1A, 0x0A};
+    // Alineamiento del inicio del buffer (línea de caché / registros SIMD)
+    const static int BUFFER_ALIGNMENT = 64;
+
+    // Buffer contiguo fila a fila: pixels[y * stride + x * channels]
+    // buffer es la reserva real, pixels apunta a su inicio alineado
+    // (buffer es nullptr si la memoria es externa, ver wrap)
+    uint8_t* buffer;
+    uint8_t* pixels;
 
-    // pixels[y][x] = color del pixel (x, y) de la imagen
-    RGBColor*** pixels;
-};
\ No newline at end of file
+    // extraBytes: reserva adicional tras la última fila (ver read_png_file)
+    void allocate(int width, int height, int channels, int rowAlignment,
+                  size_t extraBytes = 0);
+    void release();
+};
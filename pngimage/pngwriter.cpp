@@ -0,0 +1,115 @@
+#include "pngwriter.h"
+
+#include <iostream>
+
+#include "checksum.h"
+
+// Los mismos 8 bytes que comprueba PNGImage::read_png_file
+static const uint8_t PNG_SIGNATURE[8] = {0x89, 0x50, 0x4E, 0x47,
+                                         0x0D, 0x0A, 0x1A, 0x0A};
+
+static void write_big_endian(std::ofstream& os, uint32_t value) {
+    uint8_t bytes[4] = {(uint8_t)(value >> 24), (uint8_t)(value >> 16),
+                        (uint8_t)(value >> 8), (uint8_t)value};
+    os.write((char*)bytes, 4);
+}
+
+PNGWriter::PNGWriter()
+    : width(0),
+      height(0),
+      rowsWritten(0),
+      ok(false),
+      encoder(nullptr) {}
+
+PNGWriter::~PNGWriter() { delete encoder; }
+
+bool PNGWriter::open(const char* filename, int width, int height,
+                     int channels, int compressionLevel, int numThreads) {
+    delete encoder;
+    encoder = nullptr;
+    this->filename = filename;
+    this->width = width;
+    this->height = height;
+    this->rowsWritten = 0;
+    os.open(filename, std::ios::binary);
+    ok = os.is_open();
+    if (!ok) {
+        std::cerr << "Can't open file " << filename << std::endl;
+        return false;
+    }
+    os.write((char*)PNG_SIGNATURE, sizeof(PNG_SIGNATURE));
+    PNGChunk chunkIHDR(new PNGChunk::IHDRInfo(width, height, channels));
+    if (!chunkIHDR.write_file(os)) {
+        std::cerr << "An error ocurred while writing the IHDR chunk"
+                  << std::endl;
+        ok = false;
+        return false;
+    }
+    encoder = new PNGChunk::IDATEncoder(width, channels, compressionLevel,
+                                        numThreads);
+    return true;
+}
+
+bool PNGWriter::write_rows(const uint8_t* rows, int count,
+                           ptrdiff_t stride) {
+    if (!ok || count <= 0) return ok;
+    if (rowsWritten + count > height) {
+        std::cerr << "Too many rows for " << filename << std::endl;
+        ok = false;
+        return false;
+    }
+    rowsWritten += count;
+    uint8_t* data;
+    size_t length;
+    uint32_t crc;
+    encoder->encode(rows, count, stride, rowsWritten == height, data, length,
+                    crc);
+    // Un chunk IDAT con los datos comprimidos de las filas, o varios si no
+    // caben en uno. Con uno solo el CRC se combina con el que calcula el
+    // encoder (sin volver a recorrer los datos)
+    const uint32_t typeCrc = Checksum::crc32(0, (const uint8_t*)"IDAT", 4);
+    if (length <= MAX_CHUNK_LENGTH) {
+        write_idat(data, length,
+                   Checksum::crc32_combine(typeCrc, crc, length));
+    } else {
+        for (size_t pos = 0; pos < length; pos += MAX_CHUNK_LENGTH) {
+            size_t n = length - pos < MAX_CHUNK_LENGTH ? length - pos
+                                                       : MAX_CHUNK_LENGTH;
+            write_idat(&data[pos], n, Checksum::crc32(typeCrc, &data[pos], n));
+        }
+    }
+    ok = !os.fail();
+    if (!ok) {
+        std::cerr << "An error ocurred while writing the IDAT chunk"
+                  << std::endl;
+    }
+    return ok;
+}
+
+void PNGWriter::write_idat(const uint8_t* data, size_t length, uint32_t crc) {
+    write_big_endian(os, length);
+    os.write("IDAT", 4);
+    os.write((const char*)data, length);
+    write_big_endian(os, crc);
+}
+
+bool PNGWriter::close() {
+    if (ok && rowsWritten != height) {
+        std::cerr << "Missing rows in " << filename << ": " << rowsWritten
+                  << " of " << height << std::endl;
+        ok = false;
+    }
+    if (ok) {
+        PNGChunk chunkIEND(new PNGChunk::IENDInfo());
+        if (!chunkIEND.write_file(os)) {
+            std::cerr << "An error ocurred while writing the IEND chunk"
+                      << std::endl;
+            ok = false;
+        }
+    }
+    os.close();
+    ok = ok && !os.fail();
+    delete encoder;
+    encoder = nullptr;
+    return ok;
+}
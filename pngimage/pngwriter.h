@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include "pngchunk.h"
+
+// Escritura de una imagen PNG por partes, sin tenerla entera en memoria:
+// cada llamada a write_rows filtra y comprime sus filas (ver
+// PNGChunk::IDATEncoder) y las escribe en un chunk IDAT propio (o en varios
+// si no caben en uno)
+// Las filas se dan en el orden del archivo, de arriba abajo
+class PNGWriter {
+   public:
+    PNGWriter();
+    ~PNGWriter();
+    // Crea el archivo y escribe la cabecera y el chunk IHDR
+    // compressionLevel y numThreads: ver PNGImage::write_png_file
+    bool open(const char* filename, int width, int height, int channels = 3,
+              int compressionLevel = Deflater::DEFAULT_LEVEL,
+              int numThreads = 0);
+    // Escribe las count filas siguientes, la fila i en rows + i * stride
+    // (stride < 0 para recorrer un buffer de abajo arriba)
+    bool write_rows(const uint8_t* rows, int count, ptrdiff_t stride);
+    // Escribe el chunk IEND, false si faltan filas o ha fallado algo
+    bool close();
+    int rows_written() const { return rowsWritten; }
+
+   private:
+    // Datos de un chunk como mucho (la longitud se guarda en 31 bits)
+    static const size_t MAX_CHUNK_LENGTH = 0x7FFFFFFF;
+
+    std::ofstream os;
+    std::string filename;
+    int width, height;
+    int rowsWritten;
+    bool ok;
+    PNGChunk::IDATEncoder* encoder;
+
+    void write_idat(const uint8_t* data, size_t length, uint32_t crc);
+
+    PNGWriter(const PNGWriter&) = delete;
+    PNGWriter& operator=(const PNGWriter&) = delete;
+};
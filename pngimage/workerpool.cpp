@@ -0,0 +1,60 @@
+#include "workerpool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(int numThreads)
+    : numThreads(numThreads),
+      task(nullptr),
+      taskData(nullptr),
+      generation(0),
+      pending(0),
+      stopping(false) {
+    if (this->numThreads <= 0) {
+        this->numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int t = 1; t < this->numThreads; t++) {
+        workers.push_back(std::thread(&WorkerPool::work, this, t));
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskReady.notify_all();
+    for (std::thread& t : workers) t.join();
+}
+
+void WorkerPool::run_task(void (*task)(void*, int), void* data) {
+    if (!workers.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->task = task;
+            taskData = data;
+            pending = workers.size();
+            generation++;
+        }
+        taskReady.notify_all();
+    }
+    task(data, 0);
+    if (!workers.empty()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        taskDone.wait(lock, [this] { return pending == 0; });
+    }
+}
+
+void WorkerPool::work(int thread) {
+    uint64_t done = 0;  // última tarea hecha por este hilo
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        taskReady.wait(lock,
+                       [&] { return stopping || generation != done; });
+        if (stopping) return;
+        done = generation;
+        lock.unlock();
+        task(taskData, thread);
+        lock.lock();
+        if (--pending == 0) taskDone.notify_one();
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Hilos que se crean una vez y se reutilizan en cada run(f): el hilo que
+// llama hace f(0) y cada uno de los demás f(t), y run vuelve cuando han
+// terminado todos
+// Lanzar la tarea no reserva memoria (ni crea hilos), así se puede usar en
+// cada fase de cada dibujo
+class WorkerPool {
+   public:
+    // numThreads <= 0: uno por núcleo de la CPU (contando el que llama)
+    explicit WorkerPool(int numThreads = 0);
+    ~WorkerPool();
+    int threads() const { return numThreads; }
+
+    template <typename F>
+    void run(F&& f) {
+        typedef typename std::remove_reference<F>::type Task;
+        run_task(&call<Task>, (void*)&f);
+    }
+
+   private:
+    int numThreads;
+    std::vector<std::thread> workers;
+
+    // Todo lo siguiente se protege con mutex
+    std::mutex mutex;
+    std::condition_variable taskReady;  // hay una tarea nueva (o terminar)
+    std::condition_variable taskDone;   // han terminado todos los hilos
+    void (*task)(void* f, int thread);
+    void* taskData;
+    uint64_t generation;  // tareas lanzadas
+    int pending;          // hilos que no han terminado la tarea actual
+    bool stopping;
+
+    template <typename F>
+    static void call(void* f, int thread) {
+        (*(F*)f)(thread);
+    }
+    void run_task(void (*task)(void*, int), void* data);
+    void work(int thread);
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+};
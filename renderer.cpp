@@ -0,0 +1,492 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+static inline uint64_t pack_range(uint32_t begin, uint32_t end) {
+    return (uint64_t)end << 32 | begin;
+}
+
+// Recorte en coordenadas homogéneas (antes de dividir entre w)
+// Plano cercano: w mínimo, para no dividir entre 0 ni dibujar lo que queda
+// detrás de la cámara
+static const float NEAR_W = 1e-3f;
+// Guard band: los vértices con |x| o |y| mayor que CLIP_GUARD * w se
+// recortan, así llegan a triangle() dentro de GUARD_BAND (con margen para
+// los errores de redondeo)
+static const float CLIP_GUARD = GUARD_BAND / 2;
+
+// Planos de recorte (bits de los outcodes)
+enum ClipPlane {
+    CLIP_NEAR = 1,
+    CLIP_LEFT = 2,
+    CLIP_RIGHT = 4,
+    CLIP_BOTTOM = 8,
+    CLIP_TOP = 16,
+    NUM_CLIP_PLANES = 5
+};
+
+// Distancia con signo de p al plano (>= 0: lado visible)
+static inline float clip_distance(const Vec4f& p, int plane) {
+    switch (plane) {
+        case CLIP_NEAR: return p.w - NEAR_W;
+        case CLIP_LEFT: return p.x + CLIP_GUARD * p.w;
+        case CLIP_RIGHT: return CLIP_GUARD * p.w - p.x;
+        case CLIP_BOTTOM: return p.y + CLIP_GUARD * p.w;
+        default: return CLIP_GUARD * p.w - p.y;
+    }
+}
+
+// Planos de recorte que p no cumple
+static inline int clip_outcode(const Vec4f& p) {
+    int code = 0;
+    for (int plane = 1; plane < 1 << NUM_CLIP_PLANES; plane <<= 1) {
+        if (!(clip_distance(p, plane) >= 0.0f)) code |= plane;
+    }
+    return code;
+}
+
+// Lados de la imagen (centros de pixel entre 0 y width - 1) que p deja
+// fuera, más el plano cercano. Si todos los vértices dejan fuera el mismo,
+// el triángulo no toca la imagen
+static inline int frustum_outcode(const Vec4f& p, int width, int height) {
+    int code = p.w < NEAR_W ? CLIP_NEAR : 0;
+    if (p.x < 0.0f) code |= CLIP_LEFT;
+    if (p.x > (width - 1) * p.w) code |= CLIP_RIGHT;
+    if (p.y < 0.0f) code |= CLIP_BOTTOM;
+    if (p.y > (height - 1) * p.w) code |= CLIP_TOP;
+    return code;
+}
+
+// Vértice del polígono recortado: posición y pesos de los 3 vértices de la
+// cara (para interpolar los varyings). source: vértice de la cara si es uno
+// de ellos, -1 si lo ha creado el recorte
+struct ClipVertex {
+    Vec4f pos;
+    Vec3f weights;
+    int source;
+};
+
+// Cada plano añade como mucho un vértice al polígono
+static const int MAX_CLIP_VERTICES = 3 + NUM_CLIP_PLANES;
+
+// Sutherland-Hodgman: recorta el polígono in (count vértices) contra los
+// planos de planes, devuelve el número de vértices (0: nada visible)
+static int clip_polygon(ClipVertex* in, int count, int planes) {
+    ClipVertex buffer[MAX_CLIP_VERTICES];
+    ClipVertex *src = in, *dst = buffer;
+    for (int plane = 1; plane < 1 << NUM_CLIP_PLANES; plane <<= 1) {
+        if (!(planes & plane)) continue;
+        int n = 0;
+        for (int i = 0; i < count; i++) {
+            const ClipVertex& a = src[i];
+            const ClipVertex& b = src[(i + 1) % count];
+            float da = clip_distance(a.pos, plane);
+            float db = clip_distance(b.pos, plane);
+            if (da >= 0.0f) dst[n++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                float t = da / (da - db);
+                ClipVertex& v = dst[n++];
+                v.pos = a.pos + (b.pos - a.pos) * t;
+                v.weights = a.weights + (b.weights - a.weights) * t;
+                v.source = -1;
+            }
+        }
+        count = n;
+        if (count < 3) return 0;
+        std::swap(src, dst);
+    }
+    if (src != in) std::copy(src, src + count, in);
+    return count;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+TileRenderer::TileRenderer(int numThreads)
+    : pool(numThreads),
+      numThreads(pool.threads()),
+      cullBackFaces(true),
+      mode(IMMEDIATE),
+      width(0),
+      height(0),
+      bandY0(0),
+      tilesX(0),
+      tilesY(0),
+      varyingCount(0) {
+    memset(&lastStats, 0, sizeof(lastStats));
+    threadData.resize(this->numThreads);
+    work = new WorkRange[this->numThreads];
+}
+
+TileRenderer::~TileRenderer() {
+    delete[] work;
+}
+
+void TileRenderer::draw_shaders(const Model& model, IShader* const* shaders,
+                                const ShaderStages& stages, PNGImage& image,
+                                ZBuffer& zbuffer) {
+    prepare(model, shaders, stages, image.width, image.height);
+    raster(shaders, stages, 0, image.height, image, zbuffer);
+    finish_stats();
+}
+
+bool TileRenderer::check_band(int width, const PNGImage& band,
+                              const ZBuffer& zbuffer) const {
+    if (band.height <= 0 || band.height % TILE_SIZE != 0 ||
+        band.width < width || zbuffer.width < width ||
+        zbuffer.height < band.height) {
+        std::cerr << "Invalid band of " << band.width << "x" << band.height
+                  << " pixels (the height must be a multiple of "
+                  << TILE_SIZE << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void TileRenderer::prepare(const Model& model, IShader* const* shaders,
+                           const ShaderStages& stages, int width,
+                           int height) {
+    int nverts = model.nverts(), nfaces = model.nfaces();
+    memset(&lastStats, 0, sizeof(lastStats));
+    lastStats.corners = 3 * (int64_t)nfaces;
+    lastStats.vertices = nverts;
+    lastStats.faces = nfaces;
+
+    // Fase 1: vértices, cada hilo un trozo
+    Clock::time_point start = Clock::now();
+    varyingCount = shaders[0]->varying_count();
+    positions.resize(nverts);
+    varyings.resize((size_t)nverts * varyingCount);
+    pool.run([&](int t) {
+        int begin = (int64_t)nverts * t / numThreads;
+        int end = (int64_t)nverts * (t + 1) / numThreads;
+        stages.vertices(*shaders[t], begin, end, positions.data(),
+                        varyings.data());
+    });
+    lastStats.vertexTime = seconds_since(start);
+
+    // Fase 2: ensamblado y reparto en celdas, cada hilo un trozo de las
+    // caras
+    start = Clock::now();
+    this->width = width;
+    this->height = height;
+    tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    pool.run([&](int t) {
+        assemble(t, (int64_t)nfaces * t / numThreads,
+                 (int64_t)nfaces * (t + 1) / numThreads, model);
+    });
+    sort_bins();
+    lastStats.binTime = seconds_since(start);
+}
+
+// Ordenación por cuentas de las celdas de todos los hilos: contar los
+// triángulos de cada celda, acumular y colocar cada uno en su sitio,
+// recorriendo los hilos en orden para que cada celda quede en el de las
+// caras
+void TileRenderer::sort_bins() {
+    int numTiles = tilesX * tilesY;
+    tileStart.assign(numTiles + 1, 0);
+    for (const ThreadData& data : threadData) {
+        for (const TileEntry& entry : data.entries) {
+            tileStart[entry.tile + 1]++;
+        }
+    }
+    for (int tile = 0; tile < numTiles; tile++) {
+        tileStart[tile + 1] += tileStart[tile];
+    }
+    tileTriangles.resize(tileStart[numTiles]);
+    for (int t = 0; t < numThreads; t++) {
+        for (const TileEntry& entry : threadData[t].entries) {
+            TileTriangle& out = tileTriangles[tileStart[entry.tile]++];
+            out.thread = t;
+            out.index = entry.index;
+        }
+    }
+    // Tras colocarlos cada tileStart[tile] es el principio de la celda
+    // siguiente
+    for (int tile = numTiles; tile > 0; tile--) {
+        tileStart[tile] = tileStart[tile - 1];
+    }
+    tileStart[0] = 0;
+}
+
+void TileRenderer::raster(IShader* const* shaders, const ShaderStages& stages,
+                          int y0, int y1, PNGImage& image,
+                          ZBuffer& zbuffer) {
+    // Fase 3: dibujar las celdas con algún triángulo, al principio cada hilo
+    // un trozo consecutivo
+    Clock::time_point start = Clock::now();
+    bandY0 = y0;
+    tileOrder.clear();
+    int firstTile = y0 / TILE_SIZE * tilesX;
+    int lastTile = (y1 + TILE_SIZE - 1) / TILE_SIZE * tilesX;
+    for (int tile = firstTile; tile < lastTile; tile++) {
+        if (tileStart[tile] != tileStart[tile + 1]) tileOrder.push_back(tile);
+    }
+    uint32_t count = tileOrder.size();
+    for (int t = 0; t < numThreads; t++) {
+        work[t].range.store(
+            pack_range((uint64_t)count * t / numThreads,
+                       (uint64_t)count * (t + 1) / numThreads));
+    }
+    bool deferred = mode == DEFERRED && !stages.canDiscard;
+    pool.run([&](int t) {
+        int tile;
+        while (next_tile(t, tile)) {
+            if (deferred) {
+                draw_tile_deferred(tile, t, *shaders[t], stages, image,
+                                   zbuffer);
+            } else {
+                draw_tile(tile, t, *shaders[t], stages, image, zbuffer);
+            }
+        }
+    });
+    lastStats.rasterTime += seconds_since(start);
+}
+
+void TileRenderer::finish_stats() {
+    for (const ThreadData& data : threadData) {
+        lastStats.culledFrustum += data.counters.culledFrustum;
+        lastStats.clipped += data.counters.clipped;
+        lastStats.culledBackFace += data.counters.culledBackFace;
+        lastStats.culledSmall += data.counters.culledSmall;
+        lastStats.triangles += data.counters.triangles;
+        lastStats.fragments += data.raster.fragments;
+        lastStats.occluded += data.raster.occluded;
+        lastStats.shaded += data.raster.shaded;
+        lastStats.occludedTriangles += data.raster.occludedTriangles;
+        lastStats.invocations += data.raster.invocations;
+    }
+}
+
+void TileRenderer::assemble(int thread, int begin, int end,
+                            const Model& model) {
+    ThreadData& data = threadData[thread];
+    data.triangles.clear();
+    data.entries.clear();
+    data.clippedVaryings.clear();
+    memset(&data.counters, 0, sizeof(data.counters));
+    memset(&data.raster, 0, sizeof(data.raster));
+    for (int iface = begin; iface < end; iface++) {
+        const uint32_t* face = model.face(iface);
+        const Vec4f* p[3];
+        int outside = ~0, clip = 0;
+        for (int j = 0; j < 3; j++) {
+            p[j] = &positions[face[j]];
+            outside &= frustum_outcode(*p[j], width, height);
+            clip |= clip_outcode(*p[j]);
+        }
+        if (outside) {
+            data.counters.culledFrustum++;
+            continue;
+        }
+        uint32_t triVaryings[3];
+        Vec3f pts[3];
+        if (!clip) {
+            for (int j = 0; j < 3; j++) {
+                triVaryings[j] = face[j] * varyingCount;
+                pts[j] = p[j]->dehomogenize();
+            }
+            bin_triangle(data, pts, triVaryings);
+            continue;
+        }
+
+        // Recortar contra los planos que cruza y dibujar el polígono
+        // resultante como abanico de triángulos desde su primer vértice
+        data.counters.clipped++;
+        ClipVertex polygon[MAX_CLIP_VERTICES];
+        for (int j = 0; j < 3; j++) {
+            polygon[j].pos = *p[j];
+            polygon[j].weights = Vec3f(j == 0, j == 1, j == 2);
+            polygon[j].source = j;
+        }
+        int count = clip_polygon(polygon, 3, clip);
+        if (count == 0) {
+            data.counters.culledFrustum++;
+            continue;
+        }
+        uint32_t polyVaryings[MAX_CLIP_VERTICES];
+        Vec3f polyPts[MAX_CLIP_VERTICES];
+        for (int i = 0; i < count; i++) {
+            const ClipVertex& v = polygon[i];
+            polyPts[i] = v.pos.dehomogenize();
+            if (v.source >= 0) {
+                polyVaryings[i] = face[v.source] * varyingCount;
+                continue;
+            }
+            polyVaryings[i] = data.clippedVaryings.size() | CLIPPED_VARYINGS;
+            for (int k = 0; k < varyingCount; k++) {
+                float value = 0.0f;
+                for (int j = 0; j < 3; j++) {
+                    value += v.weights.raw[j] *
+                             varyings[(size_t)face[j] * varyingCount + k];
+                }
+                data.clippedVaryings.push_back(value);
+            }
+        }
+        for (int i = 1; i + 1 < count; i++) {
+            const int corners[3] = {0, i, i + 1};
+            for (int j = 0; j < 3; j++) {
+                pts[j] = polyPts[corners[j]];
+                triVaryings[j] = polyVaryings[corners[j]];
+            }
+            bin_triangle(data, pts, triVaryings);
+        }
+    }
+}
+
+void TileRenderer::bin_triangle(ThreadData& data, const Vec3f pts[3],
+                                const uint32_t varyings[3]) {
+    // Los mismos vértices en punto fijo con los que triangle() decide qué
+    // pixels cubre
+    SnappedTriangle snapped;
+    if (!snapped.snap(pts)) {
+        data.counters.culledFrustum++;
+        return;
+    }
+    // De espaldas: en sentido horario en la imagen (que se guarda con el
+    // eje y hacia arriba)
+    if (cullBackFaces && snapped.area < 0) {
+        data.counters.culledBackFace++;
+        return;
+    }
+    // Sin ningún centro de pixel dentro de la imagen
+    int x0 = std::max(0, snapped.pixels.x0);
+    int y0 = std::max(0, snapped.pixels.y0);
+    int x1 = std::min(width, snapped.pixels.x1);
+    int y1 = std::min(height, snapped.pixels.y1);
+    if (snapped.area == 0 || x0 >= x1 || y0 >= y1) {
+        data.counters.culledSmall++;
+        return;
+    }
+    data.counters.triangles++;
+    uint32_t index = data.triangles.size();
+    BinnedTriangle tri;
+    for (int j = 0; j < 3; j++) {
+        tri.pts[j] = pts[j];
+        tri.varyings[j] = varyings[j];
+    }
+    data.triangles.push_back(tri);
+    for (int ty = y0 / TILE_SIZE; ty <= (y1 - 1) / TILE_SIZE; ty++) {
+        for (int tx = x0 / TILE_SIZE; tx <= (x1 - 1) / TILE_SIZE; tx++) {
+            TileEntry entry = {(uint32_t)(ty * tilesX + tx), index};
+            data.entries.push_back(entry);
+        }
+    }
+}
+
+void TileRenderer::triangle_varyings(const ThreadData& data,
+                                     const BinnedTriangle& tri,
+                                     const float* out[3]) const {
+    for (int j = 0; j < 3; j++) {
+        uint32_t offset = tri.varyings[j];
+        out[j] = offset & CLIPPED_VARYINGS
+                     ? data.clippedVaryings.data() +
+                           (offset & ~CLIPPED_VARYINGS)
+                     : varyings.data() + offset;
+    }
+}
+
+// Las coordenadas de la franja son las de la imagen con bandY0 filas
+// menos: bandY0 es múltiplo de TILE_SIZE y las y caben en la precisión del
+// float (ver GUARD_BAND), así que los vértices y el redondeo a subpixels
+// solo se desplazan y los pixels cubiertos son los mismos
+void TileRenderer::band_points(const BinnedTriangle& tri,
+                               Vec3f pts[3]) const {
+    for (int j = 0; j < 3; j++) {
+        pts[j] = tri.pts[j];
+        pts[j].y -= bandY0;
+    }
+}
+
+Rect TileRenderer::tile_rect(int tile) const {
+    int x0 = tile % tilesX * TILE_SIZE, y0 = tile / tilesX * TILE_SIZE;
+    Rect clip = {x0, y0 - bandY0, std::min(width, x0 + TILE_SIZE),
+                 std::min(height, y0 + TILE_SIZE) - bandY0};
+    return clip;
+}
+
+void TileRenderer::draw_tile(int tile, int thread, IShader& shader,
+                             const ShaderStages& stages, PNGImage& image,
+                             ZBuffer& zbuffer) {
+    Rect clip = tile_rect(tile);
+    RasterCounters& counters = threadData[thread].raster;
+    for (uint32_t i = tileStart[tile]; i < tileStart[tile + 1]; i++) {
+        const ThreadData& data = threadData[tileTriangles[i].thread];
+        const BinnedTriangle& tri = data.triangles[tileTriangles[i].index];
+        const float* triVaryings[3];
+        triangle_varyings(data, tri, triVaryings);
+        Vec3f pts[3];
+        band_points(tri, pts);
+        stages.triangle(shader, pts, triVaryings, image, zbuffer, clip,
+                        &counters);
+    }
+}
+
+void TileRenderer::draw_tile_deferred(int tile, int thread, IShader& shader,
+                                      const ShaderStages& stages,
+                                      PNGImage& image, ZBuffer& zbuffer) {
+    Rect clip = tile_rect(tile);
+    ThreadData& own = threadData[thread];
+
+    // Pasada de visibilidad, en el mismo orden que draw_tile
+    own.visibility.assign(TILE_SIZE * TILE_SIZE, NO_TRIANGLE);
+    uint32_t begin = tileStart[tile], end = tileStart[tile + 1];
+    for (uint32_t i = begin; i < end; i++) {
+        const ThreadData& data = threadData[tileTriangles[i].thread];
+        const BinnedTriangle& tri = data.triangles[tileTriangles[i].index];
+        Vec3f pts[3];
+        band_points(tri, pts);
+        triangle_visibility(pts, i - begin, zbuffer, clip,
+                            own.visibility.data(), TILE_SIZE, &own.raster);
+    }
+
+    // Pasada de sombreado: solo los pixels visibles de cada triángulo
+    for (uint32_t i = begin; i < end; i++) {
+        const ThreadData& data = threadData[tileTriangles[i].thread];
+        const BinnedTriangle& tri = data.triangles[tileTriangles[i].index];
+        const float* triVaryings[3];
+        triangle_varyings(data, tri, triVaryings);
+        Vec3f pts[3];
+        band_points(tri, pts);
+        stages.shade(shader, pts, triVaryings, image, zbuffer, clip,
+                     own.visibility.data(), i - begin, &own.raster);
+    }
+}
+
+bool TileRenderer::next_tile(int thread, int& tile) {
+    std::atomic<uint64_t>& own = work[thread].range;
+    uint64_t range = own.load();
+    while ((uint32_t)range < range >> 32) {
+        uint32_t begin = range, end = range >> 32;
+        if (own.compare_exchange_weak(range, pack_range(begin + 1, end))) {
+            tile = tileOrder[begin];
+            return true;
+        }
+    }
+    // Sin celdas propias: robar la mitad de las que le quedan a otro hilo
+    // (la primera se dibuja ya, el resto pasan a ser propias)
+    for (int i = 1; i < numThreads; i++) {
+        std::atomic<uint64_t>& other = work[(thread + i) % numThreads].range;
+        range = other.load();
+        while ((uint32_t)range < range >> 32) {
+            uint32_t begin = range, end = range >> 32;
+            uint32_t half = (end - begin + 1) / 2;
+            if (other.compare_exchange_weak(range,
+                                            pack_range(begin, end - half))) {
+                own.store(pack_range(end - half + 1, end));
+                tile = tileOrder[end - half];
+                return true;
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <limits>
+#include <new>
+#include <vector>
+#include "geometry.h"
+#include "model.h"
+#include "our_gl.h"
+#include "pngimage/arena.h"
+#include "pngimage/pngimage.h"
+#include "pngimage/workerpool.h"
+
+// Dibujo de un modelo en paralelo, en tres fases:
+//   1. Vértices: cada vértice del modelo (combinación distinta de posición,
+//      textura y normal) se transforma una sola vez con vertex, aunque lo
+//      compartan varias caras. Los hilos se reparten los vértices y escriben
+//      posiciones y varyings en arrays planos, indexados por vértice
+//   2. Ensamblado: los hilos se reparten las caras, descartan las que quedan
+//      fuera de la imagen o detrás de la cámara, recortan en coordenadas
+//      homogéneas las que cruzan el plano cercano o la guard band, descartan
+//      los triángulos de espaldas a la cámara o que no cubren ningún centro
+//      de pixel, y apuntan el resto en las celdas (tiles) de TILE_SIZE x
+//      TILE_SIZE pixels que tocan
+//   3. Cada hilo dibuja celdas completas: su parte de la imagen y del
+//      z-buffer se queda en la caché de un solo núcleo y no hacen falta
+//      cerrojos. Las celdas se reparten por igual al empezar y el hilo que
+//      termina las suyas roba la mitad de las que le quedan a otro
+// Dentro de cada celda los triángulos se dibujan en el orden de las caras,
+// así el resultado es el mismo que dibujándolos uno a uno con triangle()
+// En modo DEFERRED cada celda se dibuja en dos pasadas: primero solo la
+// profundidad de sus triángulos, apuntando cuál queda visible en cada pixel,
+// y después se sombrean solo los pixels visibles de cada triángulo (ver
+// triangle_visible). Solo con shaders que no descartan pixels
+// Con draw_bands la fase 3 se hace por franjas de filas de celdas, y solo
+// hace falta memoria para la imagen y el z-buffer de una franja
+class TileRenderer {
+   public:
+    enum Mode { IMMEDIATE, DEFERRED };
+
+    // Múltiplo de ZBuffer::GROUP_SIZE (ver triangle)
+    static const int TILE_SIZE = 64;
+    static_assert(TILE_SIZE % ZBuffer::GROUP_SIZE == 0,
+                  "las celdas no pueden compartir grupos del z-buffer");
+
+    // Datos del último dibujo
+    struct Stats {
+        int64_t corners;   // esquinas de las caras (3 por cara)
+        int64_t vertices;  // vértices transformados
+        // Ensamblado: caras del modelo, caras descartadas enteras y caras
+        // recortadas, y después triángulos (los recortados pueden dar
+        // varios) descartados y dibujados
+        int64_t faces;
+        int64_t culledFrustum;   // fuera de la imagen o detrás de la cámara
+        int64_t clipped;         // cruzan el plano cercano o la guard band
+        int64_t culledBackFace;  // de espaldas a la cámara
+        int64_t culledSmall;     // sin ningún centro de pixel en la imagen
+        int64_t triangles;
+        // Rasterización (ver RasterCounters)
+        uint64_t fragments;
+        uint64_t occluded;
+        uint64_t shaded;
+        uint64_t occludedTriangles;
+        uint64_t invocations;  // pixels sombreados
+        // Segundos de cada fase
+        double vertexTime, binTime, rasterTime;
+
+        // Esquinas que reutilizan un vértice ya transformado
+        double hit_rate() const {
+            return corners > 0 ? 1.0 - (double)vertices / corners : 0.0;
+        }
+    };
+
+    // numThreads <= 0: uno por núcleo de la CPU
+    explicit TileRenderer(int numThreads = 0);
+    ~TileRenderer();
+    int threads() const { return numThreads; }
+    const Stats& stats() const { return lastStats; }
+    // Descartar los triángulos de espaldas a la cámara (por defecto sí): los
+    // que se ven en sentido horario en la imagen final
+    void set_back_face_culling(bool enabled) { cullBackFaces = enabled; }
+    // IMMEDIATE (por defecto) o DEFERRED (mejor cuanto más caro es el
+    // shader y más pixels se dibujan varias veces). DEFERRED solo se usa
+    // con shaders que no descartan pixels (CAN_DISCARD = false): si no, un
+    // pixel descartado dejaría un hueco en vez del triángulo de detrás
+    void set_mode(Mode mode) { this->mode = mode; }
+
+    // Dibuja las caras de model con una copia de shader por hilo (los
+    // varyings son propios de cada hilo). Las fases de vértices y de
+    // rasterización se compilan para el tipo Shader, sin llamadas virtuales
+    // por vértice ni por pixel (con Shader = IShader se usan las virtuales)
+    template <typename Shader>
+    void draw(const Model& model, const Shader& shader, PNGImage& image,
+              ZBuffer& zbuffer) {
+        IShader* const* shaders = copy_shaders(shader);
+        ShaderStages stages = {shade_vertices<Shader>, draw_triangle<Shader>,
+                               shade_triangle<Shader>, Shader::CAN_DISCARD};
+        draw_shaders(model, shaders, stages, image, zbuffer);
+        destroy_shaders<Shader>(shaders);
+    }
+
+    // Como draw, para una imagen de width x height que no tiene por qué
+    // caber en memoria: las fases de vértices y ensamblado se hacen una vez
+    // para toda la imagen, y después se dibuja cada franja de band.height
+    // filas (múltiplo de TILE_SIZE, band y zbuffer de al menos width de
+    // ancho) de arriba abajo, en el orden de las filas de un archivo PNG
+    // Antes de cada franja band se rellena con background y zbuffer con la
+    // profundidad mínima, y al terminarla se llama a output(band, rows):
+    // la fila y de band es la fila y0 + y de la imagen, para y < rows
+    // Si output devuelve false (p.ej. no se ha podido escribir la franja)
+    // no se dibujan las siguientes y draw_bands devuelve false
+    template <typename Shader, typename Output>
+    bool draw_bands(const Model& model, const Shader& shader, int width,
+                    int height, PNGImage& band, ZBuffer& zbuffer,
+                    Output output,
+                    const RGBColor& background = RGBColor::Black) {
+        if (!check_band(width, band, zbuffer)) return false;
+        int bandRows = band.height;
+        IShader* const* shaders = copy_shaders(shader);
+        ShaderStages stages = {shade_vertices<Shader>, draw_triangle<Shader>,
+                               shade_triangle<Shader>, Shader::CAN_DISCARD};
+        prepare(model, shaders, stages, width, height);
+        bool ok = true;
+        for (int y0 = (height - 1) / bandRows * bandRows; ok && y0 >= 0;
+             y0 -= bandRows) {
+            int rows = std::min(height - y0, bandRows);
+            band.fill(background);
+            zbuffer.fill(-std::numeric_limits<float>::max());
+            raster(shaders, stages, y0, y0 + rows, band, zbuffer);
+            ok = output(band, rows);
+        }
+        finish_stats();
+        destroy_shaders<Shader>(shaders);
+        return ok;
+    }
+
+   private:
+    // Partes de las fases que dependen del tipo de shader
+    struct ShaderStages {
+        // Vértices begin..end-1 de la fase de vértices
+        void (*vertices)(IShader& shader, int begin, int end,
+                         Vec4f* positions, float* varyings);
+        void (*triangle)(IShader& shader, Vec3f* pts,
+                         const float* const varyings[3], PNGImage& image,
+                         ZBuffer& zbuffer, const Rect& clip,
+                         RasterCounters* counters);
+        // Modo DEFERRED: pixels visibles de un triángulo (ver
+        // triangle_visible)
+        void (*shade)(IShader& shader, Vec3f* pts,
+                      const float* const varyings[3], PNGImage& image,
+                      ZBuffer& zbuffer, const Rect& clip, const uint32_t* ids,
+                      uint32_t id, RasterCounters* counters);
+        // Shader::CAN_DISCARD: entonces se dibuja en modo IMMEDIATE aunque
+        // se haya pedido DEFERRED
+        bool canDiscard;
+    };
+
+    template <typename Shader>
+    static void shade_vertices(IShader& base, int begin, int end,
+                               Vec4f* positions, float* varyings) {
+        Shader& shader = static_cast<Shader&>(base);
+        int count = shader.Shader::varying_count();
+        for (int i = begin; i < end; i++) {
+            positions[i] =
+                shader.Shader::vertex(i, varyings + (size_t)i * count);
+        }
+    }
+
+    template <typename Shader>
+    static void draw_triangle(IShader& base, Vec3f* pts,
+                              const float* const varyings[3],
+                              PNGImage& image, ZBuffer& zbuffer,
+                              const Rect& clip, RasterCounters* counters) {
+        Shader& shader = static_cast<Shader&>(base);
+        shader.Shader::set_varyings(varyings);
+        triangle(pts, shader, image, zbuffer, clip, counters);
+    }
+
+    template <typename Shader>
+    static void shade_triangle(IShader& base, Vec3f* pts,
+                               const float* const varyings[3],
+                               PNGImage& image, ZBuffer& zbuffer,
+                               const Rect& clip, const uint32_t* ids,
+                               uint32_t id, RasterCounters* counters) {
+        Shader& shader = static_cast<Shader&>(base);
+        shader.Shader::set_varyings(varyings);
+        triangle_visible(pts, shader, image, zbuffer, clip, ids, TILE_SIZE, id,
+                         counters);
+    }
+
+    struct BinnedTriangle {
+        Vec3f pts[3];  // coordenadas en pantalla
+        // Posición de los varyings de cada vértice en varyings o, con
+        // CLIPPED_VARYINGS, en los clippedVaryings del hilo (vértices creados
+        // al recortar)
+        uint32_t varyings[3];
+    };
+    static const uint32_t CLIPPED_VARYINGS = 1u << 31;
+
+    // Celda tocada por el triángulo index de los ensamblados por un hilo
+    struct TileEntry {
+        uint32_t tile, index;
+    };
+    // Triángulo de una celda: el index de los ensamblados por el hilo thread
+    struct TileTriangle {
+        uint32_t thread, index;
+    };
+
+    // Datos de cada hilo
+    struct ThreadData {
+        // Triángulos ensamblados y las celdas que toca cada uno
+        std::vector<BinnedTriangle> triangles;
+        std::vector<TileEntry> entries;
+        std::vector<float> clippedVaryings;
+        Stats counters;  // solo los contadores de ensamblado
+        RasterCounters raster;
+        // Modo DEFERRED: triángulo visible en cada pixel de la celda (en el
+        // orden en que se dibujan)
+        std::vector<uint32_t> visibility;
+    };
+
+    // Celdas pendientes de un hilo: índices begin (32 bits bajos) a end (32
+    // bits altos) de tileOrder. El dueño toma de begin y los demás roban de
+    // end, siempre con compare_exchange
+    // (rellenado a 64 bytes para que cada hilo use su propia línea de caché)
+    struct WorkRange {
+        std::atomic<uint64_t> range;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    WorkerPool pool;  // los hilos de las tres fases
+    int numThreads;
+    bool cullBackFaces;
+    Mode mode;
+    // Tamaño de la imagen entera y fila de la imagen que es la primera de
+    // la franja que se dibuja (0 sin franjas)
+    int width, height;
+    int bandY0;
+    int tilesX, tilesY;
+    Stats lastStats;
+    // Salida de la fase de vértices: posición y varyingCount floats por
+    // vértice
+    std::vector<Vec4f> positions;
+    std::vector<float> varyings;
+    int varyingCount;
+    std::vector<ThreadData> threadData;
+    // Triángulos de todos los hilos ordenados por celda: los de la celda
+    // tile van de tileStart[tile] a tileStart[tile + 1], en el orden de las
+    // caras (los hilos de la fase 2 tienen caras consecutivas)
+    // Así la memoria por celda es un solo índice y no depende de los hilos
+    std::vector<uint32_t> tileStart;
+    std::vector<TileTriangle> tileTriangles;
+    std::vector<int> tileOrder;  // celdas con algún triángulo
+    WorkRange* work;             // uno por hilo
+    // Memoria de cada dibujo (las copias del shader): se vacía al empezar
+    // el siguiente. El resto de buffers son vectores que conservan su
+    // capacidad entre dibujos, así al repetir un dibujo no se reserva nada
+    Arena frameArena;
+
+    // Una copia de shader por hilo, en frameArena
+    template <typename Shader>
+    IShader* const* copy_shaders(const Shader& shader) {
+        frameArena.reset();
+        IShader** shaders = frameArena.allocate<IShader*>(numThreads);
+        for (int t = 0; t < numThreads; t++) {
+            shaders[t] = new (frameArena.allocate<Shader>(1)) Shader(shader);
+        }
+        return shaders;
+    }
+    template <typename Shader>
+    void destroy_shaders(IShader* const* shaders) {
+        for (int t = 0; t < numThreads; t++) {
+            static_cast<Shader*>(shaders[t])->~Shader();
+        }
+    }
+
+    void draw_shaders(const Model& model, IShader* const* shaders,
+                      const ShaderStages& stages, PNGImage& image,
+                      ZBuffer& zbuffer);
+    // Fases 1 y 2 para una imagen de width x height
+    void prepare(const Model& model, IShader* const* shaders,
+                 const ShaderStages& stages, int width, int height);
+    // Fase 3 para las filas [y0, y1) de la imagen (múltiplos de TILE_SIZE
+    // o height), dibujadas desde la fila 0 de image y zbuffer
+    void raster(IShader* const* shaders, const ShaderStages& stages, int y0,
+                int y1, PNGImage& image, ZBuffer& zbuffer);
+    // Suma los contadores de los hilos en lastStats
+    void finish_stats();
+    bool check_band(int width, const PNGImage& band,
+                    const ZBuffer& zbuffer) const;
+    void assemble(int thread, int begin, int end, const Model& model);
+    // Triángulo ya recortado: descartar o apuntar en sus celdas
+    void bin_triangle(ThreadData& data, const Vec3f pts[3],
+                      const uint32_t varyings[3]);
+    // Junta las celdas de los hilos en tileStart y tileTriangles
+    void sort_bins();
+    void draw_tile(int tile, int thread, IShader& shader,
+                   const ShaderStages& stages, PNGImage& image,
+                   ZBuffer& zbuffer);
+    void draw_tile_deferred(int tile, int thread, IShader& shader,
+                            const ShaderStages& stages, PNGImage& image,
+                            ZBuffer& zbuffer);
+    // Varyings de los vértices de tri, ensamblado por el hilo de data
+    void triangle_varyings(const ThreadData& data, const BinnedTriangle& tri,
+                           const float* out[3]) const;
+    // Vértices de tri en las coordenadas de la franja
+    void band_points(const BinnedTriangle& tri, Vec3f pts[3]) const;
+    // Rectángulo de tile en las coordenadas de la franja
+    Rect tile_rect(int tile) const;
+    // Siguiente celda que dibuja thread, false si no queda ninguna
+    bool next_tile(int thread, int& tile);
+
+    TileRenderer(const TileRenderer&) = delete;
+    TileRenderer& operator=(const TileRenderer&) = delete;
+};
@@ -0,0 +1,239 @@
+#include "texture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// Con SSE2 los 4 canales de un texel se interpolan a la vez en un registro
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Color RGBA en float para interpolar
+#ifdef __SSE2__
+typedef __m128 Color4;
+
+static inline Color4 load(const uint32_t* texel) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i c = _mm_cvtsi32_si128(*(const int*)texel);
+    c = _mm_unpacklo_epi16(_mm_unpacklo_epi8(c, zero), zero);
+    return _mm_cvtepi32_ps(c);
+}
+
+static inline Color4 lerp(Color4 a, Color4 b, float t) {
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(t)));
+}
+
+static inline RGBColor to_rgb(Color4 c) {
+    __m128i i = _mm_cvttps_epi32(_mm_add_ps(c, _mm_set1_ps(0.5f)));
+    i = _mm_packus_epi16(_mm_packs_epi32(i, i), i);
+    uint32_t rgba = _mm_cvtsi128_si32(i);
+    return RGBColor(rgba, rgba >> 8, rgba >> 16);
+}
+#else
+struct Color4 {
+    float c[4];
+};
+
+static inline Color4 load(const uint32_t* texel) {
+    const uint8_t* p = (const uint8_t*)texel;
+    return Color4{{(float)p[0], (float)p[1], (float)p[2], (float)p[3]}};
+}
+
+static inline Color4 lerp(Color4 a, Color4 b, float t) {
+    for (int i = 0; i < 4; i++) a.c[i] += (b.c[i] - a.c[i]) * t;
+    return a;
+}
+
+static inline RGBColor to_rgb(Color4 c) {
+    return RGBColor((int)(c.c[0] + 0.5f), (int)(c.c[1] + 0.5f),
+                    (int)(c.c[2] + 0.5f));
+}
+#endif
+
+// Reparte las filas [0, rows) entre numThreads hilos (el actual hace la
+// primera parte), en trozos de celdas enteras para que dos hilos no
+// escriban en la misma línea de caché
+template <typename F>
+static void run_rows(int numThreads, int rows, F f) {
+    const int tile = Texture::TILE_SIZE;
+    // Niveles pequeños: no compensa crear hilos
+    numThreads = std::max(1, std::min(numThreads, rows / (16 * tile)));
+    int tiles = (rows + tile - 1) / tile;
+    std::vector<std::thread> threads;
+    for (int i = 1; i < numThreads; i++) {
+        int y0 = tiles * i / numThreads * tile;
+        int y1 = std::min(rows, tiles * (i + 1) / numThreads * tile);
+        threads.push_back(std::thread(f, y0, y1));
+    }
+    f(0, std::min(rows, tiles / numThreads * tile));
+    for (std::thread& t : threads) t.join();
+}
+
+Texture::Texture() : buffer(nullptr), levels(), numLevels(0) {}
+
+Texture::~Texture() { delete[] buffer; }
+
+void Texture::build(const PNGImage& image, bool flipVertically,
+                    int numThreads) {
+    delete[] buffer;
+    buffer = nullptr;
+    numLevels = 0;
+    if (image.data() == nullptr || image.width <= 0 || image.height <= 0) {
+        return;
+    }
+    if (numThreads <= 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Tamaño de los niveles y una sola reserva para todos
+    size_t total = 0;
+    int w = image.width, h = image.height;
+    while (true) {
+        Level& l = levels[numLevels++];
+        l.width = w;
+        l.height = h;
+        l.tilesX = (w + TILE_SIZE - 1) / TILE_SIZE;
+        l.texels = nullptr;
+        total += (size_t)l.tilesX * ((h + TILE_SIZE - 1) / TILE_SIZE) *
+                 (TILE_SIZE * TILE_SIZE);
+        if (w == 1 && h == 1) break;
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+    }
+    const int alignment = 64;
+    buffer = new uint8_t[total * sizeof(uint32_t) + alignment];
+    uint32_t* texels =
+        (uint32_t*)(buffer + (-(uintptr_t)buffer & (alignment - 1)));
+    for (int i = 0; i < numLevels; i++) {
+        Level& l = levels[i];
+        l.texels = texels;
+        texels += (size_t)l.tilesX * ((l.height + TILE_SIZE - 1) / TILE_SIZE) *
+                  (TILE_SIZE * TILE_SIZE);
+    }
+
+    // Nivel 0: copia de la imagen (volteada si hace falta)
+    const Level& base = levels[0];
+    run_rows(numThreads, base.height, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            const uint8_t* src =
+                image.row(flipVertically ? base.height - 1 - y : y);
+            for (int x = 0; x < base.width; x++, src += image.channels) {
+                uint8_t* dst = (uint8_t*)(base.texels + offset(base, x, y));
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst[2] = src[2];
+                dst[3] = image.channels == 4 ? src[3] : 255;
+            }
+        }
+    });
+    // Cada nivel necesita el anterior completo
+    for (int i = 1; i < numLevels; i++) {
+        run_rows(numThreads, levels[i].height,
+                 [&](int y0, int y1) { downsample(i, y0, y1); });
+    }
+}
+
+void Texture::downsample(int level, int y0, int y1) {
+    const Level& src = levels[level - 1];
+    const Level& dst = levels[level];
+    for (int y = y0; y < y1; y++) {
+        int sy0 = 2 * y, sy1 = std::min(2 * y + 1, src.height - 1);
+        for (int x = 0; x < dst.width; x++) {
+            int sx0 = 2 * x, sx1 = std::min(2 * x + 1, src.width - 1);
+            const uint8_t* p[4] = {texel(level - 1, sx0, sy0),
+                                   texel(level - 1, sx1, sy0),
+                                   texel(level - 1, sx0, sy1),
+                                   texel(level - 1, sx1, sy1)};
+            uint8_t* out = (uint8_t*)(dst.texels + offset(dst, x, y));
+            for (int c = 0; c < 4; c++) {
+                out[c] = (p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4;
+            }
+        }
+    }
+}
+
+// Interpolación de los 4 texels de l más cercanos a uv (repitiendo los del
+// borde)
+static inline Color4 bilinear(const Texture::Level& l, Vec2f uv) {
+    // s, t >= -0.5: se redondea hacia abajo sumando 1 antes de truncar
+    float s = uv.x * l.width + 0.5f, t = uv.y * l.height + 0.5f;
+    int x1 = (int)s, y1 = (int)t;
+    float fx = s - x1, fy = t - y1;
+    int x0 = std::max(x1 - 1, 0), y0 = std::max(y1 - 1, 0);
+    x1 = std::min(x1, l.width - 1);
+    y1 = std::min(y1, l.height - 1);
+    Color4 top = lerp(load(l.texels + Texture::offset(l, x0, y0)),
+                      load(l.texels + Texture::offset(l, x1, y0)), fx);
+    Color4 bottom = lerp(load(l.texels + Texture::offset(l, x0, y1)),
+                         load(l.texels + Texture::offset(l, x1, y1)), fx);
+    return lerp(top, bottom, fy);
+}
+
+inline int Texture::select_level(float lod, Filter filter,
+                                 float& weight) const {
+    lod = std::min(std::max(lod, 0.0f), (float)(numLevels - 1));
+    int level = filter == BILINEAR ? (int)(lod + 0.5f) : (int)lod;
+    weight = filter == TRILINEAR ? lod - level : 0.0f;
+    return level;
+}
+
+inline RGBColor Texture::filtered(Vec2f uv, int level, float weight) const {
+    Color4 color = bilinear(levels[level], uv);
+    if (weight > 0.0f) {
+        color = lerp(color, bilinear(levels[level + 1], uv), weight);
+    }
+    return to_rgb(color);
+}
+
+inline bool Texture::inside(Vec2f uv) const {
+    int x = (int)(uv.x * width());
+    int y = (int)(uv.y * height());
+    return x >= 0 && x < width() && y >= 0 && y < height();
+}
+
+RGBColor Texture::sample(Vec2f uv, float lod, Filter filter) const {
+    if (filter == NEAREST || !inside(uv)) return nearest(uv);
+    float weight;
+    int level = select_level(lod, filter, weight);
+    return filtered(uv, level, weight);
+}
+
+float Texture::lod(float dudx, float dvdx, float dudy, float dvdy) const {
+    float w = width(), h = height();
+    float x = dudx * w * (dudx * w) + dvdx * h * (dvdx * h);
+    float y = dudy * w * (dudy * w) + dvdy * h * (dvdy * h);
+    float rho2 = std::max(x, y);
+    // Menos de un texel por pixel: nivel 0
+    return rho2 > 1.0f ? 0.5f * std::log2(rho2) : 0.0f;
+}
+
+void Texture::sample_block(const float* u, const float* v, int w,
+                           uint32_t mask, Filter filter,
+                           RGBColor* colors) const {
+    if (filter == NEAREST) {
+        for (int i = 0; i < 2 * w; i++) {
+            if (mask >> i & 1) colors[i] = nearest(Vec2f(u[i], v[i]));
+        }
+        return;
+    }
+    for (int x = 0; x < w; x += 2) {
+        const int quad[4] = {x, x + 1, x + w, x + w + 1};
+        if ((mask >> quad[0] & 3) == 0 && (mask >> quad[2] & 3) == 0) {
+            continue;
+        }
+        float weight;
+        int level = select_level(
+            lod(u[x + 1] - u[x], v[x + 1] - v[x], u[x + w] - u[x],
+                v[x + w] - v[x]),
+            filter, weight);
+        for (int i : quad) {
+            if (mask >> i & 1) {
+                Vec2f uv(u[i], v[i]);
+                colors[i] = inside(uv) ? filtered(uv, level, weight)
+                                       : RGBColor();
+            }
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+#include "geometry.h"
+#include "pngimage/pngimage.h"
+#include "pngimage/rgbcolor.h"
+
+// Textura con mipmaps para muestrear desde los shaders
+// Cada nivel es la mitad de ancho y de alto que el anterior (redondeando
+// hacia abajo, mínimo 1) hasta llegar a 1x1, y guarda sus texels (RGBA, 4
+// bytes) en celdas de TILE_SIZE x TILE_SIZE: los 16 texels de una celda
+// ocupan una línea de caché, así los texels vecinos en vertical también
+// están cerca en memoria
+// Coordenadas de textura: (0, 0) es la esquina de abajo a la izquierda y
+// fuera de [0, 1] x [0, 1] el color es negro
+class Texture {
+   public:
+    enum Filter {
+        NEAREST,   // texel más cercano del nivel 0
+        BILINEAR,  // 4 texels del nivel más cercano a lod
+        TRILINEAR  // 4 texels de los dos niveles entre los que está lod
+    };
+    static const int TILE_SIZE = 4;
+    static const int MAX_LEVELS = 32;
+
+    Texture();
+    ~Texture();
+    // Copia image en el nivel 0 y genera el resto, repartiendo las filas
+    // entre numThreads hilos (<= 0: uno por núcleo)
+    // flipVertically: la primera fila de image es la de arriba (v = 1),
+    // como en los archivos PNG
+    void build(const PNGImage& image, bool flipVertically = false,
+               int numThreads = 0);
+    bool empty() const { return numLevels == 0; }
+    int width() const { return numLevels > 0 ? levels[0].width : 0; }
+    int height() const { return numLevels > 0 ? levels[0].height : 0; }
+    int level_count() const { return numLevels; }
+
+    // Texel (x, y) del nivel level (sin comprobar límites)
+    const uint8_t* texel(int level, int x, int y) const {
+        const Level& l = levels[level];
+        return (const uint8_t*)(l.texels + offset(l, x, y));
+    }
+    // Texel más cercano del nivel 0 (el mismo que da la imagen original). En
+    // el header para que se pueda expandir en los shaders
+    RGBColor nearest(Vec2f uv) const {
+        int x = (int)(uv.x * width());
+        int y = (int)(uv.y * height());
+        if (x < 0 || x >= width() || y < 0 || y >= height()) {
+            return RGBColor();
+        }
+        const uint8_t* p = texel(0, x, y);
+        return RGBColor(p[0], p[1], p[2]);
+    }
+    // lod: log2 de los texels del nivel 0 por pixel (ver block_lod)
+    RGBColor sample(Vec2f uv, float lod, Filter filter) const;
+    // Bloque de 2 filas de w pixels (w par, la segunda fila empieza en
+    // u + w y v + w): muestrea los pixels de mask con el lod de cada grupo
+    // de 2x2, calculado a partir de las diferencias de uv entre sus pixels
+    // (los de fuera de mask también cuentan para el lod)
+    void sample_block(const float* u, const float* v, int w, uint32_t mask,
+                      Filter filter, RGBColor* colors) const;
+    // lod de un grupo de 2x2 pixels a partir de las derivadas de uv en x e
+    // y (en unidades de textura por pixel)
+    float lod(float dudx, float dvdx, float dudy, float dvdy) const;
+
+    // Nivel de la textura: texels de (x, y) en texels[offset(l, x, y)]
+    struct Level {
+        int width, height;
+        int tilesX;        // celdas por fila
+        uint32_t* texels;  // dentro de buffer
+    };
+    const Level& level(int i) const { return levels[i]; }
+    // Posición del texel (x, y): celda y, dentro de ella, fila a fila
+    static size_t offset(const Level& l, int x, int y) {
+        return ((size_t)(y / TILE_SIZE) * l.tilesX + x / TILE_SIZE) *
+                   (TILE_SIZE * TILE_SIZE) +
+               y % TILE_SIZE * TILE_SIZE + x % TILE_SIZE;
+    }
+
+   private:
+    uint8_t* buffer;  // todos los niveles, alineado a 64 bytes
+    Level levels[MAX_LEVELS];
+    int numLevels;
+
+    // Filas [y0, y1) del nivel level a partir del anterior (media de 2x2)
+    void downsample(int level, int y0, int y1);
+    bool inside(Vec2f uv) const;
+    // Nivel (y peso del siguiente con TRILINEAR) para lod
+    int select_level(float lod, Filter filter, float& weight) const;
+    RGBColor filtered(Vec2f uv, int level, float weight) const;
+
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
+};